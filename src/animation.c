@@ -80,15 +80,29 @@ Keyframe animation_track_interpolate(AnimationTrack* track, double time) {
         return empty;
     }
 
+    // A single pose (or zero-length track) is static
+    if (track->keyframe_count == 1 || track->duration <= 0.0) {
+        Keyframe result = track->keyframes[0];
+        result.time = time;
+        result.velocity = vector_create(0, 0, 0);
+        return result;
+    }
+
     // Wrap time to animation duration
     time = fmod(time, track->duration);
     if (time < 0) time += track->duration;
 
-    // Find keyframes to interpolate between
+    // Find keyframes to interpolate between: next is the first keyframe not
+    // before time, found by binary search over the time-sorted track
     int next_idx = 0;
-    while (next_idx < track->keyframe_count && 
-           track->keyframes[next_idx].time < time) {
-        next_idx++;
+    int end = track->keyframe_count;
+    while (next_idx < end) {
+        int mid = next_idx + (end - next_idx) / 2;
+        if (track->keyframes[mid].time < time) {
+            next_idx = mid + 1;
+        } else {
+            end = mid;
+        }
     }
 
     int prev_idx = next_idx - 1;
@@ -109,8 +123,10 @@ Keyframe animation_track_interpolate(AnimationTrack* track, double time) {
     double segment_duration = next->time - prev->time;
     if (segment_duration < 0) segment_duration += track->duration;
     
-    double t = (time - prev->time) / segment_duration;
-    if (t < 0) t += 1.0;
+    // Time since prev, measured across the loop seam when wrapping around
+    double elapsed = time - prev->time;
+    if (elapsed < 0) elapsed += track->duration;
+    double t = segment_duration > 0.0 ? elapsed / segment_duration : 0.0;
 
     // Apply smooth interpolation
     t = smooth_step(t);
@@ -123,12 +139,81 @@ Keyframe animation_track_interpolate(AnimationTrack* track, double time) {
     result.scale = lerp(prev->scale, next->scale, t);
     result.velocity = vector_subtract(next->position, prev->position);
     
-    // Scale velocity by time step
-    result.velocity = vector_multiply(result.velocity, 1.0 / segment_duration);
+    // Scale velocity by time step (coincident keyframes do not move)
+    result.velocity = segment_duration > 0.0
+        ? vector_multiply(result.velocity, 1.0 / segment_duration)
+        : vector_create(0, 0, 0);
 
     return result;
 }
 
+static Vector3 vector_min3(Vector3 a, Vector3 b) {
+    return vector_create(fmin(a.x, b.x), fmin(a.y, b.y), fmin(a.z, b.z));
+}
+
+static Vector3 vector_max3(Vector3 a, Vector3 b) {
+    return vector_create(fmax(a.x, b.x), fmax(a.y, b.y), fmax(a.z, b.z));
+}
+
+static Vector3 vector_abs3(Vector3 v) {
+    return vector_create(fabs(v.x), fabs(v.y), fabs(v.z));
+}
+
+AnimationExtent animation_track_extent(AnimationTrack* track, double t0, double t1) {
+    AnimationExtent extent = {
+        .position_min = vector_create(0, 0, 0),
+        .position_max = vector_create(0, 0, 0),
+        .max_velocity = vector_create(0, 0, 0),
+        .max_scale = 1.0
+    };
+    if (!track || track->keyframe_count == 0) return extent;
+
+    // Each segment moves monotonically along the line between its keyframes,
+    // so the path over [t0, t1] lies within the end positions plus every
+    // keyframe crossed on the way
+    int all_keyframes = track->duration <= 0.0 || t1 - t0 >= track->duration;
+    if (all_keyframes) {
+        extent.position_min = track->keyframes[0].position;
+        extent.position_max = track->keyframes[0].position;
+    } else {
+        Vector3 p0 = animation_track_interpolate(track, t0).position;
+        Vector3 p1 = animation_track_interpolate(track, t1).position;
+        extent.position_min = vector_min3(p0, p1);
+        extent.position_max = vector_max3(p0, p1);
+    }
+
+    extent.max_scale = 0.0;
+    for (int i = 0; i < track->keyframe_count; i++) {
+        Keyframe* kf = &track->keyframes[i];
+
+        int crossed = all_keyframes;
+        if (!crossed) {
+            // First repetition of this keyframe at or after t0
+            double time = kf->time + ceil((t0 - kf->time) / track->duration) * track->duration;
+            crossed = time <= t1;
+        }
+        if (crossed) {
+            extent.position_min = vector_min3(extent.position_min, kf->position);
+            extent.position_max = vector_max3(extent.position_max, kf->position);
+        }
+
+        Vector3 scale = vector_abs3(kf->scale);
+        extent.max_scale = fmax(extent.max_scale, fmax(scale.x, fmax(scale.y, scale.z)));
+
+        // Segment velocity exactly as animation_track_interpolate reports it
+        Keyframe* next = &track->keyframes[(i + 1) % track->keyframe_count];
+        double segment_duration = next->time - kf->time;
+        if (segment_duration <= 0.0) segment_duration += track->duration;
+        if (segment_duration > 0.0) {
+            Vector3 velocity = vector_abs3(vector_subtract(next->position, kf->position));
+            extent.max_velocity = vector_max3(extent.max_velocity,
+                                              vector_divide(velocity, segment_duration));
+        }
+    }
+
+    return extent;
+}
+
 AnimationState animation_state_create(double frame_rate) {
     AnimationState state = {
         .current_time = 0.0,
@@ -28,11 +28,20 @@ typedef struct {
     int current_frame;    // Current frame number
 } AnimationState;
 
+// Conservative bounds on an animated transform over a time interval
+typedef struct {
+    Vector3 position_min;
+    Vector3 position_max;
+    Vector3 max_velocity;  // Per-axis bound on |velocity| across the whole track
+    double max_scale;      // Largest absolute scale component across the whole track
+} AnimationExtent;
+
 // Function declarations
 AnimationTrack* animation_track_create(void);
 void animation_track_destroy(AnimationTrack* track);
 void animation_track_add_keyframe(AnimationTrack* track, Keyframe keyframe);
 Keyframe animation_track_interpolate(AnimationTrack* track, double time);
+AnimationExtent animation_track_extent(AnimationTrack* track, double t0, double t1);
 void animation_update_state(AnimationState* state);
 AnimationState animation_state_create(double frame_rate);
 
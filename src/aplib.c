@@ -79,6 +79,7 @@ void gc_collect(void) {
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
 
 #define MAX_DECIMAL_DIGITS 100
 #define DECIMAL_PLACES 20
@@ -151,6 +152,7 @@ static double decimal_to_double(APDecimal dec) {
     if (dec.decimal_point > 0) {
         strncpy(buf + i, dec.digits, dec.decimal_point);
         i += dec.decimal_point;
+        buf[i] = '\0';
         if (dec.decimal_point < len) {
             buf[i++] = '.';
             strcpy(buf + i, dec.digits + dec.decimal_point);
@@ -173,161 +175,589 @@ static APDecimal double_to_decimal(double value) {
     return str_to_decimal(buf);
 }
 
-// Basic arithmetic operations
+// String round-trip arithmetic: each operation goes through double and back
+// through "%.20f". The fixed-point kernel below replaced it; it is kept as
+// the baseline for aplib_benchmark.
 static APDecimal add_decimals(APDecimal a, APDecimal b) {
-    // For now, convert to double, add, and convert back
-    // This is temporary until we implement proper string-based arithmetic
     double result = decimal_to_double(a) + decimal_to_double(b);
     return double_to_decimal(result);
 }
 
-static APDecimal subtract_decimals(APDecimal a, APDecimal b) {
-    double result = decimal_to_double(a) - decimal_to_double(b);
-    return double_to_decimal(result);
-}
-
 static APDecimal multiply_decimals(APDecimal a, APDecimal b) {
     double result = decimal_to_double(a) * decimal_to_double(b);
     return double_to_decimal(result);
 }
 
-static APDecimal divide_decimals(APDecimal a, APDecimal b) {
-    double result = decimal_to_double(a) / decimal_to_double(b);
-    return double_to_decimal(result);
+// Fixed-point kernel. Magnitudes are little-endian arrays of 64-bit limbs;
+// the helpers below take the limb count so the wider intermediates of
+// multiply, divide and sqrt can share them.
+typedef unsigned __int128 APWide;
+
+static int limbs_compare(const uint64_t* a, const uint64_t* b, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+static int limbs_is_zero(const uint64_t* a, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i]) return 0;
+    }
+    return 1;
+}
+
+// r = a + b, returning the carry out
+static uint64_t limbs_add(uint64_t* r, const uint64_t* a, const uint64_t* b, int n) {
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        APWide sum = (APWide)a[i] + b[i] + carry;
+        r[i] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+    return carry;
+}
+
+// r = a - b, for a >= b
+static void limbs_subtract(uint64_t* r, const uint64_t* a, const uint64_t* b, int n) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t d = a[i] - b[i];
+        uint64_t next = a[i] < b[i] || d < borrow;
+        r[i] = d - borrow;
+        borrow = next;
+    }
+}
+
+// a = (a << shift) | low_bits, for shift of 1 or 2
+static void limbs_shift_in(uint64_t* a, int n, int shift, uint64_t low_bits) {
+    for (int i = n - 1; i > 0; i--) {
+        a[i] = (a[i] << shift) | (a[i - 1] >> (64 - shift));
+    }
+    a[0] = (a[0] << shift) | low_bits;
+}
+
+static int limbs_bit(const uint64_t* a, int bit) {
+    return (int)((a[bit / 64] >> (bit % 64)) & 1);
+}
+
+// Index of the highest set bit, or -1 for zero
+static int limbs_top_bit(const uint64_t* a, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+        if (a[i]) return i * 64 + 63 - __builtin_clzll(a[i]);
+    }
+    return -1;
+}
+
+static APFixed apfixed_saturated(int negative) {
+    APFixed result;
+    for (int i = 0; i < APFIXED_LIMBS; i++) result.limb[i] = UINT64_MAX;
+    result.negative = negative;
+    return result;
+}
+
+static APFixed apfixed_zero(void) {
+    APFixed result;
+    memset(&result, 0, sizeof(result));
+    return result;
+}
+
+// Zero has no sign, so equal values always compare equal limb for limb
+static APFixed apfixed_canonical(APFixed value) {
+    if (limbs_is_zero(value.limb, APFIXED_LIMBS)) value.negative = 0;
+    return value;
+}
+
+APFixed aplib_fixed_from_double(double value) {
+    if (isnan(value) || value == 0.0) return apfixed_zero();
+    if (isinf(value)) return apfixed_saturated(value < 0);
+
+    int exponent;
+    double fraction = frexp(fabs(value), &exponent);
+    uint64_t mantissa = (uint64_t)ldexp(fraction, 53);
+
+    // Position of the mantissa's lowest bit in the fixed-point magnitude
+    int shift = exponent - 53 + APFIXED_FRACTION_BITS;
+    if (shift + 53 > APFIXED_LIMBS * 64) return apfixed_saturated(value < 0);
+
+    APFixed result = apfixed_zero();
+    result.negative = value < 0;
+    if (shift < 0) {
+        // Bits below the 2^-128 resolution are truncated
+        if (shift <= -64) return apfixed_zero();
+        result.limb[0] = mantissa >> -shift;
+    } else {
+        int limb = shift / 64;
+        int bit = shift % 64;
+        result.limb[limb] = mantissa << bit;
+        if (bit && limb + 1 < APFIXED_LIMBS) result.limb[limb + 1] = mantissa >> (64 - bit);
+    }
+    return apfixed_canonical(result);
+}
+
+double aplib_fixed_to_double(APFixed value) {
+    int top = limbs_top_bit(value.limb, APFIXED_LIMBS);
+    if (top < 0) return 0.0;
+
+    // Round once from the leading 128 bits, folding everything below them
+    // into a sticky bit so ties are not double-rounded
+    int high = top / 64 > 0 ? top / 64 : 1;
+    APWide leading = ((APWide)value.limb[high] << 64) | value.limb[high - 1];
+    if (!limbs_is_zero(value.limb, high - 1)) leading |= 1;
+
+    double result = ldexp((double)leading, 64 * (high - 1) - APFIXED_FRACTION_BITS);
+    return value.negative ? -result : result;
+}
+
+APFixed aplib_fixed_from_string(const char* str) {
+    APFixed result = apfixed_zero();
+    const char* p = str;
+    while (isspace((unsigned char)*p)) p++;
+
+    int negative = 0;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Integer digits accumulate into the upper limbs
+    int int_limb = APFIXED_FRACTION_BITS / 64;
+    for (; isdigit((unsigned char)*p); p++) {
+        uint64_t carry = (uint64_t)(*p - '0');
+        for (int i = int_limb; i < APFIXED_LIMBS; i++) {
+            APWide product = (APWide)result.limb[i] * 10 + carry;
+            result.limb[i] = (uint64_t)product;
+            carry = (uint64_t)(product >> 64);
+        }
+        if (carry) return apfixed_saturated(negative);
+    }
+
+    // Fraction digits are folded in from the last one: f = (digit + f) / 10
+    if (*p == '.') {
+        const char* first = ++p;
+        while (isdigit((unsigned char)*p)) p++;
+        uint64_t fraction[3] = {0, 0, 0};
+        for (const char* d = p - 1; d >= first; d--) {
+            fraction[2] = (uint64_t)(*d - '0');
+            APWide remainder = 0;
+            for (int i = 2; i >= 0; i--) {
+                APWide part = (remainder << 64) | fraction[i];
+                fraction[i] = (uint64_t)(part / 10);
+                remainder = part % 10;
+            }
+        }
+        result.limb[0] = fraction[0];
+        result.limb[1] = fraction[1];
+    }
+
+    result.negative = negative;
+    return apfixed_canonical(result);
+}
+
+APFixed aplib_fixed_add(APFixed a, APFixed b) {
+    APFixed result;
+    if (a.negative == b.negative) {
+        if (limbs_add(result.limb, a.limb, b.limb, APFIXED_LIMBS)) return apfixed_saturated(a.negative);
+        result.negative = a.negative;
+        return result;
+    }
+
+    if (limbs_compare(a.limb, b.limb, APFIXED_LIMBS) >= 0) {
+        limbs_subtract(result.limb, a.limb, b.limb, APFIXED_LIMBS);
+        result.negative = a.negative;
+    } else {
+        limbs_subtract(result.limb, b.limb, a.limb, APFIXED_LIMBS);
+        result.negative = b.negative;
+    }
+    return apfixed_canonical(result);
+}
+
+APFixed aplib_fixed_subtract(APFixed a, APFixed b) {
+    b.negative = !b.negative;
+    return aplib_fixed_add(a, apfixed_canonical(b));
+}
+
+APFixed aplib_fixed_multiply(APFixed a, APFixed b) {
+    uint64_t product[2 * APFIXED_LIMBS] = {0};
+    for (int i = 0; i < APFIXED_LIMBS; i++) {
+        if (!a.limb[i]) continue;
+        uint64_t carry = 0;
+        for (int j = 0; j < APFIXED_LIMBS; j++) {
+            APWide t = (APWide)a.limb[i] * b.limb[j] + product[i + j] + carry;
+            product[i + j] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+        product[i + APFIXED_LIMBS] = carry;
+    }
+
+    // Keep the middle limbs, rounding on the highest discarded bit
+    int low = APFIXED_FRACTION_BITS / 64;
+    if (!limbs_is_zero(product + low + APFIXED_LIMBS, APFIXED_LIMBS - low)) {
+        return apfixed_saturated(a.negative != b.negative);
+    }
+
+    APFixed result;
+    result.negative = a.negative != b.negative;
+    uint64_t round[APFIXED_LIMBS] = {product[low - 1] >> 63};
+    if (limbs_add(result.limb, product + low, round, APFIXED_LIMBS)) {
+        return apfixed_saturated(result.negative);
+    }
+    return apfixed_canonical(result);
+}
+
+APFixed aplib_fixed_divide(APFixed a, APFixed b) {
+    int negative = a.negative != b.negative;
+    if (limbs_is_zero(b.limb, APFIXED_LIMBS)) {
+        return limbs_is_zero(a.limb, APFIXED_LIMBS) ? apfixed_zero() : apfixed_saturated(negative);
+    }
+
+    // Quotient of the dividend scaled by 2^128, by shift-and-subtract long
+    // division; the remainder carries one spare limb for the shift
+    enum { WIDE = APFIXED_LIMBS + APFIXED_FRACTION_BITS / 64 };
+    uint64_t dividend[WIDE] = {0};
+    memcpy(dividend + APFIXED_FRACTION_BITS / 64, a.limb, sizeof(a.limb));
+    uint64_t divisor[APFIXED_LIMBS + 1] = {0};
+    memcpy(divisor, b.limb, sizeof(b.limb));
+    uint64_t remainder[APFIXED_LIMBS + 1] = {0};
+    uint64_t quotient[WIDE] = {0};
+
+    for (int bit = limbs_top_bit(dividend, WIDE); bit >= 0; bit--) {
+        limbs_shift_in(remainder, APFIXED_LIMBS + 1, 1, (uint64_t)limbs_bit(dividend, bit));
+        if (limbs_compare(remainder, divisor, APFIXED_LIMBS + 1) >= 0) {
+            limbs_subtract(remainder, remainder, divisor, APFIXED_LIMBS + 1);
+            quotient[bit / 64] |= (uint64_t)1 << (bit % 64);
+        }
+    }
+
+    if (!limbs_is_zero(quotient + APFIXED_LIMBS, WIDE - APFIXED_LIMBS)) return apfixed_saturated(negative);
+
+    APFixed result;
+    memcpy(result.limb, quotient, sizeof(result.limb));
+    result.negative = negative;
+    return apfixed_canonical(result);
+}
+
+APFixed aplib_fixed_sqrt(APFixed value) {
+    if (value.negative) return apfixed_zero();
+
+    // Digit-by-digit integer square root of the magnitude scaled by a further
+    // 2^128, which lands the root directly on the 2^128 fixed-point scale
+    enum { WIDE = APFIXED_LIMBS + APFIXED_FRACTION_BITS / 64 };
+    uint64_t radicand[WIDE] = {0};
+    memcpy(radicand + APFIXED_FRACTION_BITS / 64, value.limb, sizeof(value.limb));
+    uint64_t root[APFIXED_LIMBS] = {0};
+    uint64_t remainder[APFIXED_LIMBS] = {0};
+
+    int top = limbs_top_bit(radicand, WIDE);
+    for (int bit = top < 0 ? -1 : top | 1; bit > 0; bit -= 2) {
+        uint64_t pair = ((uint64_t)limbs_bit(radicand, bit) << 1) | (uint64_t)limbs_bit(radicand, bit - 1);
+        limbs_shift_in(remainder, APFIXED_LIMBS, 2, pair);
+
+        uint64_t trial[APFIXED_LIMBS];
+        memcpy(trial, root, sizeof(trial));
+        limbs_shift_in(trial, APFIXED_LIMBS, 2, 1);
+        limbs_shift_in(root, APFIXED_LIMBS, 1, 0);
+        if (limbs_compare(remainder, trial, APFIXED_LIMBS) >= 0) {
+            limbs_subtract(remainder, remainder, trial, APFIXED_LIMBS);
+            root[0] |= 1;
+        }
+    }
+
+    APFixed result;
+    memcpy(result.limb, root, sizeof(result.limb));
+    result.negative = 0;
+    return result;
+}
+
+// Vector operations with arbitrary precision. Inputs convert to fixed point
+// exactly, and compound operations round to double only once, at the end.
+typedef struct {
+    APFixed x, y, z;
+} APFixedVector;
+
+static APFixedVector apfixed_vector_from(Vector3 v) {
+    APFixedVector result = {
+        aplib_fixed_from_double(v.x), aplib_fixed_from_double(v.y), aplib_fixed_from_double(v.z)
+    };
+    return result;
+}
+
+static Vector3 apfixed_vector_to(APFixedVector v) {
+    return vector_create(aplib_fixed_to_double(v.x), aplib_fixed_to_double(v.y), aplib_fixed_to_double(v.z));
+}
+
+static APFixedVector apfixed_vector_scale(APFixedVector v, APFixed s) {
+    APFixedVector result = {
+        aplib_fixed_multiply(v.x, s), aplib_fixed_multiply(v.y, s), aplib_fixed_multiply(v.z, s)
+    };
+    return result;
+}
+
+static APFixedVector apfixed_vector_divide(APFixedVector v, APFixed s) {
+    APFixedVector result = {
+        aplib_fixed_divide(v.x, s), aplib_fixed_divide(v.y, s), aplib_fixed_divide(v.z, s)
+    };
+    return result;
+}
+
+static APFixed apfixed_vector_dot(APFixedVector a, APFixedVector b) {
+    return aplib_fixed_add(aplib_fixed_add(aplib_fixed_multiply(a.x, b.x), aplib_fixed_multiply(a.y, b.y)),
+                           aplib_fixed_multiply(a.z, b.z));
 }
 
-// Public API functions
 Vector3 aplib_vector_create(const char* x, const char* y, const char* z) {
-    APDecimal dx = str_to_decimal(x);
-    APDecimal dy = str_to_decimal(y);
-    APDecimal dz = str_to_decimal(z);
-    return vector_create(
-        decimal_to_double(dx),
-        decimal_to_double(dy),
-        decimal_to_double(dz)
-    );
+    APFixedVector v = {aplib_fixed_from_string(x), aplib_fixed_from_string(y), aplib_fixed_from_string(z)};
+    return apfixed_vector_to(v);
 }
 
-// Vector operations with arbitrary precision
 Vector3 aplib_vector_add(Vector3 a, Vector3 b) {
-    APDecimal ax = double_to_decimal(a.x);
-    APDecimal ay = double_to_decimal(a.y);
-    APDecimal az = double_to_decimal(a.z);
-    
-    APDecimal bx = double_to_decimal(b.x);
-    APDecimal by = double_to_decimal(b.y);
-    APDecimal bz = double_to_decimal(b.z);
-    
-    return vector_create(
-        decimal_to_double(add_decimals(ax, bx)),
-        decimal_to_double(add_decimals(ay, by)),
-        decimal_to_double(add_decimals(az, bz))
-    );
+    APFixedVector fa = apfixed_vector_from(a);
+    APFixedVector fb = apfixed_vector_from(b);
+    APFixedVector sum = {
+        aplib_fixed_add(fa.x, fb.x), aplib_fixed_add(fa.y, fb.y), aplib_fixed_add(fa.z, fb.z)
+    };
+    return apfixed_vector_to(sum);
 }
 
 Vector3 aplib_vector_subtract(Vector3 a, Vector3 b) {
-    APDecimal ax = double_to_decimal(a.x);
-    APDecimal ay = double_to_decimal(a.y);
-    APDecimal az = double_to_decimal(a.z);
-    
-    APDecimal bx = double_to_decimal(b.x);
-    APDecimal by = double_to_decimal(b.y);
-    APDecimal bz = double_to_decimal(b.z);
-    
-    return vector_create(
-        decimal_to_double(subtract_decimals(ax, bx)),
-        decimal_to_double(subtract_decimals(ay, by)),
-        decimal_to_double(subtract_decimals(az, bz))
-    );
+    APFixedVector fa = apfixed_vector_from(a);
+    APFixedVector fb = apfixed_vector_from(b);
+    APFixedVector difference = {
+        aplib_fixed_subtract(fa.x, fb.x), aplib_fixed_subtract(fa.y, fb.y), aplib_fixed_subtract(fa.z, fb.z)
+    };
+    return apfixed_vector_to(difference);
 }
 
 Vector3 aplib_vector_multiply(Vector3 v, const char* scalar) {
-    APDecimal s = str_to_decimal(scalar);
-    APDecimal vx = double_to_decimal(v.x);
-    APDecimal vy = double_to_decimal(v.y);
-    APDecimal vz = double_to_decimal(v.z);
-    
-    return vector_create(
-        decimal_to_double(multiply_decimals(vx, s)),
-        decimal_to_double(multiply_decimals(vy, s)),
-        decimal_to_double(multiply_decimals(vz, s))
-    );
+    return apfixed_vector_to(apfixed_vector_scale(apfixed_vector_from(v), aplib_fixed_from_string(scalar)));
 }
 
 Vector3 aplib_vector_divide(Vector3 v, const char* scalar) {
-    APDecimal s = str_to_decimal(scalar);
-    APDecimal vx = double_to_decimal(v.x);
-    APDecimal vy = double_to_decimal(v.y);
-    APDecimal vz = double_to_decimal(v.z);
-    
-    return vector_create(
-        decimal_to_double(divide_decimals(vx, s)),
-        decimal_to_double(divide_decimals(vy, s)),
-        decimal_to_double(divide_decimals(vz, s))
-    );
+    return apfixed_vector_to(apfixed_vector_divide(apfixed_vector_from(v), aplib_fixed_from_string(scalar)));
 }
 
 double aplib_vector_dot(Vector3 a, Vector3 b) {
-    APDecimal ax = double_to_decimal(a.x);
-    APDecimal ay = double_to_decimal(a.y);
-    APDecimal az = double_to_decimal(a.z);
-    
-    APDecimal bx = double_to_decimal(b.x);
-    APDecimal by = double_to_decimal(b.y);
-    APDecimal bz = double_to_decimal(b.z);
-    
-    APDecimal dx = multiply_decimals(ax, bx);
-    APDecimal dy = multiply_decimals(ay, by);
-    APDecimal dz = multiply_decimals(az, bz);
-    
-    return decimal_to_double(add_decimals(add_decimals(dx, dy), dz));
+    return aplib_fixed_to_double(apfixed_vector_dot(apfixed_vector_from(a), apfixed_vector_from(b)));
 }
 
 Vector3 aplib_vector_cross(Vector3 a, Vector3 b) {
-    APDecimal ax = double_to_decimal(a.x);
-    APDecimal ay = double_to_decimal(a.y);
-    APDecimal az = double_to_decimal(a.z);
-    
-    APDecimal bx = double_to_decimal(b.x);
-    APDecimal by = double_to_decimal(b.y);
-    APDecimal bz = double_to_decimal(b.z);
-    
-    return vector_create(
-        decimal_to_double(subtract_decimals(
-            multiply_decimals(ay, bz),
-            multiply_decimals(az, by)
-        )),
-        decimal_to_double(subtract_decimals(
-            multiply_decimals(az, bx),
-            multiply_decimals(ax, bz)
-        )),
-        decimal_to_double(subtract_decimals(
-            multiply_decimals(ax, by),
-            multiply_decimals(ay, bx)
-        ))
-    );
+    APFixedVector fa = apfixed_vector_from(a);
+    APFixedVector fb = apfixed_vector_from(b);
+    APFixedVector cross = {
+        aplib_fixed_subtract(aplib_fixed_multiply(fa.y, fb.z), aplib_fixed_multiply(fa.z, fb.y)),
+        aplib_fixed_subtract(aplib_fixed_multiply(fa.z, fb.x), aplib_fixed_multiply(fa.x, fb.z)),
+        aplib_fixed_subtract(aplib_fixed_multiply(fa.x, fb.y), aplib_fixed_multiply(fa.y, fb.x))
+    };
+    return apfixed_vector_to(cross);
 }
 
 double aplib_vector_length(Vector3 v) {
-    double dot = aplib_vector_dot(v, v);
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%f", dot);
-    APDecimal dec = str_to_decimal(buf);
-    // TODO: Implement proper arbitrary-precision square root
-    return sqrt(decimal_to_double(dec));
+    APFixedVector fv = apfixed_vector_from(v);
+    return aplib_fixed_to_double(aplib_fixed_sqrt(apfixed_vector_dot(fv, fv)));
 }
 
 Vector3 aplib_vector_normalize(Vector3 v) {
-    double length = aplib_vector_length(v);
-    char length_str[32];
-    snprintf(length_str, sizeof(length_str), "%f", length);
-    return aplib_vector_divide(v, length_str);
+    APFixedVector fv = apfixed_vector_from(v);
+    APFixed length = aplib_fixed_sqrt(apfixed_vector_dot(fv, fv));
+    // Zero-length vectors are returned unchanged, as in double precision
+    if (limbs_is_zero(length.limb, APFIXED_LIMBS)) return v;
+    return apfixed_vector_to(apfixed_vector_divide(fv, length));
 }
 
 Vector3 aplib_vector_reflect(Vector3 v, Vector3 normal) {
-    double dot = aplib_vector_dot(v, normal);
-    char dot_str[32];
-    snprintf(dot_str, sizeof(dot_str), "%f", 2.0 * dot);
-    Vector3 scaled = aplib_vector_multiply(normal, dot_str);
-    return aplib_vector_subtract(v, scaled);
-}
\ No newline at end of file
+    APFixedVector fv = apfixed_vector_from(v);
+    APFixedVector fn = apfixed_vector_from(normal);
+    APFixed dot = apfixed_vector_dot(fv, fn);
+    APFixedVector scaled = apfixed_vector_scale(fn, aplib_fixed_add(dot, dot));
+    APFixedVector reflected = {
+        aplib_fixed_subtract(fv.x, scaled.x), aplib_fixed_subtract(fv.y, scaled.y),
+        aplib_fixed_subtract(fv.z, scaled.z)
+    };
+    return apfixed_vector_to(reflected);
+}
+
+// Benchmark operands: vectors at a large coordinate offset, where the
+// double path loses the low bits that the fixed-point path keeps
+#define APLIB_BENCH_VECTORS 64
+#define APLIB_BENCH_OFFSET 1.0e9
+
+static double aplib_bench_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// String round-trip dot product, as the decimal path computed it
+static double aplib_bench_decimal_dot(Vector3 a, Vector3 b) {
+    APDecimal products[3] = {
+        multiply_decimals(double_to_decimal(a.x), double_to_decimal(b.x)),
+        multiply_decimals(double_to_decimal(a.y), double_to_decimal(b.y)),
+        multiply_decimals(double_to_decimal(a.z), double_to_decimal(b.z))
+    };
+    return decimal_to_double(add_decimals(add_decimals(products[0], products[1]), products[2]));
+}
+
+void aplib_benchmark(int iterations) {
+    Vector3 a[APLIB_BENCH_VECTORS];
+    Vector3 b[APLIB_BENCH_VECTORS];
+    for (int i = 0; i < APLIB_BENCH_VECTORS; i++) {
+        a[i] = vector_create(APLIB_BENCH_OFFSET + i * 0.37, APLIB_BENCH_OFFSET - i * 0.11, 0.5 + i);
+        b[i] = vector_create(APLIB_BENCH_OFFSET - i * 0.23, -APLIB_BENCH_OFFSET + i * 0.71, 0.25 * i);
+    }
+
+    const char* names[3] = {"double", "fixed-point", "string round-trip"};
+    double seconds[3];
+    double checksum[3];
+    for (int path = 0; path < 3; path++) {
+        double sum = 0.0;
+        double start = aplib_bench_seconds();
+        for (int n = 0; n < iterations; n++) {
+            for (int i = 0; i < APLIB_BENCH_VECTORS; i++) {
+                if (path == 0) {
+                    sum += fma(a[i].x, b[i].x, fma(a[i].y, b[i].y, a[i].z * b[i].z));
+                } else if (path == 1) {
+                    sum += aplib_vector_dot(a[i], b[i]);
+                } else {
+                    sum += aplib_bench_decimal_dot(a[i], b[i]);
+                }
+            }
+        }
+        seconds[path] = aplib_bench_seconds() - start;
+        checksum[path] = sum;
+    }
+
+    // Exact reference for the error column: the fixed-point dot is exact for
+    // these operands, so compare every path against it
+    double max_error[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < APLIB_BENCH_VECTORS; i++) {
+        double exact = aplib_vector_dot(a[i], b[i]);
+        double results[3] = {
+            fma(a[i].x, b[i].x, fma(a[i].y, b[i].y, a[i].z * b[i].z)),
+            exact,
+            aplib_bench_decimal_dot(a[i], b[i])
+        };
+        for (int path = 0; path < 3; path++) {
+            double error = fabs(results[path] - exact);
+            if (error > max_error[path]) max_error[path] = error;
+        }
+    }
+
+    long long dots = (long long)iterations * APLIB_BENCH_VECTORS;
+    printf("APLIB dot product benchmark: %lld dots per path, coordinates near %.0e\n", dots, APLIB_BENCH_OFFSET);
+    for (int path = 0; path < 3; path++) {
+        printf("  %-18s %10.1f ns/dot  %8.1fx double  max error %.3g  (checksum %.17g)\n",
+               names[path], seconds[path] * 1e9 / (dots > 0 ? dots : 1),
+               seconds[0] > 0 ? seconds[path] / seconds[0] : 0.0, max_error[path], checksum[path]);
+    }
+}
+
+#define APLIB_MESH_MAGIC "APLB"
+#define APLIB_MESH_VERSION 1
+
+// Positions are stored as three doubles whatever the build's component
+// type, so float and double builds share mesh files
+static int aplib_read_positions(FILE* fp, Vector3* vertices, int count) {
+    for (int i = 0; i < count; i++) {
+        double xyz[3];
+        if (fread(xyz, sizeof(double), 3, fp) != 3) return 0;
+        vertices[i] = vector_create(xyz[0], xyz[1], xyz[2]);
+    }
+    return 1;
+}
+
+static int aplib_write_positions(FILE* fp, const Vector3* vertices, int count) {
+    for (int i = 0; i < count; i++) {
+        double xyz[3] = {vertices[i].x, vertices[i].y, vertices[i].z};
+        if (fwrite(xyz, sizeof(double), 3, fp) != 3) return 0;
+    }
+    return 1;
+}
+
+// Mesh files are an APLIBHeader followed by vertex_count positions of three
+// doubles and triangle_count * 3 vertex indices
+int aplib_load_mesh(const char* filename, Mesh* mesh) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open mesh file: %s\n", filename);
+        return 0;
+    }
+
+    APLIBHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, APLIB_MESH_MAGIC, 4) != 0 ||
+        header.version != APLIB_MESH_VERSION) {
+        fprintf(stderr, "Error: %s is not an APLIB mesh\n", filename);
+        fclose(fp);
+        return 0;
+    }
+
+    if (header.vertex_count < 0 || header.triangle_count < 0) {
+        fprintf(stderr, "Error: Mesh %s has a negative element count\n", filename);
+        fclose(fp);
+        return 0;
+    }
+
+    *mesh = mesh_create(vector_create(0, 0, 0), vector_create(0, 0, 0), vector_create(1, 1, 1),
+                        vector_create(1, 1, 1), 0.0);
+    if (!mesh_reserve(mesh, header.vertex_count, header.triangle_count)) {
+        mesh_free(mesh);
+        fclose(fp);
+        return 0;
+    }
+
+    size_t index_count = (size_t)header.triangle_count * 3;
+    if (!aplib_read_positions(fp, mesh->vertices, header.vertex_count) ||
+        fread(mesh->vertex_indices, sizeof(int), index_count, fp) != index_count) {
+        fprintf(stderr, "Error: Truncated mesh file: %s\n", filename);
+        mesh_free(mesh);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    mesh->vertex_count = header.vertex_count;
+    for (int i = 0; i < header.triangle_count; i++) {
+        int* tri = &mesh->vertex_indices[i * 3];
+        for (int j = 0; j < 3; j++) {
+            if (tri[j] < 0 || tri[j] >= mesh->vertex_count) {
+                fprintf(stderr, "Error: Mesh %s has an out-of-range vertex index\n", filename);
+                mesh_free(mesh);
+                return 0;
+            }
+        }
+        if (!mesh_add_triangle(mesh, mesh->vertices[tri[0]], mesh->vertices[tri[1]], mesh->vertices[tri[2]])) {
+            mesh_free(mesh);
+            return 0;
+        }
+    }
+
+    if (!mesh_build_bvh(mesh)) {
+        mesh_free(mesh);
+        return 0;
+    }
+    return 1;
+}
+
+int aplib_save_mesh(const char* filename, Mesh* mesh) {
+    if (!mesh->vertices || !mesh->vertex_indices) return 0;
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open mesh file for writing: %s\n", filename);
+        return 0;
+    }
+
+    APLIBHeader header = {
+        .version = APLIB_MESH_VERSION,
+        .vertex_count = mesh->vertex_count,
+        .triangle_count = mesh->triangle_count
+    };
+    memcpy(header.magic, APLIB_MESH_MAGIC, 4);
+
+    size_t index_count = (size_t)mesh->triangle_count * 3;
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             aplib_write_positions(fp, mesh->vertices, mesh->vertex_count) &&
+             fwrite(mesh->vertex_indices, sizeof(int), index_count, fp) == index_count;
+    fclose(fp);
+    return ok;
+}
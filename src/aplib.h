@@ -3,6 +3,7 @@
 
 #include "mesh.h"
 #include "vector.h"
+#include <stdint.h>
 #include <stdio.h>
 
 // APLIB mesh loading and manipulation functions
@@ -13,6 +14,30 @@ typedef struct {
     int triangle_count; // Number of triangles
 } APLIBHeader;
 
+// Signed 256-bit fixed-point number with 128 integer and 128 fraction bits,
+// stored as a magnitude in little-endian 64-bit limbs plus a sign. Results
+// that overflow the integer range saturate to the largest magnitude.
+#define APFIXED_LIMBS 4
+#define APFIXED_FRACTION_BITS 128
+
+typedef struct {
+    uint64_t limb[APFIXED_LIMBS];
+    int negative;
+} APFixed;
+
+// Conversions are exact except below the 2^-128 resolution; to_double
+// rounds to nearest
+APFixed aplib_fixed_from_double(double value);
+APFixed aplib_fixed_from_string(const char* str);
+double aplib_fixed_to_double(APFixed value);
+
+APFixed aplib_fixed_add(APFixed a, APFixed b);
+APFixed aplib_fixed_subtract(APFixed a, APFixed b);
+APFixed aplib_fixed_multiply(APFixed a, APFixed b);
+// Division by zero saturates; sqrt of a negative value is zero
+APFixed aplib_fixed_divide(APFixed a, APFixed b);
+APFixed aplib_fixed_sqrt(APFixed value);
+
 // Arbitrary-precision vector functions
 Vector3 aplib_vector_create(const char* x, const char* y, const char* z);
 Vector3 aplib_vector_add(Vector3 a, Vector3 b);
@@ -25,6 +50,10 @@ double aplib_vector_length(Vector3 v);
 Vector3 aplib_vector_normalize(Vector3 v);
 Vector3 aplib_vector_reflect(Vector3 v, Vector3 normal);
 
+// Time dot products on the double, fixed-point and former string round-trip
+// paths and print the results to stdout
+void aplib_benchmark(int iterations);
+
 // Original mesh functions
 int aplib_load_mesh(const char* filename, Mesh* mesh);
 int aplib_save_mesh(const char* filename, Mesh* mesh);
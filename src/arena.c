@@ -0,0 +1,66 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(n) (((n) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(ArenaBlock))
+
+void arena_init(Arena* arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size > 0 ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->bytes_allocated = 0;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->bytes_allocated = 0;
+}
+
+static ArenaBlock* arena_new_block(size_t payload) {
+    ArenaBlock* block = (ArenaBlock*)calloc(1, ARENA_HEADER_SIZE + payload);
+    if (block) block->size = payload;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = ARENA_ALIGN(size > 0 ? size : 1);
+
+    ArenaBlock* block = arena->head;
+    if (size > arena->block_size) {
+        // Oversized requests get a dedicated block, linked behind the one
+        // being filled so its free space is not abandoned
+        block = arena_new_block(size);
+        if (!block) return NULL;
+        if (arena->head) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            arena->head = block;
+        }
+    } else if (!block || block->size - block->used < size) {
+        block = arena_new_block(arena->block_size);
+        if (!block) return NULL;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void* memory = (unsigned char*)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    arena->bytes_allocated += size;
+    return memory;
+}
+
+void* arena_grow(Arena* arena, const void* old, size_t old_size, size_t new_size) {
+    void* memory = arena_alloc(arena, new_size);
+    if (memory && old && old_size > 0) {
+        memcpy(memory, old, old_size < new_size ? old_size : new_size);
+    }
+    return memory;
+}
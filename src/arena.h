@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// Block of arena memory; the allocation payload follows the header
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+// Bump allocator for data that lives as long as its owner. Individual
+// allocations are never freed; arena_free releases every block at once.
+typedef struct {
+    ArenaBlock* head;        // Block currently being filled
+    size_t block_size;       // Minimum payload size of new blocks
+    size_t bytes_allocated;  // Total payload handed out, for diagnostics
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+void arena_free(Arena* arena);
+
+// Zeroed, 16-byte aligned storage. Returns NULL on allocation failure.
+void* arena_alloc(Arena* arena, size_t size);
+
+// Move an array into a larger arena allocation, keeping its first old_size
+// bytes. The old storage stays in the arena until arena_free.
+void* arena_grow(Arena* arena, const void* old, size_t old_size, size_t new_size);
+
+#endif
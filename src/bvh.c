@@ -0,0 +1,551 @@
+#include "bvh.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAH_BINS 16
+#define SAH_TRAVERSAL_COST 1.0
+#define SAH_INTERSECTION_COST 1.0
+
+AABB aabb_empty(void) {
+    AABB box = {
+        .min = {DBL_MAX, DBL_MAX, DBL_MAX},
+        .max = {-DBL_MAX, -DBL_MAX, -DBL_MAX}
+    };
+    return box;
+}
+
+AABB aabb_union(AABB a, AABB b) {
+    AABB box = {
+        .min = {fmin(a.min.x, b.min.x), fmin(a.min.y, b.min.y), fmin(a.min.z, b.min.z)},
+        .max = {fmax(a.max.x, b.max.x), fmax(a.max.y, b.max.y), fmax(a.max.z, b.max.z)}
+    };
+    return box;
+}
+
+AABB aabb_grow(AABB box, Vector3 point) {
+    AABB point_box = {point, point};
+    return aabb_union(box, point_box);
+}
+
+Vector3 aabb_centroid(AABB box) {
+    Vector3 c = {
+        0.5 * (box.min.x + box.max.x),
+        0.5 * (box.min.y + box.max.y),
+        0.5 * (box.min.z + box.max.z)
+    };
+    return c;
+}
+
+double aabb_surface_area(AABB box) {
+    double dx = box.max.x - box.min.x;
+    double dy = box.max.y - box.min.y;
+    double dz = box.max.z - box.min.z;
+    if (dx < 0.0 || dy < 0.0 || dz < 0.0) return 0.0;
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+int aabb_is_finite(AABB box) {
+    return isfinite(box.min.x) && isfinite(box.min.y) && isfinite(box.min.z) &&
+           isfinite(box.max.x) && isfinite(box.max.y) && isfinite(box.max.z);
+}
+
+static double vector_axis(Vector3 v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+typedef struct {
+    const AABB* bounds;
+    Vector3* centroids;
+    int* order;          // Working permutation of primitive slots
+    BVHNode* nodes;
+    int node_count;
+    int max_leaf_size;
+    int batch_width;     // Primitives a leaf test handles for the cost of one
+    BVHStats* stats;
+} BuildContext;
+
+typedef struct {
+    AABB bounds;
+    int count;
+} SAHBin;
+
+static void make_leaf(BuildContext* ctx, BVHNode* node, int first, int count, int depth) {
+    node->left_first = first;
+    node->count = count;
+
+    ctx->stats->leaf_count++;
+    if (depth > ctx->stats->max_depth) ctx->stats->max_depth = depth;
+    if (count > ctx->stats->max_leaf_size) ctx->stats->max_leaf_size = count;
+}
+
+static double elapsed_ms(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Bin of a centroid along an axis, clamped so rounding at the top edge and
+// NaN positions still land in a real bin
+static int sah_bin(double position, double lo, double scale) {
+    double b = (position - lo) * scale;
+    if (!(b > 0.0)) return 0;
+    if (b >= SAH_BINS) return SAH_BINS - 1;
+    return (int)b;
+}
+
+static void build_recursive(BuildContext* ctx, int node_index, int first, int count, int depth) {
+    BVHNode* node = &ctx->nodes[node_index];
+
+    AABB bounds = aabb_empty();
+    AABB centroid_bounds = aabb_empty();
+    for (int i = first; i < first + count; i++) {
+        int prim = ctx->order[i];
+        bounds = aabb_union(bounds, ctx->bounds[prim]);
+        centroid_bounds = aabb_grow(centroid_bounds, ctx->centroids[prim]);
+    }
+    node->bounds = bounds;
+
+    if (count <= 1 || depth >= BVH_MAX_DEPTH) {
+        make_leaf(ctx, node, first, count, depth);
+        return;
+    }
+
+    // Evaluate binned SAH splits on every axis
+    double best_cost = DBL_MAX;
+    int best_axis = -1;
+    int best_bin = 0;
+    double parent_area = aabb_surface_area(bounds);
+
+    for (int axis = 0; axis < 3; axis++) {
+        double lo = vector_axis(centroid_bounds.min, axis);
+        double hi = vector_axis(centroid_bounds.max, axis);
+        // An extent that overflows has no usable bin scale
+        if (!isfinite(hi - lo) || hi - lo < 1e-12) continue;
+
+        SAHBin bins[SAH_BINS];
+        for (int b = 0; b < SAH_BINS; b++) {
+            bins[b].bounds = aabb_empty();
+            bins[b].count = 0;
+        }
+
+        double scale = SAH_BINS / (hi - lo);
+        for (int i = first; i < first + count; i++) {
+            int prim = ctx->order[i];
+            int b = sah_bin(vector_axis(ctx->centroids[prim], axis), lo, scale);
+            bins[b].bounds = aabb_union(bins[b].bounds, ctx->bounds[prim]);
+            bins[b].count++;
+        }
+
+        // Sweep from the right to get suffix areas, then from the left
+        double right_area[SAH_BINS];
+        int right_count[SAH_BINS];
+        AABB acc = aabb_empty();
+        int acc_count = 0;
+        for (int b = SAH_BINS - 1; b > 0; b--) {
+            acc = aabb_union(acc, bins[b].bounds);
+            acc_count += bins[b].count;
+            right_area[b] = aabb_surface_area(acc);
+            right_count[b] = acc_count;
+        }
+
+        acc = aabb_empty();
+        acc_count = 0;
+        for (int b = 0; b < SAH_BINS - 1; b++) {
+            acc = aabb_union(acc, bins[b].bounds);
+            acc_count += bins[b].count;
+            if (acc_count == 0 || right_count[b + 1] == 0) continue;
+
+            double cost = aabb_surface_area(acc) * acc_count +
+                          right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    double leaf_cost = SAH_INTERSECTION_COST * ((count + ctx->batch_width - 1) / ctx->batch_width);
+    double split_cost = parent_area > 0.0
+        ? SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * best_cost / parent_area
+        : DBL_MAX;
+
+    // All centroids coincide, or splitting does not pay for a small leaf
+    if (best_axis < 0 || (count <= ctx->max_leaf_size && split_cost >= leaf_cost)) {
+        make_leaf(ctx, node, first, count, depth);
+        return;
+    }
+
+    // Partition primitives around the chosen bin boundary
+    double lo = vector_axis(centroid_bounds.min, best_axis);
+    double scale = SAH_BINS / (vector_axis(centroid_bounds.max, best_axis) - lo);
+    int i = first;
+    int j = first + count - 1;
+    while (i <= j) {
+        int b = sah_bin(vector_axis(ctx->centroids[ctx->order[i]], best_axis), lo, scale);
+        if (b <= best_bin) {
+            i++;
+        } else {
+            int tmp = ctx->order[i];
+            ctx->order[i] = ctx->order[j];
+            ctx->order[j--] = tmp;
+        }
+    }
+
+    int left_count = i - first;
+    if (left_count == 0 || left_count == count) {
+        make_leaf(ctx, node, first, count, depth);
+        return;
+    }
+
+    int left = ctx->node_count;
+    ctx->node_count += 2;
+    node->left_first = left;
+    node->count = 0;
+
+    build_recursive(ctx, left, first, left_count, depth + 1);
+    build_recursive(ctx, left + 1, i, count - left_count, depth + 1);
+}
+
+static int bvh_build_leaves(BVH* bvh, const AABB* bounds, const int* ids, int count,
+                            int max_leaf_size, int batch_width) {
+    memset(bvh, 0, sizeof(BVH));
+    if (count <= 0) return 1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    BuildContext ctx = {
+        .bounds = bounds,
+        .centroids = (Vector3*)malloc(count * sizeof(Vector3)),
+        .order = (int*)malloc(count * sizeof(int)),
+        .nodes = (BVHNode*)malloc((2 * count - 1) * sizeof(BVHNode)),
+        .node_count = 1,
+        .max_leaf_size = max_leaf_size > 0 ? max_leaf_size : 1,
+        .batch_width = batch_width > 0 ? batch_width : 1,
+        .stats = &bvh->stats
+    };
+
+    if (!ctx.centroids || !ctx.order || !ctx.nodes) {
+        free(ctx.centroids);
+        free(ctx.order);
+        free(ctx.nodes);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ctx.centroids[i] = aabb_centroid(bounds[i]);
+        ctx.order[i] = i;
+    }
+
+    build_recursive(&ctx, 0, 0, count, 0);
+
+    // Translate build slots into the caller's primitive ids
+    if (ids) {
+        for (int i = 0; i < count; i++) {
+            ctx.order[i] = ids[ctx.order[i]];
+        }
+    }
+
+    free(ctx.centroids);
+    bvh->nodes = ctx.nodes;
+    bvh->node_count = ctx.node_count;
+    bvh->indices = ctx.order;
+    bvh->index_count = count;
+    bvh->stats.build_ms = elapsed_ms(start);
+    return 1;
+}
+
+int bvh_build(BVH* bvh, const AABB* bounds, const int* ids, int count, int max_leaf_size) {
+    return bvh_build_leaves(bvh, bounds, ids, count, max_leaf_size, 1);
+}
+
+int bvh_build_batched(BVH* bvh, const AABB* bounds, const int* ids, int count, int batch_width) {
+    // Allowing a second batch per leaf trims traversal steps for dense clusters
+    return bvh_build_leaves(bvh, bounds, ids, count, 2 * batch_width, batch_width);
+}
+
+void bvh_free(BVH* bvh) {
+    free(bvh->nodes);
+    free(bvh->indices);
+    free(bvh->end_bounds);
+    memset(bvh, 0, sizeof(BVH));
+}
+
+static AABB leaf_bounds(const BVH* bvh, const BVHNode* node, const AABB* bounds) {
+    AABB box = aabb_empty();
+    for (int i = node->left_first; i < node->left_first + node->count; i++) {
+        box = aabb_union(box, bounds[bvh->indices[i]]);
+    }
+    return box;
+}
+
+void bvh_refit(BVH* bvh, const AABB* bounds) {
+    free(bvh->end_bounds);
+    bvh->end_bounds = NULL;
+
+    // Children are always allocated after their parent, so a reverse sweep
+    // visits every child before the node that contains it
+    for (int n = bvh->node_count - 1; n >= 0; n--) {
+        BVHNode* node = &bvh->nodes[n];
+        if (node->count > 0) {
+            node->bounds = leaf_bounds(bvh, node, bounds);
+        } else {
+            node->bounds = aabb_union(bvh->nodes[node->left_first].bounds,
+                                      bvh->nodes[node->left_first + 1].bounds);
+        }
+    }
+}
+
+int bvh_refit_motion(BVH* bvh, const AABB* start_bounds, const AABB* end_bounds,
+                     double time_start, double time_end) {
+    if (!bvh->end_bounds && bvh->node_count > 0) {
+        bvh->end_bounds = (AABB*)malloc(bvh->node_count * sizeof(AABB));
+        if (!bvh->end_bounds) return 0;
+    }
+    bvh->time_start = time_start;
+    bvh->time_scale = time_end > time_start ? 1.0 / (time_end - time_start) : 0.0;
+
+    // Interpolating the union of two moving boxes never leaves the union of
+    // the interpolated boxes, so each end is refitted on its own
+    for (int n = bvh->node_count - 1; n >= 0; n--) {
+        BVHNode* node = &bvh->nodes[n];
+        if (node->count > 0) {
+            node->bounds = leaf_bounds(bvh, node, start_bounds);
+            bvh->end_bounds[n] = leaf_bounds(bvh, node, end_bounds);
+        } else {
+            node->bounds = aabb_union(bvh->nodes[node->left_first].bounds,
+                                      bvh->nodes[node->left_first + 1].bounds);
+            bvh->end_bounds[n] = aabb_union(bvh->end_bounds[node->left_first],
+                                            bvh->end_bounds[node->left_first + 1]);
+        }
+    }
+    return 1;
+}
+
+// Box node n covers over the whole motion interval
+static AABB swept_bounds(const BVH* bvh, int n) {
+    return bvh->end_bounds ? aabb_union(bvh->nodes[n].bounds, bvh->end_bounds[n]) : bvh->nodes[n].bounds;
+}
+
+// Where a ray's time falls in a motion tree's interval; rays outside it are
+// culled against the nearer end
+static double bvh_time_fraction(const BVH* bvh, double time) {
+    if (!bvh->end_bounds) return 0.0;
+    double fraction = (time - bvh->time_start) * bvh->time_scale;
+    return fraction < 0.0 ? 0.0 : (fraction > 1.0 ? 1.0 : fraction);
+}
+
+double bvh_sah_cost(const BVH* bvh) {
+    if (bvh->node_count == 0) return 0.0;
+    double root_area = aabb_surface_area(swept_bounds(bvh, 0));
+    if (root_area <= 0.0) return 0.0;
+
+    double cost = 0.0;
+    for (int n = 0; n < bvh->node_count; n++) {
+        const BVHNode* node = &bvh->nodes[n];
+        double area = aabb_surface_area(swept_bounds(bvh, n));
+        cost += node->count > 0 ? SAH_INTERSECTION_COST * node->count * area
+                                : SAH_TRAVERSAL_COST * area;
+    }
+    return cost / root_area;
+}
+
+// Shared closest-hit traversal; exactly one of the two callbacks is set
+static int bvh_traverse(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                        BVHIntersectFn intersect, BVHLeafIntersectFn intersect_leaf,
+                        void* context, Hit* hit) {
+    if (bvh->node_count == 0) return 0;
+
+    Vector3 origin = ray->origin;
+    Vector3 inv_dir = {1.0 / ray->direction.x, 1.0 / ray->direction.y, 1.0 / ray->direction.z};
+    double fraction = bvh_time_fraction(bvh, ray->time);
+
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    if (bvh_node_entry(bvh, 0, fraction, origin, inv_dir, t_min, closest_so_far) == INFINITY) {
+        return 0;
+    }
+
+    int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const BVHNode* node = &bvh->nodes[stack[--stack_size]];
+
+        if (node->count > 0) {
+            if (intersect_leaf) {
+                if (intersect_leaf(context, node->left_first, node->count, ray, t_min, closest_so_far, hit)) {
+                    hit_anything = 1;
+                    closest_so_far = hit->t;
+                }
+                continue;
+            }
+            for (int i = node->left_first; i < node->left_first + node->count; i++) {
+                if (intersect(context, bvh->indices[i], ray, t_min, closest_so_far, hit)) {
+                    hit_anything = 1;
+                    closest_so_far = hit->t;
+                }
+            }
+            continue;
+        }
+
+        int near = node->left_first;
+        int far = near + 1;
+        double t_near = bvh_node_entry(bvh, near, fraction, origin, inv_dir, t_min, closest_so_far);
+        double t_far = bvh_node_entry(bvh, far, fraction, origin, inv_dir, t_min, closest_so_far);
+        if (t_far < t_near) {
+            int tmp = near; near = far; far = tmp;
+            double t = t_near; t_near = t_far; t_far = t;
+        }
+
+        // Push the far child first so the near one is popped next
+        if (t_far != INFINITY) stack[stack_size++] = far;
+        if (t_near != INFINITY) stack[stack_size++] = near;
+    }
+
+    return hit_anything;
+}
+
+int bvh_intersect(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                  BVHIntersectFn intersect, void* context, Hit* hit) {
+    return bvh_traverse(bvh, ray, t_min, t_max, intersect, NULL, context, hit);
+}
+
+int bvh_intersect_leaves(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                         BVHLeafIntersectFn intersect_leaf, void* context, Hit* hit) {
+    return bvh_traverse(bvh, ray, t_min, t_max, NULL, intersect_leaf, context, hit);
+}
+
+int bvh_occluded(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                 BVHLeafOccludedFn occluded_leaf, void* context) {
+    if (bvh->node_count == 0) return 0;
+
+    Vector3 origin = ray->origin;
+    Vector3 inv_dir = {1.0 / ray->direction.x, 1.0 / ray->direction.y, 1.0 / ray->direction.z};
+    double fraction = bvh_time_fraction(bvh, ray->time);
+
+    int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        int n = stack[--stack_size];
+        const BVHNode* node = &bvh->nodes[n];
+        if (bvh_node_entry(bvh, n, fraction, origin, inv_dir, t_min, t_max) == INFINITY) continue;
+
+        if (node->count > 0) {
+            if (occluded_leaf(context, node->left_first, node->count, ray, t_min, t_max)) return 1;
+            continue;
+        }
+        stack[stack_size++] = node->left_first + 1;
+        stack[stack_size++] = node->left_first;
+    }
+    return 0;
+}
+
+// Interval form of the slab test for rays sharing an origin whose reciprocal
+// directions lie componentwise in [inv_lo, inv_hi], all of one sign per axis.
+// Returns INFINITY only if every such ray misses the box within [t_min, t_max].
+static double aabb_packet_entry(const AABB* box, Vector3 origin, Vector3 inv_lo, Vector3 inv_hi,
+                                double t_min, double t_max) {
+    double entry = t_min;
+    double exit = t_max;
+    for (int axis = 0; axis < 3; axis++) {
+        double lo = vector_axis(inv_lo, axis);
+        double hi = vector_axis(inv_hi, axis);
+        double near = vector_axis(lo > 0.0 ? box->min : box->max, axis) - vector_axis(origin, axis);
+        double far = vector_axis(lo > 0.0 ? box->max : box->min, axis) - vector_axis(origin, axis);
+
+        double near_lo = near * lo, near_hi = near * hi;
+        double far_lo = far * lo, far_hi = far * hi;
+        double axis_entry = near_lo < near_hi ? near_lo : near_hi;
+        double axis_exit = far_lo > far_hi ? far_lo : far_hi;
+
+        entry = axis_entry > entry ? axis_entry : entry;
+        exit = axis_exit < exit ? axis_exit : exit;
+    }
+    return entry <= exit ? entry : INFINITY;
+}
+
+int bvh_intersect_packet(const BVH* bvh, const Ray* rays, int count, double t_min, double t_max,
+                         BVHLeafIntersectFn intersect_leaf, void* context, Hit* hits, int* found) {
+    if (count <= 0 || count > BVH_PACKET_MAX) return 0;
+
+    // The shared frustum needs a common origin and a consistent, non-zero
+    // direction sign on every axis; anything else is traced ray by ray
+    Vector3 origin = rays[0].origin;
+    Vector3 sign = rays[0].direction;
+    Vector3 inv_dir[BVH_PACKET_MAX];
+    Vector3 inv_lo = {INFINITY, INFINITY, INFINITY};
+    Vector3 inv_hi = {-INFINITY, -INFINITY, -INFINITY};
+    for (int i = 0; i < count; i++) {
+        Vector3 d = rays[i].direction;
+        if (bvh->end_bounds && rays[i].time != rays[0].time) return 0;
+        if (rays[i].origin.x != origin.x || rays[i].origin.y != origin.y || rays[i].origin.z != origin.z ||
+            d.x == 0.0 || d.y == 0.0 || d.z == 0.0 ||
+            (d.x > 0.0) != (sign.x > 0.0) || (d.y > 0.0) != (sign.y > 0.0) || (d.z > 0.0) != (sign.z > 0.0)) {
+            return 0;
+        }
+        inv_dir[i] = (Vector3){1.0 / d.x, 1.0 / d.y, 1.0 / d.z};
+        inv_lo = (Vector3){fmin(inv_lo.x, inv_dir[i].x), fmin(inv_lo.y, inv_dir[i].y), fmin(inv_lo.z, inv_dir[i].z)};
+        inv_hi = (Vector3){fmax(inv_hi.x, inv_dir[i].x), fmax(inv_hi.y, inv_dir[i].y), fmax(inv_hi.z, inv_dir[i].z)};
+    }
+
+    double closest[BVH_PACKET_MAX];
+    for (int i = 0; i < count; i++) {
+        found[i] = 0;
+        closest[i] = t_max;
+    }
+    if (bvh->node_count == 0) return 1;
+
+    // Farthest distance any ray in the packet still cares about
+    double packet_far = t_max;
+    double fraction = bvh_time_fraction(bvh, rays[0].time);
+
+    int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        int n = stack[--stack_size];
+        const BVHNode* node = &bvh->nodes[n];
+        AABB box = bvh->end_bounds ? bvh_node_bounds_at(bvh, n, fraction) : node->bounds;
+        if (aabb_packet_entry(&box, origin, inv_lo, inv_hi, t_min, packet_far) == INFINITY) {
+            continue;
+        }
+
+        if (node->count > 0) {
+            packet_far = t_min;
+            for (int i = 0; i < count; i++) {
+                if (aabb_ray_entry(&box, origin, inv_dir[i], t_min, closest[i]) != INFINITY &&
+                    intersect_leaf(context, node->left_first, node->count, &rays[i], t_min, closest[i], &hits[i])) {
+                    found[i] = 1;
+                    closest[i] = hits[i].t;
+                }
+                if (closest[i] > packet_far) packet_far = closest[i];
+            }
+            continue;
+        }
+
+        int near = node->left_first;
+        int far = near + 1;
+        AABB near_box = bvh->end_bounds ? bvh_node_bounds_at(bvh, near, fraction) : bvh->nodes[near].bounds;
+        AABB far_box = bvh->end_bounds ? bvh_node_bounds_at(bvh, far, fraction) : bvh->nodes[far].bounds;
+        double t_near = aabb_packet_entry(&near_box, origin, inv_lo, inv_hi, t_min, packet_far);
+        double t_far = aabb_packet_entry(&far_box, origin, inv_lo, inv_hi, t_min, packet_far);
+        if (t_far < t_near) {
+            int tmp = near; near = far; far = tmp;
+            double t = t_near; t_near = t_far; t_far = t;
+        }
+
+        if (t_far != INFINITY) stack[stack_size++] = far;
+        if (t_near != INFINITY) stack[stack_size++] = near;
+    }
+
+    return 1;
+}
@@ -0,0 +1,173 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "common.h"
+#include "ray.h"
+#include <math.h>
+
+// Builds never nest deeper than this, so traversal stacks have a fixed size
+#define BVH_MAX_DEPTH 63
+
+// Axis-aligned bounding box
+typedef struct {
+    Vector3 min;
+    Vector3 max;
+} AABB;
+
+AABB aabb_empty(void);
+AABB aabb_union(AABB a, AABB b);
+AABB aabb_grow(AABB box, Vector3 point);
+Vector3 aabb_centroid(AABB box);
+double aabb_surface_area(AABB box);
+// Returns 1 if every coordinate of the box is finite
+int aabb_is_finite(AABB box);
+
+// Slab test against a ray given its precomputed reciprocal direction.
+// Returns the entry distance, or INFINITY if the box is missed within [t_min, t_max].
+static inline double aabb_ray_entry(const AABB* box, Vector3 origin, Vector3 inv_dir,
+                                    double t_min, double t_max) {
+    double tx0 = (box->min.x - origin.x) * inv_dir.x;
+    double tx1 = (box->max.x - origin.x) * inv_dir.x;
+    if (tx0 > tx1) { double t = tx0; tx0 = tx1; tx1 = t; }
+    double ty0 = (box->min.y - origin.y) * inv_dir.y;
+    double ty1 = (box->max.y - origin.y) * inv_dir.y;
+    if (ty0 > ty1) { double t = ty0; ty0 = ty1; ty1 = t; }
+    double tz0 = (box->min.z - origin.z) * inv_dir.z;
+    double tz1 = (box->max.z - origin.z) * inv_dir.z;
+    if (tz0 > tz1) { double t = tz0; tz0 = tz1; tz1 = t; }
+
+    double entry = tx0 > ty0 ? tx0 : ty0;
+    entry = entry > tz0 ? entry : tz0;
+    entry = entry > t_min ? entry : t_min;
+    double exit = tx1 < ty1 ? tx1 : ty1;
+    exit = exit < tz1 ? exit : tz1;
+    exit = exit < t_max ? exit : t_max;
+
+    return entry <= exit ? entry : INFINITY;
+}
+
+// Flattened tree node. Interior nodes keep their two children adjacent at
+// left_first and left_first + 1; leaves reference count primitives starting
+// at left_first in the index array.
+typedef struct {
+    AABB bounds;
+    int left_first;
+    int count;  // 0 for interior nodes
+} BVHNode;
+
+// Build statistics, for weighing build cost against traversal savings
+typedef struct {
+    double build_ms;
+    int leaf_count;
+    int max_depth;
+    int max_leaf_size;
+} BVHStats;
+
+typedef struct {
+    BVHNode* nodes;
+    int node_count;
+    int* indices;    // Caller primitive ids in leaf order
+    int index_count;
+    BVHStats stats;
+
+    // Motion bounds, NULL for a static tree. Node n's box then moves
+    // linearly from nodes[n].bounds at time_start to end_bounds[n] at the
+    // interval's end, and each ray is culled against the box at its own time.
+    AABB* end_bounds;
+    double time_start;
+    double time_scale;  // 1 / interval length
+} BVH;
+
+// Box of node n at the given fraction of a motion tree's interval
+static inline AABB bvh_node_bounds_at(const BVH* bvh, int n, double fraction) {
+    const AABB* a = &bvh->nodes[n].bounds;
+    const AABB* b = &bvh->end_bounds[n];
+    AABB box = {
+        .min = {a->min.x + (b->min.x - a->min.x) * fraction,
+                a->min.y + (b->min.y - a->min.y) * fraction,
+                a->min.z + (b->min.z - a->min.z) * fraction},
+        .max = {a->max.x + (b->max.x - a->max.x) * fraction,
+                a->max.y + (b->max.y - a->max.y) * fraction,
+                a->max.z + (b->max.z - a->max.z) * fraction}
+    };
+    return box;
+}
+
+// Slab test against node n as placed at the given fraction of the motion
+// interval; static trees test the node's own bounds
+static inline double bvh_node_entry(const BVH* bvh, int n, double fraction, Vector3 origin,
+                                    Vector3 inv_dir, double t_min, double t_max) {
+    if (!bvh->end_bounds) {
+        return aabb_ray_entry(&bvh->nodes[n].bounds, origin, inv_dir, t_min, t_max);
+    }
+    AABB box = bvh_node_bounds_at(bvh, n, fraction);
+    return aabb_ray_entry(&box, origin, inv_dir, t_min, t_max);
+}
+
+// Primitive test invoked for each candidate in a visited leaf. Returns 1 and
+// fills hit when the primitive is hit closer than t_max.
+typedef int (*BVHIntersectFn)(void* context, int primitive, const Ray* ray,
+                              double t_min, double t_max, Hit* hit);
+
+// Whole-leaf test, for callers that keep per-slot data in leaf order and can
+// test a leaf's primitives together. first and count index the leaf's run in
+// bvh->indices. Returns 1 and fills hit when a primitive is hit closer than t_max.
+typedef int (*BVHLeafIntersectFn)(void* context, int first, int count, const Ray* ray,
+                                  double t_min, double t_max, Hit* hit);
+
+// Largest bundle bvh_intersect_packet traces at once: an 8x8 pixel block
+#define BVH_PACKET_MAX 64
+
+// Any-hit leaf test for occlusion queries. Returns 1 as soon as any of the
+// leaf's primitives blocks the ray within the given range.
+typedef int (*BVHLeafOccludedFn)(void* context, int first, int count, const Ray* ray,
+                                 double t_min, double t_max);
+
+// Build a binned surface-area-heuristic tree over count primitive bounds.
+// ids (may be NULL for 0..count-1) are the values handed back to the
+// intersection callback. Returns 0 on allocation failure.
+int bvh_build(BVH* bvh, const AABB* bounds, const int* ids, int count, int max_leaf_size);
+// Same build for leaves tested batch_width primitives at a time. Each batch is
+// priced as a single intersection test, and leaves hold up to two batches.
+int bvh_build_batched(BVH* bvh, const AABB* bounds, const int* ids, int count, int batch_width);
+void bvh_free(BVH* bvh);
+
+// Recompute node bounds bottom-up for moved primitives, keeping the topology.
+// bounds is indexed by primitive id. Any motion bounds are dropped.
+void bvh_refit(BVH* bvh, const AABB* bounds);
+
+// Refit the tree with motion bounds over [time_start, time_end]. Primitive
+// i's box must contain it at every time in the interval when interpolated
+// linearly from start_bounds[i] to end_bounds[i]. Returns 0 on allocation
+// failure, leaving the tree unchanged.
+int bvh_refit_motion(BVH* bvh, const AABB* start_bounds, const AABB* end_bounds,
+                     double time_start, double time_end);
+
+// Surface-area cost of the tree relative to its root, used to decide when a
+// refitted tree has degraded enough to be worth rebuilding. Motion trees are
+// priced by the boxes their nodes sweep over the interval.
+double bvh_sah_cost(const BVH* bvh);
+
+// Closest-hit traversal, visiting nearer children first
+int bvh_intersect(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                  BVHIntersectFn intersect, void* context, Hit* hit);
+// Same traversal, handing each visited leaf to intersect_leaf in one call
+int bvh_intersect_leaves(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                         BVHLeafIntersectFn intersect_leaf, void* context, Hit* hit);
+
+// Any-hit traversal for shadow rays: returns 1 at the first leaf that
+// reports a blocker, without ordering children or shrinking the range
+int bvh_occluded(const BVH* bvh, const Ray* ray, double t_min, double t_max,
+                 BVHLeafOccludedFn occluded_leaf, void* context);
+
+// Closest hits for a bundle of up to BVH_PACKET_MAX rays sharing an origin,
+// such as the primary rays of a pixel block. Nodes are culled once for the
+// whole bundle against its interval frustum, and leaves are handed to
+// intersect_leaf for each ray still able to reach them. Fills hits[i] and
+// sets found[i] for every ray that hits. Returns 0 without tracing when the
+// bundle is too divergent for a shared frustum, or its rays' times differ in
+// a motion tree; trace those rays singly.
+int bvh_intersect_packet(const BVH* bvh, const Ray* rays, int count, double t_min, double t_max,
+                         BVHLeafIntersectFn intersect_leaf, void* context, Hit* hits, int* found);
+
+#endif
@@ -27,11 +27,12 @@ typedef struct Hit {
     Vector3 point;
     Vector3 normal;
     Vector2Double tex_coord;    // Texture coordinates (u,v)
-    union {
-        struct Sphere* sphere;
-        struct Mesh* mesh;
-    };
+    // Hit objects are named by index into the scene's containers rather than
+    // by address, so a hit means the same thing in every process sharing a
+    // scene image (see scene_image.h)
+    int object;   // Sphere index, or mesh index when is_mesh is set
     int is_mesh;  // 0 for sphere, 1 for mesh
+    int primitive;  // Triangle index within the mesh, for mesh hits
 } Hit;
 
 #endif
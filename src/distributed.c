@@ -0,0 +1,516 @@
+#include "distributed.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DISTRIBUTED_MAGIC "RTDW"
+#define DISTRIBUTED_VERSION 2
+#define DISTRIBUTED_RELEASE -1  // Assignment frame telling a worker to exit
+#define DISTRIBUTED_REJECT -2   // Assignment frame refusing a worker's settings
+
+// Worker -> coordinator, once after connecting
+typedef struct {
+    char magic[4];
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t samples_per_pixel;
+    int32_t min_samples;
+    int32_t motion_samples;
+    int32_t precision;
+    double adaptive_threshold;
+    double frame_rate;
+    uint64_t scene_hash;  // Scene and camera (see scene_hash)
+} DistributedHello;
+
+// Coordinator -> worker
+typedef struct {
+    int32_t frame;  // Or DISTRIBUTED_RELEASE / DISTRIBUTED_REJECT, with no tile
+    int32_t tile;
+    int32_t x0, y0, x1, y1;
+} DistributedAssignment;
+
+// Worker -> coordinator, followed by the tile's resolved pixels as three
+// doubles each, row by row
+typedef struct {
+    int32_t frame;
+    int32_t tile;
+    int64_t paths;
+} DistributedResult;
+
+#define DISTRIBUTED_MAX_RESULT \
+    (sizeof(DistributedResult) + (size_t)DISTRIBUTED_TILE_SIZE * DISTRIBUTED_TILE_SIZE * 3 * sizeof(double))
+
+static DistributedHello distributed_hello(const Scene* scene, const Camera* camera,
+                                          const RenderSettings* settings, double frame_rate) {
+    DistributedHello hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, DISTRIBUTED_MAGIC, 4);
+    hello.version = DISTRIBUTED_VERSION;
+    hello.width = settings->width;
+    hello.height = settings->height;
+    hello.samples_per_pixel = settings->samples_per_pixel;
+    hello.min_samples = settings->min_samples;
+    hello.motion_samples = scene_motion_samples(scene);
+    hello.precision = vector_get_precision_mode();
+    hello.adaptive_threshold = settings->adaptive_threshold;
+    hello.frame_rate = frame_rate;
+    hello.scene_hash = scene_hash_bytes(scene_hash(scene), camera, sizeof(*camera));
+    return hello;
+}
+
+// Open a socket for address, bound and listening or connected.
+// Returns the descriptor, or -1 on failure.
+static int distributed_open(const char* address, int listening, char* unix_path, size_t unix_path_size) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(local.sun_path)) {
+            fprintf(stderr, "Error: UNIX socket path too long: %s\n", address + 5);
+            return -1;
+        }
+        strcpy(local.sun_path, address + 5);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (listening) {
+            unlink(local.sun_path);  // A stale socket from an earlier run
+            if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0 || listen(fd, 64) != 0) {
+                close(fd);
+                return -1;
+            }
+            if (unix_path) snprintf(unix_path, unix_path_size, "%s", local.sun_path);
+        } else if (connect(fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // host:port, with * or an empty host for every interface
+    const char* colon = strrchr(address, ':');
+    if (!colon) {
+        fprintf(stderr, "Error: Address %s is neither host:port nor unix:/path\n", address);
+        return -1;
+    }
+    char host[256];
+    size_t host_length = (size_t)(colon - address);
+    if (host_length >= sizeof(host)) return -1;
+    memcpy(host, address, host_length);
+    host[host_length] = '\0';
+    int any_host = host_length == 0 || strcmp(host, "*") == 0;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    struct addrinfo* results;
+    if (getaddrinfo(any_host ? (listening ? NULL : "localhost") : host, colon + 1, &hints, &results) != 0) {
+        fprintf(stderr, "Error: Could not resolve %s\n", address);
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int ok;
+        if (listening) {
+            int reuse = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0;
+        } else {
+            ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (!ok) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    return fd;
+}
+
+static double distributed_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Probe idle TCP connections, so a node that loses power or its network
+// fails the connection within about a minute instead of never
+static void distributed_enable_keepalive(int fd) {
+    int on = 1, idle = 30, interval = 10, count = 3;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+static int distributed_send(int fd, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (size > 0) {
+        // A vanished peer must fail the send, not raise SIGPIPE
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 0;
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+static int distributed_receive(int fd, void* data, size_t size) {
+    unsigned char* bytes = (unsigned char*)data;
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return 0;
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return 1;
+}
+
+int distributed_coordinator_init(DistributedCoordinator* coordinator, const char* address,
+                                 const Scene* scene, const Camera* camera, const RenderSettings* settings,
+                                 double frame_rate) {
+    memset(coordinator, 0, sizeof(*coordinator));
+    DistributedHello hello = distributed_hello(scene, camera, settings, frame_rate);
+    memcpy(coordinator->hello, &hello, sizeof(hello));
+    coordinator->hello_size = sizeof(hello);
+
+    coordinator->listen_fd = distributed_open(address, 1, coordinator->unix_path, sizeof(coordinator->unix_path));
+    if (coordinator->listen_fd < 0) {
+        fprintf(stderr, "Error: Could not listen on %s\n", address);
+        return 0;
+    }
+    fprintf(stderr, "Coordinator listening on %s\n", address);
+    return 1;
+}
+
+int distributed_spawn_local_workers(DistributedCoordinator* coordinator, const char* address, int count,
+                                    Scene* scene, const Camera* camera, const RenderSettings* settings,
+                                    double frame_rate) {
+    for (int i = 0; i < count && coordinator->local_worker_count < DISTRIBUTED_MAX_WORKERS; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Error: Could not start local worker %d\n", i);
+            return 0;
+        }
+        if (pid == 0) {
+            // The child shares the already loaded scene, and leaves the
+            // coordinator's socket to the coordinator
+            close(coordinator->listen_fd);
+            int ok = distributed_worker_run(address, scene, camera, settings, frame_rate);
+            _exit(ok ? 0 : 1);
+        }
+        coordinator->local_workers[coordinator->local_worker_count++] = pid;
+    }
+    return 1;
+}
+
+static void distributed_drop_peer(DistributedCoordinator* coordinator, int index, int* tile_state) {
+    DistributedPeer* peer = &coordinator->peers[index];
+    if (peer->tile >= 0 && tile_state) {
+        fprintf(stderr, "\nWorker dropped; requeueing tile %d\n", peer->tile);
+        tile_state[peer->tile] = 0;
+    }
+    close(peer->fd);
+    free(peer->buffer);
+    coordinator->peers[index] = coordinator->peers[--coordinator->peer_count];
+}
+
+// Whether any forked local worker is still running
+static int distributed_local_workers_alive(DistributedCoordinator* coordinator) {
+    int alive = 0;
+    for (int i = 0; i < coordinator->local_worker_count; i++) {
+        if (coordinator->local_workers[i] <= 0) continue;
+        if (waitpid(coordinator->local_workers[i], NULL, WNOHANG) == 0) {
+            alive++;
+        } else {
+            coordinator->local_workers[i] = 0;  // Reaped
+        }
+    }
+    return alive;
+}
+
+int distributed_render_frame(DistributedCoordinator* coordinator, const Scene* scene,
+                             const RenderSettings* settings, Vector3* pixels, RenderStats* stats) {
+    TileScheduler layout;
+    if (!tile_scheduler_init(&layout, settings->width, settings->height, DISTRIBUTED_TILE_SIZE, 1)) {
+        fprintf(stderr, "Error: Could not allocate tile scheduler\n");
+        return 0;
+    }
+
+    // 0 pending, 1 assigned, 2 done
+    int* tile_state = (int*)calloc(layout.tile_count, sizeof(int));
+    if (!tile_state) {
+        fprintf(stderr, "Error: Could not allocate tile state\n");
+        tile_scheduler_destroy(&layout);
+        return 0;
+    }
+
+    const int frame = scene->animation_state.current_frame;
+    int tiles_done = 0;
+    int next_pending = 0;  // Tiles before this are all assigned or done, barring requeues
+    long long paths = 0;
+    int ok = 1;
+
+    while (ok && tiles_done < layout.tile_count) {
+        // Hand a pending tile to every idle worker
+        for (int p = 0; p < coordinator->peer_count; p++) {
+            DistributedPeer* peer = &coordinator->peers[p];
+            if (!peer->greeted || peer->tile >= 0) continue;
+
+            int tile = -1;
+            for (int t = 0; t < layout.tile_count && tile < 0; t++) {
+                int candidate = (next_pending + t) % layout.tile_count;
+                if (tile_state[candidate] == 0) tile = candidate;
+            }
+            if (tile < 0) break;
+
+            const Tile* bounds = &layout.tiles[tile];
+            DistributedAssignment assignment = {frame, tile, bounds->x0, bounds->y0, bounds->x1, bounds->y1};
+            if (!distributed_send(peer->fd, &assignment, sizeof(assignment))) {
+                distributed_drop_peer(coordinator, p--, tile_state);
+                continue;
+            }
+            tile_state[tile] = 1;
+            next_pending = tile + 1;
+            peer->tile = tile;
+            peer->since = distributed_seconds();
+            peer->received = 0;
+            peer->expected = sizeof(DistributedResult) +
+                             (size_t)(bounds->x1 - bounds->x0) * (bounds->y1 - bounds->y0) * 3 * sizeof(double);
+        }
+
+        if (coordinator->peer_count == 0 && coordinator->local_worker_count > 0 &&
+            !distributed_local_workers_alive(coordinator)) {
+            fprintf(stderr, "Error: Every worker has exited with %d tiles left\n", layout.tile_count - tiles_done);
+            ok = 0;
+            break;
+        }
+
+        struct pollfd fds[DISTRIBUTED_MAX_WORKERS + 1];
+        fds[0].fd = coordinator->listen_fd;
+        fds[0].events = POLLIN;
+        for (int p = 0; p < coordinator->peer_count; p++) {
+            fds[p + 1].fd = coordinator->peers[p].fd;
+            fds[p + 1].events = POLLIN;
+        }
+        int peer_count = coordinator->peer_count;
+        int ready = poll(fds, peer_count + 1, 1000);
+
+        // A worker that neither returns its tile nor closes the connection
+        // would hold the tile forever. Drop it once it is far slower than
+        // any tile so far; its tile goes back in the queue.
+        double now = distributed_seconds();
+        double timeout = DISTRIBUTED_TIMEOUT_FACTOR * coordinator->slowest_tile;
+        if (timeout < DISTRIBUTED_MIN_TIMEOUT) timeout = DISTRIBUTED_MIN_TIMEOUT;
+        for (int p = peer_count - 1; p >= 0; p--) {
+            DistributedPeer* peer = &coordinator->peers[p];
+            if ((peer->tile >= 0 || !peer->greeted) && now - peer->since > timeout) {
+                fprintf(stderr, "\nWorker silent for %.0f s\n", now - peer->since);
+                distributed_drop_peer(coordinator, p, tile_state);
+                fds[p + 1] = fds[peer_count];  // Keep fds in step with the moved peer
+                peer_count--;
+            }
+        }
+        if (ready <= 0) continue;
+
+        // Read from existing peers first; dropping one moves the last peer
+        // into its slot, so walk backwards
+        for (int p = peer_count - 1; p >= 0; p--) {
+            if (!(fds[p + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            DistributedPeer* peer = &coordinator->peers[p];
+
+            ssize_t received = recv(peer->fd, peer->buffer + peer->received, peer->expected - peer->received, 0);
+            if (received <= 0) {
+                distributed_drop_peer(coordinator, p, tile_state);
+                continue;
+            }
+            peer->received += (size_t)received;
+            if (peer->received < peer->expected) continue;
+
+            if (!peer->greeted) {
+                if (memcmp(peer->buffer, coordinator->hello, coordinator->hello_size) != 0) {
+                    fprintf(stderr, "\nRejecting a worker with a different scene, camera, settings or build\n");
+                    DistributedAssignment reject = {DISTRIBUTED_REJECT, -1, 0, 0, 0, 0};
+                    distributed_send(peer->fd, &reject, sizeof(reject));
+                    distributed_drop_peer(coordinator, p, tile_state);
+                    continue;
+                }
+                peer->greeted = 1;
+                peer->expected = 0;
+                continue;
+            }
+
+            DistributedResult result;
+            memcpy(&result, peer->buffer, sizeof(result));
+            if (result.frame != frame || result.tile != peer->tile) {
+                fprintf(stderr, "\nWorker returned an unexpected tile\n");
+                distributed_drop_peer(coordinator, p, tile_state);
+                continue;
+            }
+
+            const Tile* bounds = &layout.tiles[peer->tile];
+            const unsigned char* data = peer->buffer + sizeof(result);
+            for (int y = bounds->y0; y < bounds->y1; y++) {
+                for (int x = bounds->x0; x < bounds->x1; x++) {
+                    double rgb[3];
+                    memcpy(rgb, data, sizeof(rgb));
+                    data += sizeof(rgb);
+                    pixels[y * settings->width + x] = vector_create(rgb[0], rgb[1], rgb[2]);
+                }
+            }
+            tile_state[peer->tile] = 2;
+            tiles_done++;
+            paths += result.paths;
+            double seconds = distributed_seconds() - peer->since;
+            if (seconds > coordinator->slowest_tile) coordinator->slowest_tile = seconds;
+            peer->tile = -1;
+            peer->expected = 0;
+            fprintf(stderr, "\rTiles remaining: %d ", layout.tile_count - tiles_done);
+        }
+
+        if ((fds[0].revents & POLLIN) && coordinator->peer_count < DISTRIBUTED_MAX_WORKERS) {
+            int fd = accept(coordinator->listen_fd, NULL, NULL);
+            unsigned char* buffer = fd >= 0 ? (unsigned char*)malloc(DISTRIBUTED_MAX_RESULT) : NULL;
+            if (buffer) {
+                DistributedPeer* peer = &coordinator->peers[coordinator->peer_count++];
+                if (!coordinator->unix_path[0]) distributed_enable_keepalive(fd);
+                peer->fd = fd;
+                peer->greeted = 0;
+                peer->tile = -1;
+                peer->since = distributed_seconds();
+                peer->buffer = buffer;
+                peer->received = 0;
+                peer->expected = coordinator->hello_size;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    free(tile_state);
+    tile_scheduler_destroy(&layout);
+    if (stats) {
+        stats->paths = paths;
+    }
+    return ok;
+}
+
+void distributed_coordinator_finish(DistributedCoordinator* coordinator) {
+    DistributedAssignment release = {DISTRIBUTED_RELEASE, -1, 0, 0, 0, 0};
+    while (coordinator->peer_count > 0) {
+        distributed_send(coordinator->peers[0].fd, &release, sizeof(release));
+        distributed_drop_peer(coordinator, 0, NULL);
+    }
+    close(coordinator->listen_fd);
+    if (coordinator->unix_path[0]) {
+        unlink(coordinator->unix_path);
+    }
+
+    // Local workers exit once released, or on seeing the socket close
+    for (int i = 0; i < coordinator->local_worker_count; i++) {
+        if (coordinator->local_workers[i] > 0) {
+            waitpid(coordinator->local_workers[i], NULL, 0);
+        }
+    }
+    coordinator->local_worker_count = 0;
+}
+
+int distributed_worker_run(const char* address, Scene* scene, const Camera* camera,
+                           const RenderSettings* settings, double frame_rate) {
+    int fd = distributed_open(address, 0, NULL, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not connect to coordinator at %s\n", address);
+        return 0;
+    }
+
+    DistributedHello hello = distributed_hello(scene, camera, settings, frame_rate);
+    PixelAccumulator* accumulators =
+        (PixelAccumulator*)malloc((size_t)DISTRIBUTED_TILE_SIZE * DISTRIBUTED_TILE_SIZE * sizeof(PixelAccumulator));
+    unsigned char* result = (unsigned char*)malloc(DISTRIBUTED_MAX_RESULT);
+    if (!accumulators || !result || !distributed_send(fd, &hello, sizeof(hello))) {
+        fprintf(stderr, "Error: Could not start worker\n");
+        free(accumulators);
+        free(result);
+        close(fd);
+        return 0;
+    }
+
+    const int motion_samples = scene_motion_samples(scene);
+    int current_frame = -1;
+    int posed = 0;
+    int tiles = 0;
+    int ok = 1;
+    DistributedAssignment assignment;
+
+    while (ok && distributed_receive(fd, &assignment, sizeof(assignment)) &&
+           assignment.frame != DISTRIBUTED_RELEASE) {
+        if (assignment.frame == DISTRIBUTED_REJECT) {
+            fprintf(stderr, "Error: Coordinator rejected this worker's scene, camera or render settings\n");
+            ok = 0;
+            break;
+        }
+        Tile tile = {assignment.x0, assignment.y0, assignment.x1, assignment.y1};
+        if (tile.x0 < 0 || tile.y0 < 0 || tile.x1 > settings->width || tile.y1 > settings->height ||
+            tile.x1 <= tile.x0 || tile.y1 <= tile.y0 ||
+            (tile.x1 - tile.x0) > DISTRIBUTED_TILE_SIZE || (tile.y1 - tile.y0) > DISTRIBUTED_TILE_SIZE) {
+            fprintf(stderr, "Error: Coordinator assigned an invalid tile\n");
+            ok = 0;
+            break;
+        }
+
+        // Pose the scene as the single-process frame loop does
+        if (!posed || assignment.frame != current_frame) {
+            current_frame = assignment.frame;
+            scene->animation_state.current_frame = current_frame;
+            scene->animation_state.current_time = current_frame / frame_rate;
+            if (!scene_update_bvh(scene)) {
+                ok = 0;
+                break;
+            }
+            posed = 1;
+        }
+
+        int count = (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        memset(accumulators, 0, count * sizeof(PixelAccumulator));
+        RenderStats stats;
+        render_tile_pass(scene, camera, settings, &tile, accumulators, settings->samples_per_pixel, &stats);
+
+        DistributedResult header = {assignment.frame, assignment.tile, stats.paths};
+        memcpy(result, &header, sizeof(header));
+        unsigned char* data = result + sizeof(header);
+        for (int i = 0; i < count; i++) {
+            Vector3 color = pixel_accumulator_resolve(&accumulators[i], motion_samples);
+            double rgb[3] = {color.x, color.y, color.z};
+            memcpy(data, rgb, sizeof(rgb));
+            data += sizeof(rgb);
+        }
+        ok = distributed_send(fd, result, (size_t)(data - result));
+        tiles++;
+    }
+
+    fprintf(stderr, "Worker %d rendered %d tiles\n", (int)getpid(), tiles);
+    free(accumulators);
+    free(result);
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,72 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "render.h"
+#include <sys/types.h>
+
+// Distributed rendering of single frames. A coordinator listens on a TCP
+// ("host:port", "*:port" for every interface) or UNIX socket ("unix:/path")
+// address. Workers load the same scene with the same settings, connect,
+// and announce those settings along with a hash of the scene and camera.
+// The coordinator then hands each worker one tile at a time, copies every
+// returned tile into the framebuffer and answers with the next assignment.
+// Tiles held by a worker whose connection drops go back in the queue. TCP
+// keepalive notices remote nodes that vanish without closing, and a worker
+// holding a tile far longer than tiles have been taking is dropped too.
+// Peers are assumed to share the coordinator's byte order.
+
+#define DISTRIBUTED_TILE_SIZE 64
+#define DISTRIBUTED_MAX_WORKERS 256
+#define DISTRIBUTED_MIN_TIMEOUT 60.0  // Seconds a worker may hold a tile or stay silent before greeting
+#define DISTRIBUTED_TIMEOUT_FACTOR 8  // Allowed multiple of the slowest tile returned so far
+
+// One worker connection
+typedef struct {
+    int fd;
+    int greeted;   // Settings announced and accepted
+    int tile;      // Tile being rendered, or -1 when idle
+    double since;  // When the tile was assigned, or the peer connected
+    unsigned char* buffer;  // Partial message from the worker
+    size_t received;
+    size_t expected;
+} DistributedPeer;
+
+typedef struct {
+    int listen_fd;
+    char unix_path[108];  // Socket file to remove on finish, if any
+    DistributedPeer peers[DISTRIBUTED_MAX_WORKERS];
+    int peer_count;
+    unsigned char hello[64];  // Settings announcement workers must match
+    size_t hello_size;
+    pid_t local_workers[DISTRIBUTED_MAX_WORKERS];
+    int local_worker_count;
+    double slowest_tile;  // Longest seconds a worker took to return a tile
+} DistributedCoordinator;
+
+// Start listening on address for workers rendering the same scene through
+// the same camera with settings. Returns 0 on failure.
+int distributed_coordinator_init(DistributedCoordinator* coordinator, const char* address,
+                                 const Scene* scene, const Camera* camera, const RenderSettings* settings,
+                                 double frame_rate);
+
+// Fork count worker processes that connect back to the coordinator, standing
+// in for remote nodes. Call before starting any threads.
+int distributed_spawn_local_workers(DistributedCoordinator* coordinator, const char* address, int count,
+                                    Scene* scene, const Camera* camera, const RenderSettings* settings,
+                                    double frame_rate);
+
+// Render the scene's current frame through the connected workers into
+// pixels. Waits for workers while tiles remain, and fails only if every
+// local worker has exited with no other worker connected.
+int distributed_render_frame(DistributedCoordinator* coordinator, const Scene* scene,
+                             const RenderSettings* settings, Vector3* pixels, RenderStats* stats);
+
+// Release the workers and stop listening
+void distributed_coordinator_finish(DistributedCoordinator* coordinator);
+
+// Worker loop: connect to the coordinator at address and render assigned
+// tiles of whichever frame they belong to until released. Returns 0 on failure.
+int distributed_worker_run(const char* address, Scene* scene, const Camera* camera,
+                           const RenderSettings* settings, double frame_rate);
+
+#endif
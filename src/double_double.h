@@ -0,0 +1,127 @@
+#ifndef DOUBLE_DOUBLE_H
+#define DOUBLE_DOUBLE_H
+
+#include "vector.h"
+#include <math.h>
+
+// Unevaluated sum hi + lo of two doubles, giving about 106 bits of
+// significand. Used to refine individual results, not in hot loops.
+typedef struct {
+    double hi;
+    double lo;
+} DoubleDouble;
+
+typedef struct {
+    DoubleDouble x, y, z;
+} DoubleDoubleVector3;
+
+static inline DoubleDouble dd_from_double(double value) {
+    DoubleDouble result = {value, 0.0};
+    return result;
+}
+
+static inline double dd_to_double(DoubleDouble a) {
+    return a.hi + a.lo;
+}
+
+// Exact sum of two doubles
+static inline DoubleDouble dd_two_sum(double a, double b) {
+    double s = a + b;
+    double v = s - a;
+    DoubleDouble result = {s, (a - (s - v)) + (b - v)};
+    return result;
+}
+
+static inline DoubleDouble dd_fast_two_sum(double a, double b) {
+    double s = a + b;
+    DoubleDouble result = {s, b - (s - a)};
+    return result;
+}
+
+// Exact product of two doubles
+static inline DoubleDouble dd_two_prod(double a, double b) {
+    double p = a * b;
+    DoubleDouble result = {p, fma(a, b, -p)};
+    return result;
+}
+
+static inline DoubleDouble dd_add(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble s = dd_two_sum(a.hi, b.hi);
+    DoubleDouble t = dd_two_sum(a.lo, b.lo);
+    s = dd_fast_two_sum(s.hi, s.lo + t.hi);
+    return dd_fast_two_sum(s.hi, s.lo + t.lo);
+}
+
+static inline DoubleDouble dd_negate(DoubleDouble a) {
+    DoubleDouble result = {-a.hi, -a.lo};
+    return result;
+}
+
+static inline DoubleDouble dd_subtract(DoubleDouble a, DoubleDouble b) {
+    return dd_add(a, dd_negate(b));
+}
+
+static inline DoubleDouble dd_multiply(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble p = dd_two_prod(a.hi, b.hi);
+    return dd_fast_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline DoubleDouble dd_divide(DoubleDouble a, DoubleDouble b) {
+    // Long division: a first quotient, then a correction from the remainder
+    double q1 = a.hi / b.hi;
+    DoubleDouble r = dd_subtract(a, dd_multiply(b, dd_from_double(q1)));
+    double q2 = r.hi / b.hi;
+    r = dd_subtract(r, dd_multiply(b, dd_from_double(q2)));
+    double q3 = r.hi / b.hi;
+    DoubleDouble q = dd_fast_two_sum(q1, q2);
+    return dd_add(q, dd_from_double(q3));
+}
+
+static inline DoubleDouble dd_sqrt(DoubleDouble a) {
+    if (a.hi <= 0.0) return dd_from_double(0.0);
+    // One Newton step from the double root doubles its precision
+    double root = sqrt(a.hi);
+    DoubleDouble square = dd_two_prod(root, root);
+    double correction = dd_to_double(dd_subtract(a, square)) / (2.0 * root);
+    return dd_fast_two_sum(root, correction);
+}
+
+static inline DoubleDoubleVector3 dd_vector_from(Vector3 v) {
+    DoubleDoubleVector3 result = {dd_from_double(v.x), dd_from_double(v.y), dd_from_double(v.z)};
+    return result;
+}
+
+static inline Vector3 dd_vector_to(DoubleDoubleVector3 v) {
+    return vector_create(dd_to_double(v.x), dd_to_double(v.y), dd_to_double(v.z));
+}
+
+static inline DoubleDoubleVector3 dd_vector_subtract(DoubleDoubleVector3 a, DoubleDoubleVector3 b) {
+    DoubleDoubleVector3 result = {dd_subtract(a.x, b.x), dd_subtract(a.y, b.y), dd_subtract(a.z, b.z)};
+    return result;
+}
+
+static inline DoubleDouble dd_vector_dot(DoubleDoubleVector3 a, DoubleDoubleVector3 b) {
+    return dd_add(dd_add(dd_multiply(a.x, b.x), dd_multiply(a.y, b.y)), dd_multiply(a.z, b.z));
+}
+
+static inline DoubleDoubleVector3 dd_vector_cross(DoubleDoubleVector3 a, DoubleDoubleVector3 b) {
+    DoubleDoubleVector3 result = {
+        dd_subtract(dd_multiply(a.y, b.z), dd_multiply(a.z, b.y)),
+        dd_subtract(dd_multiply(a.z, b.x), dd_multiply(a.x, b.z)),
+        dd_subtract(dd_multiply(a.x, b.y), dd_multiply(a.y, b.x))
+    };
+    return result;
+}
+
+// origin + t * direction
+static inline DoubleDoubleVector3 dd_ray_point_at(DoubleDoubleVector3 origin, DoubleDoubleVector3 direction,
+                                                  DoubleDouble t) {
+    DoubleDoubleVector3 result = {
+        dd_add(origin.x, dd_multiply(direction.x, t)),
+        dd_add(origin.y, dd_multiply(direction.y, t)),
+        dd_add(origin.z, dd_multiply(direction.z, t))
+    };
+    return result;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include "frame_output.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+// Write the framebuffer as a binary PPM, 8 or 16 bits per channel. The
+// whole file is serialized first and written in one call.
+static int frame_output_save_ppm(const char* filename, const Vector3* pixels, int width, int height,
+                                 int sixteen_bit) {
+    char header[64];
+    int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n%d\n", width, height,
+                               sixteen_bit ? 65535 : 255);
+    size_t raster_size = (size_t)width * height * 3 * (sixteen_bit ? 2 : 1);
+    size_t size = header_size + raster_size;
+
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (!data) {
+        fprintf(stderr, "Error: Could not allocate memory for %s\n", filename);
+        return 0;
+    }
+    memcpy(data, header, header_size);
+
+    unsigned char* out = data + header_size;
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        double channels[3] = {pixels[i].x, pixels[i].y, pixels[i].z};
+        for (int c = 0; c < 3; c++) {
+            double value = fmin(1.0, fmax(0.0, channels[c]));
+            if (sixteen_bit) {
+                // 16-bit samples are big-endian
+                unsigned int sample = (unsigned int)(65535.99 * value);
+                *out++ = (unsigned char)(sample >> 8);
+                *out++ = (unsigned char)(sample & 0xff);
+            } else {
+                *out++ = (unsigned char)(255.99 * value);
+            }
+        }
+    }
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open output file: %s\n", filename);
+        free(data);
+        return 0;
+    }
+    int ok = fwrite(data, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write output file: %s\n", filename);
+    }
+    return ok;
+}
+
+static int frame_output_save_png(const char* filename, const Vector3* pixels, int width, int height) {
+    size_t count = (size_t)width * height;
+    unsigned char* data = (unsigned char*)malloc(count * 3);
+    if (!data) {
+        fprintf(stderr, "Error: Could not allocate memory for %s\n", filename);
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        data[i * 3 + 0] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].x)));
+        data[i * 3 + 1] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].y)));
+        data[i * 3 + 2] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].z)));
+    }
+    int ok = stbi_write_png(filename, width, height, 3, data, width * 3) != 0;
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write output file: %s\n", filename);
+    }
+    return ok;
+}
+
+int frame_output_save(OutputFormat format, const char* filename, const Vector3* pixels, int width, int height) {
+    char temp_filename[FRAME_OUTPUT_MAX_FILENAME + 8];
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+
+    int ok = format == FORMAT_PNG
+        ? frame_output_save_png(temp_filename, pixels, width, height)
+        : frame_output_save_ppm(temp_filename, pixels, width, height, format == FORMAT_PPM16);
+    if (ok && rename(temp_filename, filename) != 0) {
+        fprintf(stderr, "Error: Could not move %s into place\n", filename);
+        ok = 0;
+    }
+    if (!ok) {
+        remove(temp_filename);
+    }
+    return ok;
+}
+
+#define FRAME_PATTERN_MAX_WIDTH 32
+
+// Length of the conversion starting at the '%' in pattern, setting width to
+// its zero-padded width (0 for plain %d) or -1 for %%. Returns 0 for any
+// other conversion.
+static int frame_pattern_conversion(const char* pattern, int* width) {
+    if (pattern[1] == '%') {
+        *width = -1;
+        return 2;
+    }
+    int i = 1;
+    *width = 0;
+    if (pattern[i] == '0') {
+        i++;
+        if (pattern[i] < '1' || pattern[i] > '9') return 0;
+        while (pattern[i] >= '0' && pattern[i] <= '9') {
+            *width = *width * 10 + (pattern[i++] - '0');
+            if (*width > FRAME_PATTERN_MAX_WIDTH) return 0;
+        }
+    }
+    return pattern[i] == 'd' ? i + 1 : 0;
+}
+
+int frame_output_check_pattern(const char* pattern) {
+    int frames = 0;
+    for (const char* p = pattern; *p; p++) {
+        if (*p != '%') continue;
+        int width;
+        int length = frame_pattern_conversion(p, &width);
+        if (length == 0) return -1;
+        if (width >= 0 && ++frames > 1) return -1;
+        p += length - 1;
+    }
+    return frames;
+}
+
+int frame_output_format_name(char* name, size_t size, const char* pattern, int frame) {
+    if (frame_output_check_pattern(pattern) < 0) return 0;
+
+    size_t length = 0;
+    for (const char* p = pattern; *p;) {
+        char number[FRAME_PATTERN_MAX_WIDTH + 16];
+        const char* piece = p;
+        size_t piece_length = 1;
+        if (*p == '%') {
+            int width;
+            int conversion = frame_pattern_conversion(p, &width);
+            if (width >= 0) {
+                piece_length = (size_t)snprintf(number, sizeof(number), "%0*d", width, frame);
+                piece = number;
+            }
+            p += conversion;
+        } else {
+            p++;
+        }
+        if (length + piece_length >= size) return 0;
+        memcpy(name + length, piece, piece_length);
+        length += piece_length;
+    }
+    name[length] = '\0';
+    return 1;
+}
+
+static int frame_output_ppm_complete(FILE* fp, int width, int height, int sixteen_bit) {
+    char magic[3] = {0};
+    int file_width, file_height, max_value;
+    if (fscanf(fp, "%2s %d %d %d", magic, &file_width, &file_height, &max_value) != 4 ||
+        strcmp(magic, "P6") != 0 || file_width != width || file_height != height ||
+        max_value != (sixteen_bit ? 65535 : 255) || fgetc(fp) == EOF) {
+        return 0;
+    }
+    long raster_start = ftell(fp);
+    if (raster_start < 0 || fseek(fp, 0, SEEK_END) != 0) return 0;
+    return ftell(fp) - raster_start == (long)width * height * 3 * (sixteen_bit ? 2 : 1);
+}
+
+static int frame_output_png_complete(FILE* fp, int width, int height) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    static const unsigned char end_chunk[12] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82};
+
+    // Signature, then the IHDR chunk with big-endian width and height
+    unsigned char header[24];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, signature, 8) != 0 || memcmp(header + 12, "IHDR", 4) != 0) {
+        return 0;
+    }
+    unsigned long file_width = (unsigned long)header[16] << 24 | header[17] << 16 | header[18] << 8 | header[19];
+    unsigned long file_height = (unsigned long)header[20] << 24 | header[21] << 16 | header[22] << 8 | header[23];
+    if (file_width != (unsigned long)width || file_height != (unsigned long)height) return 0;
+
+    unsigned char trailer[12];
+    return fseek(fp, -(long)sizeof(trailer), SEEK_END) == 0 &&
+           fread(trailer, 1, sizeof(trailer), fp) == sizeof(trailer) &&
+           memcmp(trailer, end_chunk, sizeof(trailer)) == 0;
+}
+
+int frame_output_complete(OutputFormat format, const char* filename, int width, int height) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return 0;
+    int complete = format == FORMAT_PNG
+        ? frame_output_png_complete(fp, width, height)
+        : frame_output_ppm_complete(fp, width, height, format == FORMAT_PPM16);
+    fclose(fp);
+    return complete;
+}
+
+static int frame_output_save_manifest(const char* filename, const FrameManifest* manifest,
+                                      double write_seconds) {
+    char manifest_filename[FRAME_OUTPUT_MAX_FILENAME + 8];
+    char temp_filename[FRAME_OUTPUT_MAX_FILENAME + 16];
+    snprintf(manifest_filename, sizeof(manifest_filename), "%s.json", filename);
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", manifest_filename);
+
+    FILE* fp = fopen(temp_filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open manifest file for writing: %s\n", temp_filename);
+        return 0;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "    \"frame\": %d,\n", manifest->frame);
+    fprintf(fp, "    \"output\": \"");
+    for (const char* c = filename; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', fp);
+        fputc(*c, fp);
+    }
+    fprintf(fp, "\",\n");
+    fprintf(fp, "    \"shard\": \"%d/%d\",\n", manifest->shard_index, manifest->shard_count);
+    fprintf(fp, "    \"samples_per_pixel\": %d,\n", manifest->samples_per_pixel);
+    fprintf(fp, "    \"camera_paths\": %lld,\n", manifest->paths);
+    fprintf(fp, "    \"render_seconds\": %.6f,\n", manifest->render_seconds);
+    fprintf(fp, "    \"write_seconds\": %.6f\n", write_seconds);
+    fprintf(fp, "}\n");
+    int ok = fclose(fp) == 0;
+
+    if (!ok || rename(temp_filename, manifest_filename) != 0) {
+        fprintf(stderr, "Error: Could not write manifest file: %s\n", manifest_filename);
+        remove(temp_filename);
+        return 0;
+    }
+    return 1;
+}
+
+static void* frame_writer_run(void* arg) {
+    FrameWriter* writer = (FrameWriter*)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->queue_count == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        if (writer->queue_count == 0) break;  // Closing with nothing left to write
+
+        FrameWriterSlot* slot = &writer->slots[writer->queue[writer->queue_head]];
+        writer->queue_head = (writer->queue_head + 1) % writer->slot_count;
+        writer->queue_count--;
+
+        // Encode without the lock, so the renderer can submit meanwhile
+        pthread_mutex_unlock(&writer->lock);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int ok = frame_output_save(writer->format, slot->filename, slot->pixels,
+                                   writer->width, writer->height);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (ok && slot->has_manifest) {
+            double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+            ok = frame_output_save_manifest(slot->filename, &slot->manifest, seconds);
+        }
+        pthread_mutex_lock(&writer->lock);
+
+        if (!ok) writer->failures++;
+        slot->in_use = 0;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+int frame_writer_init(FrameWriter* writer, OutputFormat format, int width, int height, int depth) {
+    memset(writer, 0, sizeof(*writer));
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->slot_count = depth > 0 ? depth : 1;
+
+    writer->slots = (FrameWriterSlot*)calloc(writer->slot_count, sizeof(FrameWriterSlot));
+    writer->queue = (int*)calloc(writer->slot_count, sizeof(int));
+    int ok = writer->slots && writer->queue;
+    for (int i = 0; ok && i < writer->slot_count; i++) {
+        writer->slots[i].pixels = (Vector3*)malloc((size_t)width * height * sizeof(Vector3));
+        ok = writer->slots[i].pixels != NULL;
+    }
+
+    if (ok) {
+        pthread_mutex_init(&writer->lock, NULL);
+        pthread_cond_init(&writer->changed, NULL);
+        if (pthread_create(&writer->thread, NULL, frame_writer_run, writer) != 0) {
+            pthread_mutex_destroy(&writer->lock);
+            pthread_cond_destroy(&writer->changed);
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Could not start the frame writer\n");
+        for (int i = 0; writer->slots && i < writer->slot_count; i++) {
+            free(writer->slots[i].pixels);
+        }
+        free(writer->slots);
+        free(writer->queue);
+        writer->slots = NULL;
+        writer->queue = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+Vector3* frame_writer_acquire(FrameWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    FrameWriterSlot* slot = NULL;
+    while (!slot) {
+        for (int i = 0; i < writer->slot_count && !slot; i++) {
+            if (!writer->slots[i].in_use) slot = &writer->slots[i];
+        }
+        if (!slot) pthread_cond_wait(&writer->changed, &writer->lock);
+    }
+    slot->in_use = 1;
+    pthread_mutex_unlock(&writer->lock);
+    return slot->pixels;
+}
+
+int frame_writer_submit(FrameWriter* writer, Vector3* pixels, const char* filename,
+                        const FrameManifest* manifest) {
+    pthread_mutex_lock(&writer->lock);
+    int index = 0;
+    while (writer->slots[index].pixels != pixels) index++;
+
+    FrameWriterSlot* slot = &writer->slots[index];
+    snprintf(slot->filename, sizeof(slot->filename), "%s", filename);
+    slot->has_manifest = manifest != NULL;
+    if (manifest) {
+        slot->manifest = *manifest;
+    }
+    writer->queue[(writer->queue_head + writer->queue_count) % writer->slot_count] = index;
+    writer->queue_count++;
+    int ok = writer->failures == 0;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    return ok;
+}
+
+int frame_writer_finish(FrameWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+    for (int i = 0; i < writer->slot_count; i++) {
+        free(writer->slots[i].pixels);
+    }
+    free(writer->slots);
+    free(writer->queue);
+    writer->slots = NULL;
+    writer->queue = NULL;
+    return writer->failures == 0;
+}
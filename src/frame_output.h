@@ -0,0 +1,93 @@
+#ifndef FRAME_OUTPUT_H
+#define FRAME_OUTPUT_H
+
+#include "vector.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#define FRAME_WRITER_DEFAULT_DEPTH 2
+#define FRAME_OUTPUT_MAX_FILENAME 256
+
+typedef enum {
+    FORMAT_PPM,    // Binary P6, 8 bits per channel
+    FORMAT_PPM16,  // Binary P6, 16 bits per channel
+    FORMAT_PNG
+} OutputFormat;
+
+// Quantize and write a width * height framebuffer (row 0 at the top). The
+// image is written under a temporary name and renamed into place, so a file
+// at filename is always whole. Returns 0 on failure.
+int frame_output_save(OutputFormat format, const char* filename, const Vector3* pixels, int width, int height);
+
+// Whether filename already holds a complete width x height image in format,
+// judged from its header and length (PPM) or its final chunk (PNG)
+int frame_output_complete(OutputFormat format, const char* filename, int width, int height);
+
+// Frame file names are patterns holding at most one frame number, written
+// %d or zero-padded as %0Nd, with %% for a literal percent sign. Returns the
+// number of frame numbers in pattern, or -1 if it has any other conversion.
+int frame_output_check_pattern(const char* pattern);
+
+// Expand pattern for frame into name. Returns 0 if pattern is invalid or
+// the name does not fit in size bytes.
+int frame_output_format_name(char* name, size_t size, const char* pattern, int frame);
+
+// Per-frame record written beside a frame as <filename>.json, once the
+// frame itself is on disk
+typedef struct {
+    int frame;
+    int shard_index;
+    int shard_count;
+    int samples_per_pixel;
+    long long paths;
+    double render_seconds;
+} FrameManifest;
+
+// Framebuffer owned by a FrameWriter, cycling between the renderer and the
+// writer thread
+typedef struct {
+    Vector3* pixels;
+    char filename[FRAME_OUTPUT_MAX_FILENAME];
+    FrameManifest manifest;
+    int has_manifest;
+    int in_use;  // Acquired by the renderer, or queued for writing
+} FrameWriterSlot;
+
+// Background stage that quantizes, encodes and writes finished frames while
+// the next ones render. It owns depth framebuffers: the renderer acquires
+// one, renders into it and submits it, and the writer thread saves queued
+// frames in submission order and hands their buffers back. Acquiring blocks
+// while every buffer is queued, which bounds memory and lag.
+typedef struct {
+    FrameWriterSlot* slots;
+    int slot_count;
+    int* queue;  // Ring of queued slot indices in submission order
+    int queue_head;
+    int queue_count;
+    OutputFormat format;
+    int width;
+    int height;
+    int failures;  // Frames that could not be written
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+} FrameWriter;
+
+// Allocate depth framebuffers and start the writer thread. Returns 0 on failure.
+int frame_writer_init(FrameWriter* writer, OutputFormat format, int width, int height, int depth);
+
+// Framebuffer to render the next frame into
+Vector3* frame_writer_acquire(FrameWriter* writer);
+
+// Queue a framebuffer from frame_writer_acquire to be saved as filename,
+// followed by its manifest when one is given. Returns 0 if an earlier frame
+// has already failed to write.
+int frame_writer_submit(FrameWriter* writer, Vector3* pixels, const char* filename,
+                        const FrameManifest* manifest);
+
+// Write every queued frame, stop the thread and free the buffers. Returns 0
+// if any frame failed to write.
+int frame_writer_finish(FrameWriter* writer);
+
+#endif
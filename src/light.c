@@ -42,19 +42,24 @@ static double radical_inverse(unsigned int bits) {
     return (double)bits * 2.3283064365386963e-10;
 }
 
-Vector3 light_random_position(Light light) {
-    static unsigned int sample_index = 0;
-    sample_index = (sample_index + 1) % 1024; // Reset after 1024 samples
-    
+int light_shadow_samples(Light light) {
+    // Every sample of a point light lands on the same spot
+    return light.light_type == LIGHT_TYPE_POINT ? 1 : AREA_LIGHT_SHADOW_SAMPLES;
+}
+
+Vector3 light_random_position(Light light, Sampler* sampler, int stratum, int stratum_count) {
+    if (light.light_type == LIGHT_TYPE_POINT) {
+        return light.position;
+    }
+
+    // Jittered Hammersley point: one stratum per sample along the first axis,
+    // radical inverse (jittered within its 1/N cell) along the second
+    double u1 = (stratum + sampler_next_double(sampler)) / stratum_count;
+    double u2 = radical_inverse((unsigned int)stratum) + sampler_next_double(sampler) / stratum_count;
+    if (u2 >= 1.0) u2 -= 1.0;
+
     switch (light.light_type) {
-        case LIGHT_TYPE_POINT:
-            return light.position;
-            
         case LIGHT_TYPE_CIRCULAR: {
-            // Use Hammersley sequence for better distribution
-            double u1 = (double)sample_index / 1024.0;
-            double u2 = radical_inverse(sample_index);
-            
             // Concentric disk mapping for better stratification
             double r = light.radius * sqrt(u1);
             double theta = 2.0 * M_PI * u2;
@@ -69,10 +74,9 @@ Vector3 light_random_position(Light light) {
         }
         
         case LIGHT_TYPE_RECTANGULAR: {
-            // Use Hammersley sequence for better distribution
-            double u = radical_inverse(sample_index);
-            double v = (double)sample_index / 1024.0;
-            
+            double u = u2;
+            double v = u1;
+
             // Calculate position on rectangular area light
             Vector3 scaled_width = vector_multiply(light.width, u - 0.5);
             Vector3 scaled_height = vector_multiply(light.height, v - 0.5);
@@ -2,6 +2,7 @@
 #define LIGHT_H
 
 #include "vector.h"
+#include "sampler.h"
 
 typedef struct {
     Vector3 position;
@@ -17,8 +18,14 @@ typedef struct {
 #define LIGHT_TYPE_CIRCULAR 1
 #define LIGHT_TYPE_RECTANGULAR 2
 
+// Shadow rays cast towards an area light per shading point
+#define AREA_LIGHT_SHADOW_SAMPLES 8
+
 Light light_create(Vector3 position, Vector3 color, double intensity);
 Light area_light_create(Vector3 position, Vector3 color, double intensity, double radius);
-Vector3 light_random_position(Light light);
+int light_shadow_samples(Light light);
+// Sample a point on the light for stratum [0, stratum_count) of the caller's
+// shadow sample set, jittered by the caller's per-path sampler
+Vector3 light_random_position(Light light, Sampler* sampler, int stratum, int stratum_count);
 
 #endif
@@ -1,56 +1,244 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
 #include "scene.h"
 #include "scene_config.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image.h"
-#include "stb_image_write.h"
+#include "render.h"
+#include "aplib.h"
+#include "frame_output.h"
+#include "distributed.h"
+#include "process_pool.h"
+#include "scene_image.h"
 
 #define WIDTH 800
 #define HEIGHT 600
 
-typedef enum {
-    FORMAT_PPM,
-    FORMAT_PNG
-} OutputFormat;
+// Read a P3 or P6 image with 8-bit channels into data (width * height * 3)
+int load_ppm(const char* filename, unsigned char* data, int width, int height) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open reference image: %s\n", filename);
+        return 0;
+    }
+
+    char magic[3] = {0};
+    int file_width, file_height, max_value;
+    if (fscanf(fp, "%2s %d %d %d", magic, &file_width, &file_height, &max_value) != 4 ||
+        (strcmp(magic, "P3") != 0 && strcmp(magic, "P6") != 0) || max_value != 255) {
+        fprintf(stderr, "Error: %s is not an 8-bit P3 or P6 image\n", filename);
+        fclose(fp);
+        return 0;
+    }
+    if (file_width != width || file_height != height) {
+        fprintf(stderr, "Error: Reference image is %dx%d, expected %dx%d\n",
+                file_width, file_height, width, height);
+        fclose(fp);
+        return 0;
+    }
 
-void write_color_ppm(FILE* fp, Vector3 color) {
-    int r = (int)(255.99 * fmin(1.0, fmax(0.0, color.x)));
-    int g = (int)(255.99 * fmin(1.0, fmax(0.0, color.y)));
-    int b = (int)(255.99 * fmin(1.0, fmax(0.0, color.z)));
-    fprintf(fp, "%d %d %d\n", r, g, b);
+    int count = width * height * 3;
+    int ok = 1;
+    if (magic[1] == '6') {
+        fgetc(fp);  // Single whitespace byte before the raster
+        ok = fread(data, 1, count, fp) == (size_t)count;
+    } else {
+        for (int i = 0; i < count && ok; i++) {
+            int value;
+            ok = fscanf(fp, "%d", &value) == 1;
+            data[i] = (unsigned char)value;
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "Error: Truncated reference image: %s\n", filename);
+    }
+    return ok;
 }
 
-void save_png(const char* filename, Vector3* pixels, int width, int height) {
-    unsigned char* data = (unsigned char*)malloc(width * height * 3);
+// Report how far the rendered frame, quantized as it is written, strays from
+// a reference image, such as the same frame from a double precision build
+int compare_with_reference(const char* filename, Vector3* pixels, int width, int height) {
+    int count = width * height * 3;
+    unsigned char* reference = (unsigned char*)malloc(count);
+    if (!reference || !load_ppm(filename, reference, width, height)) {
+        free(reference);
+        return 0;
+    }
+
+    double sum = 0.0;
+    double sum_squared = 0.0;
+    int max_error = 0;
+    int differing = 0;
     for (int i = 0; i < width * height; i++) {
-        data[i * 3 + 0] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].x)));
-        data[i * 3 + 1] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].y)));
-        data[i * 3 + 2] = (unsigned char)(255.99 * fmin(1.0, fmax(0.0, pixels[i].z)));
+        double channels[3] = {pixels[i].x, pixels[i].y, pixels[i].z};
+        for (int c = 0; c < 3; c++) {
+            int value = (int)(255.99 * fmin(1.0, fmax(0.0, channels[c])));
+            int error = abs(value - reference[i * 3 + c]);
+            sum += error;
+            sum_squared += (double)error * error;
+            if (error > max_error) max_error = error;
+            if (error) differing++;
+        }
+    }
+    free(reference);
+
+    double rmse = sqrt(sum_squared / count);
+    fprintf(stderr, "Compared with %s: mean error %.4f, max error %d, RMSE %.4f, PSNR %.2f dB, "
+            "%d of %d channels differ\n", filename, sum / count, max_error, rmse,
+            rmse > 0 ? 20.0 * log10(255.0 / rmse) : INFINITY, differing, count);
+    return 1;
+}
+
+int frame_manifest_exists(const char* frame_filename) {
+    char manifest_filename[FRAME_OUTPUT_MAX_FILENAME + 8];
+    snprintf(manifest_filename, sizeof(manifest_filename), "%s.json", frame_filename);
+    FILE* fp = fopen(manifest_filename, "r");
+    if (fp) {
+        fclose(fp);
+    }
+    return fp != NULL;
+}
+
+// Drop a frame's manifest before its image is overwritten by anything but a
+// finished frame, so an interrupted run cannot leave a manifest vouching
+// for a partial image. Returns 0 if an existing manifest could not be removed.
+int frame_manifest_remove(const char* frame_filename) {
+    char manifest_filename[FRAME_OUTPUT_MAX_FILENAME + 8];
+    snprintf(manifest_filename, sizeof(manifest_filename), "%s.json", frame_filename);
+    if (remove(manifest_filename) != 0 && errno != ENOENT) {
+        fprintf(stderr, "Error: Could not remove manifest file: %s\n", manifest_filename);
+        return 0;
+    }
+    return 1;
+}
+
+// Render a frame in passes of pass_samples samples per pixel. After each
+// pass the accumulation buffer is checkpointed and the image refreshed, so
+// a killed job keeps a usable image and loses at most one pass. With resume,
+// an existing checkpoint is continued, possibly toward a larger budget.
+int render_progressive(Scene* scene, const Camera* camera, const RenderSettings* settings,
+                       int pass_samples, const char* checkpoint_file, int resume,
+                       OutputFormat format, const char* image_file, Vector3* pixels, RenderStats* stats) {
+    size_t count = (size_t)settings->width * settings->height;
+    PixelAccumulator* accumulators = (PixelAccumulator*)calloc(count, sizeof(PixelAccumulator));
+    if (!accumulators) {
+        fprintf(stderr, "Error: Could not allocate accumulation buffer\n");
+        return 0;
+    }
+
+    int sample_end = 0;
+    FILE* existing = resume ? fopen(checkpoint_file, "rb") : NULL;
+    if (existing) {
+        fclose(existing);
+        if (!render_checkpoint_load(checkpoint_file, scene, settings, accumulators)) {
+            free(accumulators);
+            return 0;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (accumulators[i].samples > sample_end) sample_end = accumulators[i].samples;
+        }
+        fprintf(stderr, "Resuming %s at %d samples per pixel\n", checkpoint_file, sample_end);
+    }
+
+    stats->paths = 0;
+    while (sample_end < settings->samples_per_pixel) {
+        sample_end += pass_samples;
+        if (sample_end > settings->samples_per_pixel) sample_end = settings->samples_per_pixel;
+
+        RenderStats pass_stats;
+        if (!render_pass(scene, camera, settings, accumulators, sample_end, &pass_stats) ||
+            !render_checkpoint_save(checkpoint_file, scene, settings, accumulators)) {
+            free(accumulators);
+            return 0;
+        }
+        stats->paths += pass_stats.paths;
+        fprintf(stderr, "\nPass complete: %d/%d samples per pixel, checkpoint %s\n",
+                sample_end, settings->samples_per_pixel, checkpoint_file);
+
+        // The caller saves the final image
+        if (sample_end < settings->samples_per_pixel) {
+            render_resolve(scene, settings, accumulators, pixels);
+            frame_output_save(format, image_file, pixels, settings->width, settings->height);
+        }
     }
-    stbi_write_png(filename, width, height, 3, data, width * 3);
-    free(data);
+
+    render_resolve(scene, settings, accumulators, pixels);
+    free(accumulators);
+    return 1;
 }
 
 int main(int argc, char* argv[]) {
     OutputFormat format = FORMAT_PPM;
-    const char* output_file = "output.ppm";
+    const char* output_file = NULL;  // Defaults by format and frame count once arguments are read
     int start_frame = 0;
     int end_frame = 0;  // 0 means render single frame
     double frame_rate = 30.0;
+    int thread_count = render_default_thread_count();
+    int packet_size = DEFAULT_PACKET_SIZE;
+    int aplib_bench_iterations = 0;
+    int refine_hits = 0;
+    const char* reference_file = NULL;
+    int progressive_samples = 0;  // Samples per progressive pass; 0 renders frames in one go
+    const char* checkpoint_file = "checkpoint_%04d.rtcp";
+    int resume = 0;
+    int output_queue = FRAME_WRITER_DEFAULT_DEPTH;
+    int shard_index = 0;
+    int shard_count = 0;  // 0 renders every frame without skipping or manifests
+    const char* coordinator_address = NULL;
+    const char* worker_address = NULL;
+    int local_workers = 0;
+    int processes = 0;  // Worker processes sharing one scene image; 0 renders with threads
+    int samples_per_pixel = 0;    // 0 keeps the scene's or renderer's budget
+    int min_samples = 0;
+    double adaptive_threshold = -1.0;  // Negative keeps the scene's or renderer's threshold
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
             if (strcmp(argv[i + 1], "png") == 0) {
                 format = FORMAT_PNG;
-                output_file = "frame_%04d.png";
+            } else if (strcmp(argv[i + 1], "ppm16") == 0) {
+                format = FORMAT_PPM16;
+            } else if (strcmp(argv[i + 1], "ppm") == 0) {
+                format = FORMAT_PPM;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--coordinator") == 0 && i + 1 < argc) {
+            coordinator_address = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+            worker_address = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--local-workers") == 0 && i + 1 < argc) {
+            local_workers = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            processes = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (sscanf(argv[i + 1], "%d/%d", &shard_index, &shard_count) != 2 ||
+                shard_count < 1 || shard_index < 0 || shard_index >= shard_count) {
+                fprintf(stderr, "Error: --shard expects i/n with 0 <= i < n\n");
+                return 1;
             }
             i++;
         }
+        else if (strcmp(argv[i], "--output-queue") == 0 && i + 1 < argc) {
+            output_queue = atoi(argv[i + 1]);
+            i++;
+        }
         else if (strcmp(argv[i], "--start-frame") == 0 && i + 1 < argc) {
             start_frame = atoi(argv[i + 1]);
             i++;
@@ -63,6 +251,65 @@ int main(int argc, char* argv[]) {
             frame_rate = atof(argv[i + 1]);
             i++;
         }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--packet-size") == 0 && i + 1 < argc) {
+            packet_size = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples_per_pixel = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--min-samples") == 0 && i + 1 < argc) {
+            min_samples = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+            adaptive_threshold = atof(argv[i + 1]);
+            if (!isfinite(adaptive_threshold) || adaptive_threshold < 0.0) {
+                fprintf(stderr, "Error: --adaptive must be a non-negative number\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--progressive") == 0 && i + 1 < argc) {
+            progressive_samples = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_file = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "double") == 0) {
+                vector_set_precision_mode(PRECISION_DOUBLE);
+            } else if (strcmp(argv[i + 1], "arbitrary") == 0) {
+                vector_set_precision_mode(PRECISION_ARBITRARY);
+            } else if (strcmp(argv[i + 1], "float") == 0) {
+                vector_set_precision_mode(PRECISION_FLOAT);
+            } else {
+                fprintf(stderr, "Error: --precision expects double, arbitrary or float\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--refine-hits") == 0) {
+            refine_hits = 1;
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            reference_file = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--bench-aplib") == 0 && i + 1 < argc) {
+            aplib_bench_iterations = atoi(argv[i + 1]);
+            i++;
+        }
     }
 
     // Validate animation parameters
@@ -70,23 +317,65 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "Error: end_frame must be greater than start_frame\n");
         return 1;
     }
+    // The frame rate sets the shutter interval motion bounds are built over
+    if (!isfinite(frame_rate) || frame_rate <= 0.0) {
+        fprintf(stderr, "Error: --fps must be a positive number\n");
+        return 1;
+    }
+    if (thread_count < 1) {
+        fprintf(stderr, "Error: --threads must be at least 1\n");
+        return 1;
+    }
+    if (packet_size < 0 || packet_size * packet_size > BVH_PACKET_MAX) {
+        fprintf(stderr, "Error: --packet-size must be between 0 and 8\n");
+        return 1;
+    }
+    if (samples_per_pixel < 0 || min_samples < 0 || progressive_samples < 0) {
+        fprintf(stderr, "Error: --samples, --min-samples and --progressive must not be negative\n");
+        return 1;
+    }
+    if (coordinator_address && worker_address) {
+        fprintf(stderr, "Error: A process is either --coordinator or --worker\n");
+        return 1;
+    }
+    if (coordinator_address && progressive_samples > 0) {
+        fprintf(stderr, "Error: --progressive is not available with --coordinator\n");
+        return 1;
+    }
+    if (local_workers < 0 || local_workers > DISTRIBUTED_MAX_WORKERS || (local_workers > 0 && !coordinator_address)) {
+        fprintf(stderr, "Error: --local-workers needs --coordinator and at most %d workers\n",
+                DISTRIBUTED_MAX_WORKERS);
+        return 1;
+    }
+    if (processes < 0 || processes > PROCESS_POOL_MAX_WORKERS) {
+        fprintf(stderr, "Error: --processes must be between 0 and %d\n", PROCESS_POOL_MAX_WORKERS);
+        return 1;
+    }
+    if (processes > 0 && (coordinator_address || worker_address || progressive_samples > 0)) {
+        fprintf(stderr, "Error: --processes is not available with --coordinator, --worker or --progressive\n");
+        return 1;
+    }
+    if (resume && progressive_samples == 0) {
+        fprintf(stderr, "Error: --resume needs --progressive\n");
+        return 1;
+    }
+    if (output_queue < 1) {
+        fprintf(stderr, "Error: --output-queue must be at least 1\n");
+        return 1;
+    }
+    if (output_file && frame_output_check_pattern(output_file) < 0) {
+        fprintf(stderr, "Error: --output may hold one frame number as %%d or %%0Nd, and %%%% for a literal %%\n");
+        return 1;
+    }
+    if (frame_output_check_pattern(checkpoint_file) < 0) {
+        fprintf(stderr, "Error: --checkpoint may hold one frame number as %%d or %%0Nd, and %%%% for a literal %%\n");
+        return 1;
+    }
 
-    FILE* fp = NULL;
-    Vector3* pixels = NULL;
-
-    if (format == FORMAT_PPM) {
-        fp = fopen(output_file, "w");
-        if (!fp) {
-            fprintf(stderr, "Error: Could not open output file\n");
-            return 1;
-        }
-        fprintf(fp, "P3\n%d %d\n255\n", WIDTH, HEIGHT);
-    } else {
-        pixels = (Vector3*)malloc(WIDTH * HEIGHT * sizeof(Vector3));
-        if (!pixels) {
-            fprintf(stderr, "Error: Could not allocate memory for pixels\n");
-            return 1;
-        }
+    // Benchmark runs replace rendering entirely
+    if (aplib_bench_iterations > 0) {
+        aplib_benchmark(aplib_bench_iterations);
+        return 0;
     }
 
     // Load scene from configuration file or create default scene
@@ -114,6 +403,9 @@ int main(int argc, char* argv[]) {
         scene->focal_distance = 6.0;
     }
     
+    if (refine_hits) {
+        scene->refine_hits = 1;
+    }
     scene->animation_state = animation_state_create(frame_rate);
     scene->animation_state.current_frame = start_frame;
 
@@ -159,114 +451,275 @@ int main(int argc, char* argv[]) {
         water_sphere.metallic = 0.0;        // Non-metallic
         water_sphere.dispersion = 0.02;     // Slight water dispersion
         
-        scene_add_sphere(scene, glass_sphere);  // Glass sphere at focal plane
+        if (!scene_add_sphere(scene, glass_sphere)) {  // Glass sphere at focal plane
+            animation_track_destroy(glass_sphere_track);
+            scene_destroy(scene);
+            free(scene);
+            return 1;
+        }
         scene->sphere_animations[0] = glass_sphere_track;  // Assign animation track to glass sphere
         scene->motion_blur_intensity = 0.5;  // Enable motion blur
-        scene_add_sphere(scene, metal_sphere);  // Metal sphere in front
-        scene_add_sphere(scene, water_sphere);  // Water sphere behind
-        scene_add_sphere(scene, sphere_create(vector_create(0, -101, -5), 100.0, vector_create(0.5, 0.5, 0.5), 0.1, 1.0, 0.5)); // Ground plane
+        if (!scene_add_sphere(scene, metal_sphere) ||  // Metal sphere in front
+            !scene_add_sphere(scene, water_sphere) ||  // Water sphere behind
+            !scene_add_sphere(scene, sphere_create(vector_create(0, -101, -5), 100.0, vector_create(0.5, 0.5, 0.5), 0.1, 1.0, 0.5)) || // Ground plane
+            // Add lights
+            // Enhanced lighting setup for better shadows and reflections
+            !scene_add_light(scene, area_light_create(vector_create(5, 5, -5), vector_create(1, 0.95, 0.8), 1.2, 2.0)) ||  // Main warm light
+            !scene_add_light(scene, area_light_create(vector_create(-5, 4, -3), vector_create(0.7, 0.8, 1.0), 0.8, 1.5))) {  // Fill cool light
+            scene_destroy(scene);
+            free(scene);
+            return 1;
+        }
+    }
 
-        // Add lights
-        // Enhanced lighting setup for better shadows and reflections
-        scene_add_light(scene, area_light_create(vector_create(5, 5, -5), vector_create(1, 0.95, 0.8), 1.2, 2.0));  // Main warm light
-        scene_add_light(scene, area_light_create(vector_create(-5, 4, -3), vector_create(0.7, 0.8, 1.0), 0.8, 1.5));  // Fill cool light
+    // Accelerate ray queries now that the scene content is final
+    if (!scene_build_bvh(scene)) {
+        scene_destroy(scene);
+        free(scene);
+        return 1;
+    }
+    fprintf(stderr, "Scene BVH: %d objects (%d animated) in %d nodes, built in %.3f ms\n",
+            scene->bvh.index_count, scene->animated_object_count, scene->bvh.node_count,
+            scene->bvh.stats.build_ms);
+    for (int i = 0; i < scene->mesh_count; i++) {
+        const BVH* mesh_bvh = &scene->meshes[i].bvh;
+        fprintf(stderr, "Mesh %d BVH: %d triangles in %d nodes (%d leaves, depth %d, max leaf %d), built in %.3f ms\n",
+                i, scene->meshes[i].triangle_count, mesh_bvh->node_count, mesh_bvh->stats.leaf_count,
+                mesh_bvh->stats.max_depth, mesh_bvh->stats.max_leaf_size, mesh_bvh->stats.build_ms);
     }
 
     // Camera parameters
-    Vector3 camera_pos = vector_create(0, 0, 1);
-    double viewport_height = 2.0;
-    double viewport_width = viewport_height * (double)WIDTH / HEIGHT;
-    double focal_length = 1.0;
-
-    Vector3 horizontal = vector_create(viewport_width, 0, 0);
-    Vector3 vertical = vector_create(0, viewport_height, 0);
-    Vector3 lower_left_corner = vector_subtract(
-        vector_subtract(
-            vector_subtract(camera_pos, vector_divide(horizontal, 2.0)),
-            vector_divide(vertical, 2.0)
-        ),
-        vector_create(0, 0, focal_length)
-    );
+    Camera camera = camera_create(vector_create(0, 0, 1), 2.0, (double)WIDTH / HEIGHT, 1.0);
+
+    RenderSettings settings = render_settings_default(WIDTH, HEIGHT);
+    settings.thread_count = thread_count;
+    settings.packet_size = packet_size;
+
+    // Sampling comes from the command line, then the scene file, then the defaults
+    if (samples_per_pixel == 0) samples_per_pixel = scene->samples_per_pixel;
+    if (min_samples == 0) min_samples = scene->min_samples_per_pixel;
+    if (adaptive_threshold < 0.0) adaptive_threshold = scene->adaptive_threshold;
+    if (samples_per_pixel > 0) settings.samples_per_pixel = samples_per_pixel;
+    if (min_samples > 0) settings.min_samples = min_samples;
+    if (adaptive_threshold > 0.0) settings.adaptive_threshold = adaptive_threshold;
+    if (settings.adaptive_threshold > 0.0) {
+        fprintf(stderr, "Adaptive sampling: %d to %d samples per pixel, threshold %g\n",
+                settings.min_samples, settings.samples_per_pixel, settings.adaptive_threshold);
+    }
 
     // Animation rendering loop
     int total_frames = end_frame > 0 ? (end_frame - start_frame + 1) : 1;
-    
-    for (int frame = 0; frame < total_frames; frame++) {
+
+    // Output names are patterns holding the frame number (see
+    // frame_output_check_pattern). Single PPM frames keep the historical
+    // output.ppm.
+    if (!output_file) {
+        if (format == FORMAT_PNG) {
+            output_file = "frame_%04d.png";
+        } else {
+            output_file = total_frames > 1 ? "frame_%04d.ppm" : "output.ppm";
+        }
+    }
+    if (shard_count > 0) {
+        fprintf(stderr, "Shard %d/%d: frames %d + %d*k of %d-%d\n", shard_index, shard_count,
+                start_frame + shard_index, shard_count, start_frame, start_frame + total_frames - 1);
+    }
+    if (total_frames > 1 && frame_output_check_pattern(output_file) == 0) {
+        fprintf(stderr, "Warning: --output %s has no frame number, so each frame overwrites the last\n",
+                output_file);
+    }
+
+    // Workers take their frames and tiles from the coordinator and write nothing
+    if (worker_address) {
+        int worked = distributed_worker_run(worker_address, scene, &camera, &settings, frame_rate);
+        scene_destroy(scene);
+        free(scene);
+        return worked ? 0 : 1;
+    }
+
+    // Setup failures skip the frame loop but still go through the cleanup
+    // after it, which stops any workers already started
+    int failed = 0;
+
+    // Local workers are forked before any thread starts
+    DistributedCoordinator coordinator;
+    if (coordinator_address) {
+        if (!distributed_coordinator_init(&coordinator, coordinator_address, scene, &camera, &settings,
+                                          frame_rate) ||
+            !distributed_spawn_local_workers(&coordinator, coordinator_address, local_workers,
+                                             scene, &camera, &settings, frame_rate)) {
+            failed = 1;
+        }
+    }
+
+    // Pool workers render from one read-only image of the scene. The loaded
+    // scene is swapped for a view of that image before they are forked, so
+    // no process holds a private copy of the scene data.
+    SceneImage image = {0};
+    ProcessPool pool = {0};
+    if (!failed && processes > 0) {
+        if (!scene_image_create(&image, scene)) {
+            failed = 1;
+        } else {
+            scene_destroy(scene);
+            if (!scene_image_attach(&image, scene) ||
+                !process_pool_init(&pool, scene, &camera, &settings, frame_rate, processes)) {
+                failed = 1;
+            } else {
+                fprintf(stderr, "Scene image: %.2f MB shared by %d worker processes\n",
+                        image.size / (1024.0 * 1024.0), processes);
+            }
+        }
+    }
+
+    // Frames render into the writer's framebuffers, and are encoded and
+    // written in the background while later frames render
+    FrameWriter writer;
+    int writer_ready = !failed && frame_writer_init(&writer, format, WIDTH, HEIGHT, output_queue);
+    if (!writer_ready) {
+        failed = 1;
+    }
+    struct timespec sequence_start, sequence_end;
+    clock_gettime(CLOCK_MONOTONIC, &sequence_start);
+    int rendered_frames = 0;
+
+    for (int frame = 0; !failed && frame < total_frames; frame++) {
+        // Shards take every shard_count-th frame, which needs no coordination
+        // and spreads slow stretches of a shot over all shards
+        if (shard_count > 0 && frame % shard_count != shard_index) {
+            continue;
+        }
+
         scene->animation_state.current_frame = start_frame + frame;
         scene->animation_state.current_time = scene->animation_state.current_frame / frame_rate;
         
-        char frame_filename[256];
-        if (format == FORMAT_PNG) {
-            snprintf(frame_filename, sizeof(frame_filename), output_file, scene->animation_state.current_frame);
+        char frame_filename[FRAME_OUTPUT_MAX_FILENAME];
+        if (!frame_output_format_name(frame_filename, sizeof(frame_filename), output_file,
+                                      scene->animation_state.current_frame)) {
+            fprintf(stderr, "Error: Output name for frame %d is longer than %d characters\n",
+                    scene->animation_state.current_frame, FRAME_OUTPUT_MAX_FILENAME - 1);
+            failed = 1;
+            break;
+        }
+
+        // Frames are renamed into place only once written, and their manifest
+        // follows, so both together mean an earlier run already finished the
+        // frame. Progressive previews remove the manifest before replacing
+        // the image, so they leave an image but no manifest.
+        if (shard_count > 0 && frame_output_complete(format, frame_filename, WIDTH, HEIGHT) &&
+            frame_manifest_exists(frame_filename)) {
+            fprintf(stderr, "Skipping frame %d: %s is complete\n",
+                    scene->animation_state.current_frame, frame_filename);
+            continue;
         }
         
         fprintf(stderr, "\nRendering frame %d/%d\n", frame + 1, total_frames);
+
+        // Move animated instances to this frame's shutter interval
+        if (!scene_update_bvh(scene)) {
+            failed = 1;
+            break;
+        }
         
         // Render scene
-        for (int j = HEIGHT - 1; j >= 0; j--) {
-            fprintf(stderr, "\rScanlines remaining: %d ", j);
-            for (int i = 0; i < WIDTH; i++) {
-                Vector3 color = vector_create(0, 0, 0);
-                const int samples_per_pixel = 4;   // Reduced samples for better performance
-                const int motion_samples = scene->motion_blur_intensity > 0 ? 4 : 1; // Reduced motion blur samples
-
-            // Anti-aliasing and motion blur sampling
-            for (int s = 0; s < samples_per_pixel; s++) {
-                for (int m = 0; m < motion_samples; m++) {
-                    // Calculate time offset for motion blur
-                    double time_offset = 0.0;
-                    if (motion_samples > 1) {
-                        time_offset = ((double)m / (motion_samples - 1) - 0.5) * 
-                                    scene->motion_blur_intensity * scene->animation_state.time_step;
-                    }
-                    
-                    double u = ((double)i + ((double)rand() / RAND_MAX)) / (WIDTH - 1);
-                    double v = ((double)j + ((double)rand() / RAND_MAX)) / (HEIGHT - 1);
-
-                    Vector3 direction = vector_subtract(
-                        vector_add(
-                            vector_add(lower_left_corner,
-                                vector_multiply(horizontal, u)),
-                            vector_multiply(vertical, v)
-                        ),
-                        camera_pos
-                    );
-
-                    Ray ray = ray_create(camera_pos, direction);
-                    ray.time = scene->animation_state.current_time + time_offset;
-                    color = vector_add(color, scene_trace(scene, ray, MAX_DEPTH));
-                }
+        Vector3* pixels = frame_writer_acquire(&writer);
+        struct timespec frame_start, frame_end;
+        clock_gettime(CLOCK_MONOTONIC, &frame_start);
+        RenderStats stats;
+        if (progressive_samples > 0) {
+            char frame_checkpoint[FRAME_OUTPUT_MAX_FILENAME];
+            if (!frame_output_format_name(frame_checkpoint, sizeof(frame_checkpoint), checkpoint_file,
+                                          scene->animation_state.current_frame)) {
+                fprintf(stderr, "Error: Checkpoint name for frame %d is longer than %d characters\n",
+                        scene->animation_state.current_frame, FRAME_OUTPUT_MAX_FILENAME - 1);
+                failed = 1;
+                break;
             }
-            
-            // Average the color samples (including motion blur samples)
-            color = vector_divide(color, samples_per_pixel * motion_samples);
-            
-            if (format == FORMAT_PPM) {
-                write_color_ppm(fp, color);
-            } else {
-                pixels[(HEIGHT - 1 - j) * WIDTH + i] = color;
+            if (!frame_manifest_remove(frame_filename) ||
+                !render_progressive(scene, &camera, &settings, progressive_samples, frame_checkpoint, resume,
+                                    format, frame_filename, pixels, &stats)) {
+                failed = 1;
+                break;
+            }
+        } else if (coordinator_address) {
+            if (!distributed_render_frame(&coordinator, scene, &settings, pixels, &stats)) {
+                failed = 1;
+                break;
+            }
+        } else if (processes > 0) {
+            if (!process_pool_render_frame(&pool, pixels, &stats)) {
+                failed = 1;
+                break;
             }
+        } else if (!render_frame(scene, &camera, &settings, pixels, &stats)) {
+            failed = 1;
+            break;
         }
-    }
+        clock_gettime(CLOCK_MONOTONIC, &frame_end);
 
-    fprintf(stderr, "\nDone.\n");
+        fprintf(stderr, "\nDone in %.3f s (%s precision).\n",
+                (frame_end.tv_sec - frame_start.tv_sec) + (frame_end.tv_nsec - frame_start.tv_nsec) * 1e-9,
+                vector_get_precision_mode() == PRECISION_FLOAT ? "single" :
+                vector_get_precision_mode() == PRECISION_ARBITRARY ? "arbitrary" : "double");
+        fprintf(stderr, "Traced %lld camera paths (%.2f per pixel)\n",
+                stats.paths, (double)stats.paths / (WIDTH * HEIGHT));
 
-    // Save frame
-        if (format == FORMAT_PPM) {
-            // For PPM format, we only support single frame output
-            fclose(fp);
+        // The reference is checked against the first frame this process
+        // renders, wherever its shard or skipped frames put that
+        if (reference_file && rendered_frames == 0 &&
+            !compare_with_reference(reference_file, pixels, WIDTH, HEIGHT)) {
+            failed = 1;
+            break;
+        }
+
+        // Save frame
+        FrameManifest manifest = {
+            .frame = scene->animation_state.current_frame,
+            .shard_index = shard_index,
+            .shard_count = shard_count,
+            .samples_per_pixel = settings.samples_per_pixel,
+            .paths = stats.paths,
+            .render_seconds = (frame_end.tv_sec - frame_start.tv_sec) +
+                              (frame_end.tv_nsec - frame_start.tv_nsec) * 1e-9
+        };
+        rendered_frames++;
+        if (!frame_writer_submit(&writer, pixels, frame_filename, shard_count > 0 ? &manifest : NULL)) {
+            failed = 1;
             break;
-        } else {
-            save_png(frame_filename, pixels, WIDTH, HEIGHT);
         }
         
         // Update animation state
         animation_update_state(&scene->animation_state);
     }
-    
-    if (pixels) {
-        free(pixels);
+
+    if (!failed && reference_file && rendered_frames == 0) {
+        fprintf(stderr, "Error: --compare found no frame rendered by this process to compare\n");
+        failed = 1;
+    }
+
+    // Every failure, in setup or in the loop, comes through here, so workers
+    // are stopped and frames already rendered are still written out
+    if (coordinator_address) {
+        distributed_coordinator_finish(&coordinator);
     }
+    if (processes > 0) {
+        process_pool_finish(&pool);
+    }
+    int written = 0;
+    if (writer_ready) {
+        written = frame_writer_finish(&writer);
+        clock_gettime(CLOCK_MONOTONIC, &sequence_end);
+        fprintf(stderr, "Rendered and wrote %d frame%s in %.3f s\n", rendered_frames, rendered_frames == 1 ? "" : "s",
+                (sequence_end.tv_sec - sequence_start.tv_sec) +
+                (sequence_end.tv_nsec - sequence_start.tv_nsec) * 1e-9);
+    }
+
+    scene_destroy(scene);
+    free(scene);
+    scene_image_release(&image);
 
+    if (failed || !written) {
+        return 1;
+    }
     return 0;
 }
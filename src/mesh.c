@@ -1,14 +1,11 @@
 #include "mesh.h"
+#include "double_double.h"
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 // Matrix operations
-typedef struct {
-    double m[4][4];
-} Matrix4x4;
-
 Matrix4x4 matrix_identity() {
     Matrix4x4 m = {{{0}}};
     for (int i = 0; i < 4; i++) {
@@ -84,6 +81,39 @@ Matrix4x4 create_transform_matrix(Vector3 position, Vector3 rotation, Vector3 sc
     return transform;
 }
 
+// Inverse of an affine transform: invert the 3x3 linear part by cofactors,
+// then carry the translation through it
+Matrix4x4 matrix_inverse_affine(Matrix4x4 m) {
+    Matrix4x4 inv = matrix_identity();
+    double a = m.m[0][0], b = m.m[0][1], c = m.m[0][2];
+    double d = m.m[1][0], e = m.m[1][1], f = m.m[1][2];
+    double g = m.m[2][0], h = m.m[2][1], k = m.m[2][2];
+
+    double c00 = e * k - f * h;
+    double c01 = f * g - d * k;
+    double c02 = d * h - e * g;
+    double det = a * c00 + b * c01 + c * c02;
+    if (fabs(det) < 1e-12) {
+        return inv;  // Degenerate (zero scale); leave the ray untransformed
+    }
+    double inv_det = 1.0 / det;
+
+    inv.m[0][0] = c00 * inv_det;
+    inv.m[0][1] = (c * h - b * k) * inv_det;
+    inv.m[0][2] = (b * f - c * e) * inv_det;
+    inv.m[1][0] = c01 * inv_det;
+    inv.m[1][1] = (a * k - c * g) * inv_det;
+    inv.m[1][2] = (c * d - a * f) * inv_det;
+    inv.m[2][0] = c02 * inv_det;
+    inv.m[2][1] = (b * g - a * h) * inv_det;
+    inv.m[2][2] = (a * e - b * d) * inv_det;
+
+    for (int i = 0; i < 3; i++) {
+        inv.m[i][3] = -(inv.m[i][0] * m.m[0][3] + inv.m[i][1] * m.m[1][3] + inv.m[i][2] * m.m[2][3]);
+    }
+    return inv;
+}
+
 Vector3 transform_point(Matrix4x4 matrix, Vector3 point) {
     double x = matrix.m[0][0] * point.x + matrix.m[0][1] * point.y + matrix.m[0][2] * point.z + matrix.m[0][3];
     double y = matrix.m[1][0] * point.x + matrix.m[1][1] * point.y + matrix.m[1][2] * point.z + matrix.m[1][3];
@@ -98,34 +128,90 @@ Vector3 transform_vector(Matrix4x4 matrix, Vector3 vector) {
     return vector_create(x, y, z);
 }
 
+// Normals transform by the inverse transpose, given here as the inverse
+Vector3 transform_normal(Matrix4x4 inverse, Vector3 normal) {
+    double x = inverse.m[0][0] * normal.x + inverse.m[1][0] * normal.y + inverse.m[2][0] * normal.z;
+    double y = inverse.m[0][1] * normal.x + inverse.m[1][1] * normal.y + inverse.m[2][1] * normal.z;
+    double z = inverse.m[0][2] * normal.x + inverse.m[1][2] * normal.y + inverse.m[2][2] * normal.z;
+    return vector_create(x, y, z);
+}
+
+MeshTransform mesh_transform_create(Vector3 position, Vector3 rotation, Vector3 scale) {
+    MeshTransform transform;
+    transform.to_world = create_transform_matrix(position, rotation, scale);
+    transform.to_object = matrix_inverse_affine(transform.to_world);
+    return transform;
+}
+
+void mesh_update_transform(Mesh* mesh) {
+    mesh->transform = mesh_transform_create(mesh->position, mesh->rotation, mesh->scale);
+}
 
 Mesh mesh_create(Vector3 position, Vector3 rotation, Vector3 scale, Vector3 color, double reflectivity) {
+    // Storage is allocated on demand, by mesh_reserve or mesh_add_triangle
     Mesh mesh = {
         .position = position,
         .rotation = rotation,
         .scale = scale,
         .color = color,
         .reflectivity = reflectivity,
+        .triangles = NULL,
         .triangle_count = 0,
+        .triangle_capacity = 0,
         .vertex_count = 0,
         .vertices = NULL,
         .vertex_indices = NULL,
-        .use_smooth_shading = 0
+        .normal_map = -1,
+        .use_smooth_shading = 0,
+        .casts_shadow = 1
     };
-    
-    // Allocate initial arrays
-    mesh.vertices = (Vector3*)malloc(MAX_VERTICES * sizeof(Vector3));
-    mesh.vertex_indices = (int*)malloc(MAX_TRIANGLES * 3 * sizeof(int));
-    
-    if (!mesh.vertices || !mesh.vertex_indices) {
+    mesh_update_transform(&mesh);
+    return mesh;
+}
+
+static void mesh_free_triangle_batch(Mesh* mesh) {
+    free(mesh->triangle_batch.v0[0]);
+    memset(&mesh->triangle_batch, 0, sizeof(TriangleBatch));
+}
+
+static int mesh_grow_triangles(Mesh* mesh, int capacity) {
+    if (capacity <= mesh->triangle_capacity) return 1;
+    Triangle* triangles = (Triangle*)realloc(mesh->triangles, (size_t)capacity * sizeof(Triangle));
+    if (!triangles) {
+        fprintf(stderr, "Failed to allocate mesh triangles\n");
+        return 0;
+    }
+    mesh->triangles = triangles;
+    mesh->triangle_capacity = capacity;
+    return 1;
+}
+
+// Size the vertex and index arrays exactly, and make room for the triangles
+int mesh_reserve(Mesh* mesh, int vertex_count, int triangle_count) {
+    Vector3* vertices = (Vector3*)realloc(mesh->vertices, (size_t)(vertex_count > 0 ? vertex_count : 1) * sizeof(Vector3));
+    if (vertices) mesh->vertices = vertices;
+    int* indices = (int*)realloc(mesh->vertex_indices, (size_t)(triangle_count > 0 ? triangle_count : 1) * 3 * sizeof(int));
+    if (indices) mesh->vertex_indices = indices;
+
+    if (!vertices || !indices) {
         fprintf(stderr, "Failed to allocate mesh buffers\n");
-        if (mesh.vertices) free(mesh.vertices);
-        if (mesh.vertex_indices) free(mesh.vertex_indices);
-        mesh.vertices = NULL;
-        mesh.vertex_indices = NULL;
+        return 0;
     }
-    
-    return mesh;
+    return mesh_grow_triangles(mesh, triangle_count);
+}
+
+void mesh_free(Mesh* mesh) {
+    free(mesh->triangles);
+    free(mesh->vertices);
+    free(mesh->vertex_indices);
+    bvh_free(&mesh->bvh);
+    mesh_free_triangle_batch(mesh);
+    mesh->triangles = NULL;
+    mesh->vertices = NULL;
+    mesh->vertex_indices = NULL;
+    mesh->triangle_count = 0;
+    mesh->triangle_capacity = 0;
+    mesh->vertex_count = 0;
 }
 
 void mesh_set_smooth_shading(Mesh* mesh, int enable) {
@@ -142,6 +228,15 @@ void mesh_compute_triangle_normal(Triangle* triangle) {
     Vector3 edge1 = vector_subtract(triangle->vertices[1], triangle->vertices[0]);
     Vector3 edge2 = vector_subtract(triangle->vertices[2], triangle->vertices[0]);
     triangle->face_normal = vector_normalize(vector_cross(edge1, edge2));
+
+    // Each vertex normal is weighted by the lengths of the edges meeting at
+    // it, so smooth-shaded hits need no square roots
+    double len01 = vector_length(edge1);
+    double len02 = vector_length(edge2);
+    double len12 = vector_length(vector_subtract(triangle->vertices[2], triangle->vertices[1]));
+    triangle->normal_weights[0] = len01 + len02;
+    triangle->normal_weights[1] = len01 + len12;
+    triangle->normal_weights[2] = len02 + len12;
     
     // Initialize vertex normals with face normal if smooth shading is not enabled
     if (!triangle->smooth_shading) {
@@ -208,62 +303,73 @@ void mesh_compute_smooth_normals(Mesh* mesh) {
     free(vertex_weights);
 }
 
-void mesh_add_triangle(Mesh* mesh, Vector3 v1, Vector3 v2, Vector3 v3) {
-    if (mesh->triangle_count < MAX_TRIANGLES) {
-        Triangle triangle;
-        triangle.vertices[0] = v1;
-        triangle.vertices[1] = v2;
-        triangle.vertices[2] = v3;
-        mesh_compute_triangle_normal(&triangle);
-        mesh->triangles[mesh->triangle_count++] = triangle;
+int mesh_add_triangle(Mesh* mesh, Vector3 v1, Vector3 v2, Vector3 v3) {
+    if (mesh->triangle_count == mesh->triangle_capacity &&
+        !mesh_grow_triangles(mesh, mesh->triangle_capacity > 0 ? 2 * mesh->triangle_capacity : 16)) {
+        return 0;
     }
+    bvh_free(&mesh->bvh);  // Rebuilt once the geometry is complete
+    mesh_free_triangle_batch(mesh);
+
+    Triangle triangle;
+    triangle.vertices[0] = v1;
+    triangle.vertices[1] = v2;
+    triangle.vertices[2] = v3;
+    triangle.smooth_shading = 0;  // Flat until mesh_set_smooth_shading
+    mesh_compute_triangle_normal(&triangle);
+    mesh->triangles[mesh->triangle_count++] = triangle;
+    return 1;
 }
 
-int ray_triangle_intersect(Ray ray, Triangle triangle, double t_min, double t_max, Hit* hit) {
-    Vector3 edge1 = vector_subtract(triangle.vertices[1], triangle.vertices[0]);
-    Vector3 edge2 = vector_subtract(triangle.vertices[2], triangle.vertices[0]);
+static void triangle_fill_hit(const Ray* ray, const Triangle* triangle, double t, double u, double v, Hit* hit);
+
+int ray_triangle_intersect(Ray ray, const Triangle* triangle, double t_min, double t_max, Hit* hit) {
+    Vector3 edge1 = vector_subtract(triangle->vertices[1], triangle->vertices[0]);
+    Vector3 edge2 = vector_subtract(triangle->vertices[2], triangle->vertices[0]);
     
     // Calculate determinant
     Vector3 pvec = vector_cross(ray.direction, edge2);
-    double det = vector_dot(edge1, pvec);
+    vector_real det = vector_dot(edge1, pvec);
     
     // Two-sided triangle test
     if (fabs(det) < 0.000001) return 0;
     
-    double inv_det = 1.0 / det;
+    vector_real inv_det = 1.0 / det;
     
     // Calculate barycentric coordinates
-    Vector3 tvec = vector_subtract(ray.origin, triangle.vertices[0]);
-    double u = vector_dot(tvec, pvec) * inv_det;
+    Vector3 tvec = vector_subtract(ray.origin, triangle->vertices[0]);
+    vector_real u = vector_dot(tvec, pvec) * inv_det;
     if (u < 0.0 || u > 1.0) return 0;
     
     Vector3 qvec = vector_cross(tvec, edge1);
-    double v = vector_dot(ray.direction, qvec) * inv_det;
+    vector_real v = vector_dot(ray.direction, qvec) * inv_det;
     if (v < 0.0 || u + v > 1.0) return 0;
     
-    double t = vector_dot(edge2, qvec) * inv_det;
+    vector_real t = vector_dot(edge2, qvec) * inv_det;
     if (t < t_min || t > t_max) return 0;
     
+    triangle_fill_hit(&ray, triangle, t, u, v, hit);
+    return 1;
+}
+
+// Shading attributes of a hit at distance t and barycentrics (u, v), shared
+// by the single-triangle test and the batched traversal's closest hit
+static void triangle_fill_hit(const Ray* ray, const Triangle* triangle, double t, double u, double v, Hit* hit) {
     // Calculate intersection point
     hit->t = t;
-    hit->point = ray_point_at(ray, t);
+    hit->point = ray_point_at(*ray, t);
     
     // Calculate barycentric coordinates
     double w = 1.0 - u - v;
     
-    if (triangle.smooth_shading) {
+    if (triangle->smooth_shading) {
         // Enhanced smooth normal interpolation with proper weighting
         Vector3 interpolated_normal;
         
-        // Calculate edge lengths for proper weighting
-        double len01 = vector_length(edge1);
-        double len02 = vector_length(edge2);
-        double len12 = vector_length(vector_subtract(triangle.vertices[2], triangle.vertices[1]));
-        
         // Calculate weights based on edge lengths and barycentric coordinates
-        double weight0 = w * (len01 + len02);
-        double weight1 = u * (len01 + len12);
-        double weight2 = v * (len02 + len12);
+        double weight0 = w * triangle->normal_weights[0];
+        double weight1 = u * triangle->normal_weights[1];
+        double weight2 = v * triangle->normal_weights[2];
         double total_weight = weight0 + weight1 + weight2;
         
         if (total_weight > 0.0) {
@@ -273,62 +379,382 @@ int ray_triangle_intersect(Ray ray, Triangle triangle, double t_min, double t_ma
             
             interpolated_normal = vector_add(
                 vector_add(
-                    vector_multiply(triangle.normals[0], weight0),
-                    vector_multiply(triangle.normals[1], weight1)
+                    vector_multiply(triangle->normals[0], weight0),
+                    vector_multiply(triangle->normals[1], weight1)
                 ),
-                vector_multiply(triangle.normals[2], weight2)
+                vector_multiply(triangle->normals[2], weight2)
             );
         } else {
-            interpolated_normal = triangle.face_normal;
+            interpolated_normal = triangle->face_normal;
         }
         
         hit->normal = vector_normalize(interpolated_normal);
     } else {
-        hit->normal = triangle.face_normal;
+        hit->normal = triangle->face_normal;
     }
     
     // Store barycentric coordinates for texture mapping
     hit->tex_coord.u = u;
     hit->tex_coord.v = v;
-    
+}
+
+// The batched kernel mirrors ray_triangle_intersect operation for operation,
+// including the fma forms of vector_cross and vector_dot, so both agree on
+// every hit. Like the single test, a later slot at an equal distance wins.
+int triangle_batch_intersect(const TriangleBatch* batch, int first, int count, const Ray* ray,
+                             double t_min, double t_max, int* hit_slot, double* hit_t,
+                             double* hit_u, double* hit_v) {
+    Vector3 o = ray->origin;
+    Vector3 d = ray->direction;
+
+    int best = -1;
+    double closest = t_max, best_u = 0.0, best_v = 0.0;
+    int end = first + count;
+    int slot = first;
+
+#ifdef __AVX2__
+    const SimdReal ox = simd_set1(o.x), oy = simd_set1(o.y), oz = simd_set1(o.z);
+    const SimdReal dx = simd_set1(d.x), dy = simd_set1(d.y), dz = simd_set1(d.z);
+    const SimdReal det_epsilon = simd_set1(0.000001);
+    const SimdReal zero = simd_set1(0);
+    const SimdReal one = simd_set1(1);
+    const SimdReal lo = simd_set1(t_min);
+
+    // Padding makes whole-register loads past the leaf safe; surplus lanes
+    // are discarded below
+    for (; slot < end; slot += TRIANGLE_BATCH_WIDTH) {
+        SimdReal e1x = simd_load(batch->edge1[0] + slot);
+        SimdReal e1y = simd_load(batch->edge1[1] + slot);
+        SimdReal e1z = simd_load(batch->edge1[2] + slot);
+        SimdReal e2x = simd_load(batch->edge2[0] + slot);
+        SimdReal e2y = simd_load(batch->edge2[1] + slot);
+        SimdReal e2z = simd_load(batch->edge2[2] + slot);
+
+        SimdReal px = simd_fmsub(dy, e2z, simd_mul(dz, e2y));
+        SimdReal py = simd_fmsub(dz, e2x, simd_mul(dx, e2z));
+        SimdReal pz = simd_fmsub(dx, e2y, simd_mul(dy, e2x));
+        SimdReal det = simd_fmadd(e1x, px, simd_fmadd(e1y, py, simd_mul(e1z, pz)));
+        SimdReal valid = simd_greater_equal(simd_abs(det), det_epsilon);
+        if (simd_mask(valid) == 0) continue;
+        SimdReal inv_det = simd_div(one, det);
+
+        SimdReal tx = simd_sub(ox, simd_load(batch->v0[0] + slot));
+        SimdReal ty = simd_sub(oy, simd_load(batch->v0[1] + slot));
+        SimdReal tz = simd_sub(oz, simd_load(batch->v0[2] + slot));
+        SimdReal u = simd_mul(simd_fmadd(tx, px, simd_fmadd(ty, py, simd_mul(tz, pz))), inv_det);
+
+        SimdReal qx = simd_fmsub(ty, e1z, simd_mul(tz, e1y));
+        SimdReal qy = simd_fmsub(tz, e1x, simd_mul(tx, e1z));
+        SimdReal qz = simd_fmsub(tx, e1y, simd_mul(ty, e1x));
+        SimdReal v = simd_mul(simd_fmadd(dx, qx, simd_fmadd(dy, qy, simd_mul(dz, qz))), inv_det);
+        SimdReal t = simd_mul(simd_fmadd(e2x, qx, simd_fmadd(e2y, qy, simd_mul(e2z, qz))), inv_det);
+
+        SimdReal hi = simd_set1(closest);
+        valid = simd_and(valid, simd_greater_equal(u, zero));
+        valid = simd_and(valid, simd_less_equal(u, one));
+        valid = simd_and(valid, simd_greater_equal(v, zero));
+        valid = simd_and(valid, simd_less_equal(simd_add(u, v), one));
+        valid = simd_and(valid, simd_greater_equal(t, lo));
+        valid = simd_and(valid, simd_less_equal(t, hi));
+        int mask = simd_mask(valid);
+        if (mask == 0) continue;
+
+        vector_real lanes_t[TRIANGLE_BATCH_WIDTH], lanes_u[TRIANGLE_BATCH_WIDTH], lanes_v[TRIANGLE_BATCH_WIDTH];
+        simd_store(lanes_t, t);
+        simd_store(lanes_u, u);
+        simd_store(lanes_v, v);
+        for (int lane = 0; lane < TRIANGLE_BATCH_WIDTH && slot + lane < end; lane++) {
+            if ((mask & (1 << lane)) && lanes_t[lane] <= closest) {
+                closest = lanes_t[lane];
+                best_u = lanes_u[lane];
+                best_v = lanes_v[lane];
+                best = slot + lane;
+            }
+        }
+    }
+#else
+    for (; slot < end; slot++) {
+        Vector3 edge1 = {batch->edge1[0][slot], batch->edge1[1][slot], batch->edge1[2][slot]};
+        Vector3 edge2 = {batch->edge2[0][slot], batch->edge2[1][slot], batch->edge2[2][slot]};
+        Vector3 v0 = {batch->v0[0][slot], batch->v0[1][slot], batch->v0[2][slot]};
+
+        Vector3 pvec = vector_cross(d, edge2);
+        vector_real det = vector_dot(edge1, pvec);
+        if (fabs(det) < 0.000001) continue;
+        vector_real inv_det = 1.0 / det;
+
+        Vector3 tvec = vector_subtract(o, v0);
+        vector_real u = vector_dot(tvec, pvec) * inv_det;
+        if (u < 0.0 || u > 1.0) continue;
+
+        Vector3 qvec = vector_cross(tvec, edge1);
+        vector_real v = vector_dot(d, qvec) * inv_det;
+        if (v < 0.0 || u + v > 1.0) continue;
+
+        vector_real t = vector_dot(edge2, qvec) * inv_det;
+        if (t < t_min || t > closest) continue;
+
+        closest = t;
+        best_u = u;
+        best_v = v;
+        best = slot;
+    }
+#endif
+
+    if (best < 0) return 0;
+    *hit_slot = best;
+    *hit_t = closest;
+    *hit_u = best_u;
+    *hit_v = best_v;
     return 1;
 }
 
-int mesh_intersect(Mesh* mesh, Ray ray, double t_min, double t_max, Hit* hit) {
+// Lay triangle hit data out in the tree's leaf order, so a leaf's triangles
+// are contiguous for the batched kernel
+static int mesh_build_triangle_batch(Mesh* mesh) {
+    mesh_free_triangle_batch(mesh);
+
+    TriangleBatch* batch = &mesh->triangle_batch;
+    int slots = mesh->bvh.index_count;
+    int padded = slots + TRIANGLE_BATCH_WIDTH - 1;  // Whole-register loads may overrun a leaf
+    vector_real* data = (vector_real*)calloc((size_t)(padded > 0 ? padded : 1) * 9, sizeof(vector_real));
+    if (!data) return 0;
+
+    // Padding slots keep zero edges, which the determinant test rejects
+    for (int axis = 0; axis < 3; axis++) {
+        batch->v0[axis] = data + (size_t)axis * padded;
+        batch->edge1[axis] = data + (size_t)(3 + axis) * padded;
+        batch->edge2[axis] = data + (size_t)(6 + axis) * padded;
+    }
+    for (int slot = 0; slot < slots; slot++) {
+        const Triangle* triangle = &mesh->triangles[mesh->bvh.indices[slot]];
+        Vector3 edge1 = vector_subtract(triangle->vertices[1], triangle->vertices[0]);
+        Vector3 edge2 = vector_subtract(triangle->vertices[2], triangle->vertices[0]);
+        batch->v0[0][slot] = triangle->vertices[0].x;
+        batch->v0[1][slot] = triangle->vertices[0].y;
+        batch->v0[2][slot] = triangle->vertices[0].z;
+        batch->edge1[0][slot] = edge1.x;
+        batch->edge1[1][slot] = edge1.y;
+        batch->edge1[2][slot] = edge1.z;
+        batch->edge2[0][slot] = edge2.x;
+        batch->edge2[1][slot] = edge2.y;
+        batch->edge2[2][slot] = edge2.z;
+    }
+    batch->count = slots;
+    return 1;
+}
+
+int mesh_build_bvh(Mesh* mesh) {
+    AABB* bounds = (AABB*)malloc((mesh->triangle_count > 0 ? mesh->triangle_count : 1) * sizeof(AABB));
+    if (!bounds) return 0;
+
+    for (int i = 0; i < mesh->triangle_count; i++) {
+        AABB box = aabb_empty();
+        for (int v = 0; v < 3; v++) {
+            box = aabb_grow(box, mesh->triangles[i].vertices[v]);
+        }
+        if (!aabb_is_finite(box)) {
+            fprintf(stderr, "Error: Mesh triangle %d has non-finite vertices\n", i);
+            free(bounds);
+            return 0;
+        }
+        bounds[i] = box;
+    }
+
+    bvh_free(&mesh->bvh);
+    int ok = TRIANGLE_BATCH_WIDTH > 1
+        ? bvh_build_batched(&mesh->bvh, bounds, NULL, mesh->triangle_count, TRIANGLE_BATCH_WIDTH)
+        : bvh_build(&mesh->bvh, bounds, NULL, mesh->triangle_count, MESH_BVH_LEAF_SIZE);
+    free(bounds);
+    if (ok && !mesh_build_triangle_batch(mesh)) {
+        bvh_free(&mesh->bvh);
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to allocate mesh BVH\n");
+    }
+    return ok;
+}
+
+static int mesh_triangle_intersect(void* context, int triangle, const Ray* ray,
+                                   double t_min, double t_max, Hit* hit) {
+    const Mesh* mesh = (const Mesh*)context;
+    if (!ray_triangle_intersect(*ray, &mesh->triangles[triangle], t_min, t_max, hit)) return 0;
+    hit->primitive = triangle;
+    return 1;
+}
+
+// Test a whole leaf with the batched kernel (BVHLeafIntersectFn). Only the
+// triangle, distance and barycentrics are recorded; mesh_intersect_instance
+// shades the closest hit once traversal is done.
+static int mesh_leaf_intersect(void* context, int first, int count, const Ray* ray,
+                               double t_min, double t_max, Hit* hit) {
+    const Mesh* mesh = (const Mesh*)context;
+    int slot;
+    double t, u, v;
+    if (!triangle_batch_intersect(&mesh->triangle_batch, first, count, ray, t_min, t_max, &slot, &t, &u, &v)) {
+        return 0;
+    }
+    hit->primitive = mesh->bvh.indices[slot];
+    hit->t = t;
+    hit->tex_coord.u = u;
+    hit->tex_coord.v = v;
+    return 1;
+}
+
+int mesh_intersect_instance(const Mesh* mesh, const MeshTransform* transform, const Ray* ray,
+                            double t_min, double t_max, Hit* hit) {
     int hit_anything = 0;
     double closest_so_far = t_max;
     Hit temp_hit;
     
-    // Create transformation matrix
-    Matrix4x4 transform = create_transform_matrix(mesh->position, mesh->rotation, mesh->scale);
-    Matrix4x4 inverse_transform = matrix_identity();  // TODO: Implement proper matrix inversion
-    
-    // Transform ray to mesh space
-    Ray transformed_ray = ray;
-    transformed_ray.origin = vector_subtract(ray.origin, mesh->position);  // Simple translation for now
-    transformed_ray.origin = transform_point(inverse_transform, ray.origin);
-    transformed_ray.direction = transform_vector(inverse_transform, ray.direction);
-    transformed_ray.direction = vector_normalize(transformed_ray.direction);
-    
-    for (int i = 0; i < mesh->triangle_count; i++) {
-        if (ray_triangle_intersect(transformed_ray, mesh->triangles[i], t_min, closest_so_far, &temp_hit)) {
-            hit_anything = 1;
-            closest_so_far = temp_hit.t;
-            
-            // Transform intersection point and normal back to world space
-            temp_hit.point = transform_point(transform, temp_hit.point);
-            temp_hit.normal = transform_vector(transform, temp_hit.normal);
-            temp_hit.normal = vector_normalize(temp_hit.normal);
-            
-            *hit = temp_hit;
+    // Transform ray to mesh space. The direction is deliberately left
+    // unnormalised so hit distances agree between mesh and world space.
+    Ray transformed_ray = *ray;
+    transformed_ray.origin = transform_point(transform->to_object, ray->origin);
+    transformed_ray.direction = transform_vector(transform->to_object, ray->direction);
+    
+    if (mesh->bvh.node_count > 0 && vector_get_precision_mode() != PRECISION_ARBITRARY) {
+        hit_anything = bvh_intersect_leaves(&mesh->bvh, &transformed_ray, t_min, closest_so_far,
+                                            mesh_leaf_intersect, (void*)mesh, &temp_hit);
+        if (hit_anything) {
+            triangle_fill_hit(&transformed_ray, &mesh->triangles[temp_hit.primitive], temp_hit.t,
+                              temp_hit.tex_coord.u, temp_hit.tex_coord.v, &temp_hit);
+        }
+    } else if (mesh->bvh.node_count > 0) {
+        // The batched kernel works in vector_real, so arbitrary precision keeps
+        // the per-triangle test
+        hit_anything = bvh_intersect(&mesh->bvh, &transformed_ray, t_min, closest_so_far,
+                                     mesh_triangle_intersect, (void*)mesh, &temp_hit);
+    } else {
+        // Geometry changed since the last build: test every triangle
+        for (int i = 0; i < mesh->triangle_count; i++) {
+            if (ray_triangle_intersect(transformed_ray, &mesh->triangles[i], t_min, closest_so_far, &temp_hit)) {
+                hit_anything = 1;
+                closest_so_far = temp_hit.t;
+                temp_hit.primitive = i;
+            }
         }
     }
+
+    if (hit_anything) {
+        // Transform intersection point and normal back to world space
+        temp_hit.point = transform_point(transform->to_world, temp_hit.point);
+        temp_hit.normal = transform_normal(transform->to_object, temp_hit.normal);
+        temp_hit.normal = vector_normalize(temp_hit.normal);
+        
+        *hit = temp_hit;
+    }
     
     return hit_anything;
 }
 
-Mesh create_cube_mesh(Vector3 position, double size, Vector3 color, double reflectivity) {
-    Mesh mesh = mesh_create(position, vector_create(0, 0, 0), vector_create(1, 1, 1), color, reflectivity);
+// Row r of the matrix applied to a point, in double-double
+static DoubleDouble dd_transform_row(const Matrix4x4* matrix, int r, Vector3 point) {
+    DoubleDouble sum = dd_two_prod(matrix->m[r][0], point.x);
+    sum = dd_add(sum, dd_two_prod(matrix->m[r][1], point.y));
+    sum = dd_add(sum, dd_two_prod(matrix->m[r][2], point.z));
+    return dd_add(sum, dd_from_double(matrix->m[r][3]));
+}
+
+void mesh_refine_hit(const Mesh* mesh, const MeshTransform* transform, const Ray* ray, Hit* hit) {
+    if (hit->primitive < 0 || hit->primitive >= mesh->triangle_count) return;
+    const Triangle* triangle = &mesh->triangles[hit->primitive];
+
+    // Place the triangle in world space without rounding, and intersect the
+    // world ray with its plane there
+    DoubleDoubleVector3 vertices[3];
+    for (int i = 0; i < 3; i++) {
+        vertices[i].x = dd_transform_row(&transform->to_world, 0, triangle->vertices[i]);
+        vertices[i].y = dd_transform_row(&transform->to_world, 1, triangle->vertices[i]);
+        vertices[i].z = dd_transform_row(&transform->to_world, 2, triangle->vertices[i]);
+    }
+    DoubleDoubleVector3 normal = dd_vector_cross(dd_vector_subtract(vertices[1], vertices[0]),
+                                                 dd_vector_subtract(vertices[2], vertices[0]));
+
+    DoubleDoubleVector3 origin = dd_vector_from(ray->origin);
+    DoubleDoubleVector3 direction = dd_vector_from(ray->direction);
+    DoubleDouble denominator = dd_vector_dot(direction, normal);
+    if (denominator.hi == 0.0) return;
+
+    DoubleDouble t = dd_divide(dd_vector_dot(dd_vector_subtract(vertices[0], origin), normal), denominator);
+    hit->t = dd_to_double(t);
+    hit->point = dd_vector_to(dd_ray_point_at(origin, direction, t));
+}
+
+static int mesh_leaf_occluded(void* context, int first, int count, const Ray* ray,
+                              double t_min, double t_max) {
+    const Mesh* mesh = (const Mesh*)context;
+    int slot;
+    double t, u, v;
+    return triangle_batch_intersect(&mesh->triangle_batch, first, count, ray, t_min, t_max, &slot, &t, &u, &v);
+}
+
+int mesh_occluded_instance(const Mesh* mesh, const MeshTransform* transform, const Ray* ray,
+                           double t_min, double t_max) {
+    Ray transformed_ray = *ray;
+    transformed_ray.origin = transform_point(transform->to_object, ray->origin);
+    transformed_ray.direction = transform_vector(transform->to_object, ray->direction);
+
+    if (mesh->bvh.node_count > 0 && vector_get_precision_mode() != PRECISION_ARBITRARY) {
+        return bvh_occluded(&mesh->bvh, &transformed_ray, t_min, t_max, mesh_leaf_occluded, (void*)mesh);
+    }
+
+    // Arbitrary precision, or no tree yet: the per-triangle test
+    Hit scratch;
+    for (int i = 0; i < mesh->triangle_count; i++) {
+        if (ray_triangle_intersect(transformed_ray, &mesh->triangles[i], t_min, t_max, &scratch)) return 1;
+    }
+    return 0;
+}
+
+int mesh_intersect(Mesh* mesh, Ray ray, double t_min, double t_max, Hit* hit) {
+    return mesh_intersect_instance(mesh, &mesh->transform, &ray, t_min, t_max, hit);
+}
+
+static AABB mesh_local_bounds(const Mesh* mesh) {
+    if (mesh->bvh.node_count > 0) {
+        return mesh->bvh.nodes[0].bounds;
+    }
+    AABB local = aabb_empty();
+    for (int i = 0; i < mesh->triangle_count; i++) {
+        for (int v = 0; v < 3; v++) {
+            local = aabb_grow(local, mesh->triangles[i].vertices[v]);
+        }
+    }
+    return local;
+}
+
+double mesh_local_radius(const Mesh* mesh) {
+    if (mesh->triangle_count == 0) return 0.0;
+    AABB local = mesh_local_bounds(mesh);
+    double x = fmax(fabs(local.min.x), fabs(local.max.x));
+    double y = fmax(fabs(local.min.y), fabs(local.max.y));
+    double z = fmax(fabs(local.min.z), fabs(local.max.z));
+    return sqrt(x * x + y * y + z * z);
+}
+
+AABB mesh_bounds(const Mesh* mesh) {
+    AABB local = mesh_local_bounds(mesh);
+    if (mesh->triangle_count == 0) return local;
+
+    // Bound the transformed corners of the local box
+    Matrix4x4 transform = create_transform_matrix(mesh->position, mesh->rotation, mesh->scale);
+    AABB world = aabb_empty();
+    for (int corner = 0; corner < 8; corner++) {
+        Vector3 p = vector_create(
+            (corner & 1) ? local.max.x : local.min.x,
+            (corner & 2) ? local.max.y : local.min.y,
+            (corner & 4) ? local.max.z : local.min.z
+        );
+        world = aabb_grow(world, transform_point(transform, p));
+    }
+    return world;
+}
+
+// Returns 0, with the mesh freed, if its storage cannot be allocated
+int create_cube_mesh(Mesh* mesh, Vector3 position, double size, Vector3 color, double reflectivity) {
+    *mesh = mesh_create(position, vector_create(0, 0, 0), vector_create(1, 1, 1), color, reflectivity);
     
     double s = size / 2.0;
     Vector3 vertices[8] = {
@@ -342,29 +768,35 @@ Mesh create_cube_mesh(Vector3 position, double size, Vector3 color, double refle
         vector_create(-s, s, s)    // 7: left top front
     };
     
+    int added = 1;
+    
     // Front face
-    mesh_add_triangle(&mesh, vertices[4], vertices[5], vertices[6]);
-    mesh_add_triangle(&mesh, vertices[4], vertices[6], vertices[7]);
+    added = added && mesh_add_triangle(mesh, vertices[4], vertices[5], vertices[6]);
+    added = added && mesh_add_triangle(mesh, vertices[4], vertices[6], vertices[7]);
     
     // Back face
-    mesh_add_triangle(&mesh, vertices[1], vertices[0], vertices[2]);
-    mesh_add_triangle(&mesh, vertices[2], vertices[0], vertices[3]);
+    added = added && mesh_add_triangle(mesh, vertices[1], vertices[0], vertices[2]);
+    added = added && mesh_add_triangle(mesh, vertices[2], vertices[0], vertices[3]);
     
     // Right face
-    mesh_add_triangle(&mesh, vertices[5], vertices[1], vertices[6]);
-    mesh_add_triangle(&mesh, vertices[6], vertices[1], vertices[2]);
+    added = added && mesh_add_triangle(mesh, vertices[5], vertices[1], vertices[6]);
+    added = added && mesh_add_triangle(mesh, vertices[6], vertices[1], vertices[2]);
     
     // Left face
-    mesh_add_triangle(&mesh, vertices[0], vertices[4], vertices[3]);
-    mesh_add_triangle(&mesh, vertices[3], vertices[4], vertices[7]);
+    added = added && mesh_add_triangle(mesh, vertices[0], vertices[4], vertices[3]);
+    added = added && mesh_add_triangle(mesh, vertices[3], vertices[4], vertices[7]);
     
     // Top face
-    mesh_add_triangle(&mesh, vertices[3], vertices[7], vertices[2]);
-    mesh_add_triangle(&mesh, vertices[2], vertices[7], vertices[6]);
+    added = added && mesh_add_triangle(mesh, vertices[3], vertices[7], vertices[2]);
+    added = added && mesh_add_triangle(mesh, vertices[2], vertices[7], vertices[6]);
     
     // Bottom face
-    mesh_add_triangle(&mesh, vertices[4], vertices[0], vertices[5]);
-    mesh_add_triangle(&mesh, vertices[5], vertices[0], vertices[1]);
+    added = added && mesh_add_triangle(mesh, vertices[4], vertices[0], vertices[5]);
+    added = added && mesh_add_triangle(mesh, vertices[5], vertices[0], vertices[1]);
     
-    return mesh;
+    if (!added || !mesh_build_bvh(mesh)) {
+        mesh_free(mesh);
+        return 0;
+    }
+    return 1;
 }
@@ -3,23 +3,52 @@
 
 #include "common.h"
 #include "ray.h"
+#include "bvh.h"
+#include "simd.h"
 
-#define MAX_TRIANGLES 1000
+#define MESH_BVH_LEAF_SIZE 4
 
 typedef struct {
     Vector3 vertices[3];     // Three vertices defining the triangle
     Vector3 normals[3];      // Per-vertex normals for smooth shading
     Vector3 face_normal;     // Face normal (precomputed)
+    vector_real normal_weights[3];  // Edge-length weights of the vertex normals (precomputed)
     int smooth_shading;      // Flag for smooth shading
 } Triangle;
 
-#define MAX_VERTICES 2000
+// Triangles tested per pass of the batched kernel: one AVX2 register of
+// components, or one at a time where the scalar fallback is compiled in
+#define TRIANGLE_BATCH_WIDTH SIMD_WIDTH
+
+// Precomputed Moller-Trumbore data (first vertex and both edges) in
+// structure-of-arrays form, laid out in BVH leaf order. Normals and shading
+// flags stay in the Triangle records, read only for the mesh's closest hit.
+// Arrays hold TRIANGLE_BATCH_WIDTH - 1 degenerate slots past count so whole
+// batches can be loaded.
+typedef struct {
+    vector_real* v0[3];
+    vector_real* edge1[3];
+    vector_real* edge2[3];
+    int count;
+} TriangleBatch;
+
+typedef struct {
+    double m[4][4];
+} Matrix4x4;
+
+// Placement of a mesh in the world. Both directions are computed once per
+// pose, so rays can share one transform instead of rebuilding it per test.
+typedef struct {
+    Matrix4x4 to_world;
+    Matrix4x4 to_object;
+} MeshTransform;
 
 // Mesh structure definition
 typedef struct Mesh {
-    Triangle triangles[MAX_TRIANGLES];
+    Triangle* triangles;       // Grows as triangles are added
     int triangle_count;
-    Vector3* vertices;         // Dynamic vertex array
+    int triangle_capacity;
+    Vector3* vertices;         // Dynamic vertex array (see mesh_reserve)
     int* vertex_indices;       // Triangle vertex indices
     int vertex_count;          // Total number of vertices
     Vector3 position;          // Mesh position in world space
@@ -29,21 +58,46 @@ typedef struct Mesh {
     double reflectivity;      // Mesh reflectivity
     double fresnel_ior;       // Index of Refraction for Fresnel calculations
     double fresnel_power;     // Controls strength of Fresnel effect
-    Texture* normal_map;      // Normal map for enhanced surface detail
+    int normal_map;           // Index into the scene's textures, or -1 for none
     int use_smooth_shading;   // Global smooth shading flag
+    int casts_shadow;         // 0 leaves the mesh out of shadow rays
+    BVH bvh;                  // Mesh-space triangle hierarchy (see mesh_build_bvh)
+    TriangleBatch triangle_batch;  // Hit-test data in bvh leaf order, built with it
+    MeshTransform transform;  // Cached from position/rotation/scale (see mesh_update_transform)
 } Mesh;
 
 // Function declarations
 void mesh_compute_smooth_normals(Mesh* mesh);
 void mesh_set_smooth_shading(Mesh* mesh, int enable);
 Mesh mesh_create(Vector3 position, Vector3 rotation, Vector3 scale, Vector3 color, double reflectivity);
-void mesh_add_triangle(Mesh* mesh, Vector3 v1, Vector3 v2, Vector3 v3);
+int mesh_reserve(Mesh* mesh, int vertex_count, int triangle_count);
+int mesh_add_triangle(Mesh* mesh, Vector3 v1, Vector3 v2, Vector3 v3);  // 0 if storage cannot grow
+void mesh_free(Mesh* mesh);
 int mesh_intersect(Mesh* mesh, Ray ray, double t_min, double t_max, Hit* hit);
-int ray_triangle_intersect(Ray ray, Triangle triangle, double t_min, double t_max, Hit* hit);
+// Intersect the mesh's triangles placed by an arbitrary instance transform
+int mesh_intersect_instance(const Mesh* mesh, const MeshTransform* transform, const Ray* ray,
+                            double t_min, double t_max, Hit* hit);
+// Recompute a confirmed hit's distance and point in double-double precision
+// against its triangle (hit->primitive) placed by the same transform
+void mesh_refine_hit(const Mesh* mesh, const MeshTransform* transform, const Ray* ray, Hit* hit);
+// Whether any triangle blocks the ray within [t_min, t_max], computing no hit attributes
+int mesh_occluded_instance(const Mesh* mesh, const MeshTransform* transform, const Ray* ray,
+                           double t_min, double t_max);
+MeshTransform mesh_transform_create(Vector3 position, Vector3 rotation, Vector3 scale);
+void mesh_update_transform(Mesh* mesh);
+int mesh_build_bvh(Mesh* mesh);
+int ray_triangle_intersect(Ray ray, const Triangle* triangle, double t_min, double t_max, Hit* hit);
+// Closest hit among batch slots [first, first + count), reporting the slot,
+// distance and barycentric coordinates without touching any Triangle record
+int triangle_batch_intersect(const TriangleBatch* batch, int first, int count, const Ray* ray,
+                             double t_min, double t_max, int* hit_slot, double* hit_t,
+                             double* hit_u, double* hit_v);
 
 // Utility functions
 void mesh_compute_triangle_normal(Triangle* triangle);
-Mesh create_cube_mesh(Vector3 position, double size, Vector3 color, double reflectivity);
+int create_cube_mesh(Mesh* mesh, Vector3 position, double size, Vector3 color, double reflectivity);
 Vector3 calculate_mesh_normal(Vector3 normal, Vector2Double tex_coord, Texture* normal_map);
+AABB mesh_bounds(const Mesh* mesh);  // World-space bounds under the mesh transform
+double mesh_local_radius(const Mesh* mesh);  // Mesh-space distance from origin to farthest bound
 
 #endif
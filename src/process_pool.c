@@ -0,0 +1,317 @@
+#include "process_pool.h"
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROCESS_POOL_EXIT -1  // Frame number telling workers to exit
+
+// Start of the shared segment. One done flag per tile follows it, then the
+// framebuffer on its own cache line.
+struct ProcessPoolShared {
+    sem_t start;     // Posted once per live worker to begin a frame
+    sem_t progress;  // Posted for every finished tile
+    _Atomic int frame;  // Frame being rendered, or PROCESS_POOL_EXIT
+    _Atomic uint32_t generation;  // Frames started so far
+    // Tile claims: the generation in the high half and the next unclaimed
+    // tile in the low half, so a worker still finishing one frame can never
+    // claim a tile of the next
+    _Atomic uint64_t next_tile;
+    _Atomic int tiles_done;
+    _Atomic long long paths;
+    // Raised by each worker before it claims, and lowered once the claimed
+    // tile is done, so the pool can tell when every claimed tile is finished
+    // or lost
+    _Atomic int busy[PROCESS_POOL_MAX_WORKERS];
+};
+
+static _Atomic int* process_pool_tile_flags(const ProcessPool* pool) {
+    return (_Atomic int*)((unsigned char*)pool->shared + sizeof(ProcessPoolShared));
+}
+
+static size_t process_pool_framebuffer_offset(int tile_count) {
+    size_t offset = sizeof(ProcessPoolShared) + (size_t)tile_count * sizeof(_Atomic int);
+    return (offset + 63) & ~(size_t)63;
+}
+
+static Vector3* process_pool_framebuffer(const ProcessPool* pool) {
+    return (Vector3*)((unsigned char*)pool->shared + process_pool_framebuffer_offset(pool->layout.tile_count));
+}
+
+// Claim the next tile of the given frame generation. Returns -1 once that
+// frame has no unclaimed tiles left.
+static int process_pool_claim(ProcessPoolShared* shared, uint32_t generation, int tile_count) {
+    uint64_t claim = atomic_load(&shared->next_tile);
+    while ((uint32_t)(claim >> 32) == generation && (int)(uint32_t)claim < tile_count) {
+        if (atomic_compare_exchange_weak(&shared->next_tile, &claim, claim + 1)) {
+            return (int)(uint32_t)claim;
+        }
+    }
+    return -1;
+}
+
+// Render one tile of the current frame into the shared framebuffer
+static void process_pool_render_tile(ProcessPool* pool, int tile, PixelAccumulator* accumulators) {
+    const Tile* bounds = &pool->layout.tiles[tile];
+    int count = (bounds->x1 - bounds->x0) * (bounds->y1 - bounds->y0);
+    memset(accumulators, 0, count * sizeof(PixelAccumulator));
+
+    RenderStats stats;
+    render_tile_pass(pool->scene, &pool->camera, &pool->settings, bounds, accumulators,
+                     pool->settings.samples_per_pixel, &stats);
+
+    Vector3* pixels = process_pool_framebuffer(pool);
+    const int motion_samples = scene_motion_samples(pool->scene);
+    const PixelAccumulator* pixel = accumulators;
+    for (int y = bounds->y0; y < bounds->y1; y++) {
+        for (int x = bounds->x0; x < bounds->x1; x++) {
+            pixels[y * pool->settings.width + x] = pixel_accumulator_resolve(pixel++, motion_samples);
+        }
+    }
+
+    atomic_fetch_add(&pool->shared->paths, stats.paths);
+    atomic_store(&process_pool_tile_flags(pool)[tile], 1);
+    atomic_fetch_add(&pool->shared->tiles_done, 1);
+}
+
+static void process_pool_worker(ProcessPool* pool, int index, pid_t parent) {
+    ProcessPoolShared* shared = pool->shared;
+    const int tile_size = pool->settings.tile_size;
+    PixelAccumulator* accumulators = (PixelAccumulator*)malloc((size_t)tile_size * tile_size * sizeof(PixelAccumulator));
+    if (!accumulators) {
+        fprintf(stderr, "Error: Worker %d could not allocate its tile buffer\n", index);
+        return;
+    }
+
+    uint32_t posed = 0;  // Generation the scene was last posed for
+    for (;;) {
+        // Wake up now and then to leave if the pool's process has gone
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        if (sem_timedwait(&shared->start, &deadline) != 0) {
+            if (getppid() != parent) break;
+            continue;
+        }
+
+        uint32_t generation = atomic_load(&shared->generation);
+        if (atomic_load(&shared->frame) == PROCESS_POOL_EXIT) break;
+
+        for (;;) {
+            atomic_store(&shared->busy[index], 1);
+            int tile = process_pool_claim(shared, generation, pool->layout.tile_count);
+            if (tile < 0) break;
+
+            // A successful claim means frame holds this generation's frame
+            if (posed != generation) {
+                Scene* scene = pool->scene;
+                scene->animation_state.current_frame = atomic_load(&shared->frame);
+                scene->animation_state.current_time = scene->animation_state.current_frame / pool->frame_rate;
+                if (!scene_update_bvh(scene)) {
+                    free(accumulators);
+                    _exit(1);  // The pool takes over the claimed tile
+                }
+                posed = generation;
+            }
+
+            process_pool_render_tile(pool, tile, accumulators);
+            atomic_store(&shared->busy[index], 0);
+            sem_post(&shared->progress);
+        }
+        atomic_store(&shared->busy[index], 0);
+    }
+    free(accumulators);
+}
+
+int process_pool_init(ProcessPool* pool, Scene* scene, const Camera* camera, const RenderSettings* settings,
+                      double frame_rate, int worker_count) {
+    memset(pool, 0, sizeof(*pool));
+    pool->scene = scene;
+    pool->camera = *camera;
+    pool->settings = *settings;
+    pool->frame_rate = frame_rate;
+
+    if (!tile_scheduler_init(&pool->layout, settings->width, settings->height, settings->tile_size, 1)) {
+        fprintf(stderr, "Error: Could not allocate tile scheduler\n");
+        return 0;
+    }
+
+    pool->shared_size = process_pool_framebuffer_offset(pool->layout.tile_count) +
+                        (size_t)settings->width * settings->height * sizeof(Vector3);
+    void* shared = mmap(NULL, pool->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map the shared framebuffer\n");
+        tile_scheduler_destroy(&pool->layout);
+        return 0;
+    }
+    pool->shared = (ProcessPoolShared*)shared;
+    if (sem_init(&pool->shared->start, 1, 0) != 0 || sem_init(&pool->shared->progress, 1, 0) != 0) {
+        fprintf(stderr, "Error: Could not create process-shared semaphores\n");
+        munmap(shared, pool->shared_size);
+        pool->shared = NULL;
+        tile_scheduler_destroy(&pool->layout);
+        return 0;
+    }
+
+    pid_t parent = getpid();
+    for (int i = 0; i < worker_count && i < PROCESS_POOL_MAX_WORKERS; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Error: Could not start worker process %d\n", i);
+            process_pool_finish(pool);
+            return 0;
+        }
+        if (pid == 0) {
+            process_pool_worker(pool, i, parent);
+            _exit(0);
+        }
+        pool->workers[i] = pid;
+        pool->worker_count = i + 1;
+    }
+    return 1;
+}
+
+// Reap exited workers and count the ones still running
+static int process_pool_live_workers(ProcessPool* pool) {
+    int live = 0;
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pool->workers[i] <= 0) continue;
+        int status;
+        if (waitpid(pool->workers[i], &status, WNOHANG) == 0) {
+            live++;
+            continue;
+        }
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "\nWorker %d was killed by signal %d\n", i, WTERMSIG(status));
+        } else {
+            fprintf(stderr, "\nWorker %d exited with status %d\n", i, WEXITSTATUS(status));
+        }
+        pool->workers[i] = 0;
+    }
+    return live;
+}
+
+// Whether every tile of the frame has been claimed and no running worker
+// is still rendering one
+static int process_pool_idle(ProcessPool* pool, uint32_t generation) {
+    uint64_t claim = atomic_load(&pool->shared->next_tile);
+    if ((uint32_t)(claim >> 32) == generation && (int)(uint32_t)claim < pool->layout.tile_count) {
+        return 0;
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pool->workers[i] > 0 && atomic_load(&pool->shared->busy[i])) return 0;
+    }
+    return 1;
+}
+
+// Tiles whose pixels are in the framebuffer. tiles_done only tracks
+// progress: a worker can die between setting a tile's flag and counting it.
+static int process_pool_tiles_finished(ProcessPool* pool) {
+    _Atomic int* tile_flags = process_pool_tile_flags(pool);
+    int finished = 0;
+    for (int t = 0; t < pool->layout.tile_count; t++) {
+        finished += atomic_load(&tile_flags[t]) != 0;
+    }
+    return finished;
+}
+
+int process_pool_render_frame(ProcessPool* pool, Vector3* pixels, RenderStats* stats) {
+    ProcessPoolShared* shared = pool->shared;
+    const int tile_count = pool->layout.tile_count;
+    _Atomic int* tile_flags = process_pool_tile_flags(pool);
+
+    for (int t = 0; t < tile_count; t++) {
+        atomic_store(&tile_flags[t], 0);
+    }
+    atomic_store(&shared->tiles_done, 0);
+    atomic_store(&shared->paths, 0);
+
+    // Workers read the frame only after claiming a tile of the new generation
+    uint32_t generation = atomic_load(&shared->generation) + 1;
+    atomic_store(&shared->frame, pool->scene->animation_state.current_frame);
+    atomic_store(&shared->generation, generation);
+    atomic_store(&shared->next_tile, (uint64_t)generation << 32);
+    int live = process_pool_live_workers(pool);
+    for (int i = 0; i < live; i++) {
+        sem_post(&shared->start);
+    }
+
+    PixelAccumulator* accumulators = NULL;  // Only for tiles the pool renders itself
+    int ok = 1;
+    while (atomic_load(&shared->tiles_done) < tile_count) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&shared->progress, &deadline);
+        fprintf(stderr, "\rTiles remaining: %d ", tile_count - atomic_load(&shared->tiles_done));
+
+        live = process_pool_live_workers(pool);
+        if (live > 0 && !process_pool_idle(pool, generation)) continue;
+        int finished = process_pool_tiles_finished(pool);
+        if (finished == tile_count) break;
+
+        // Whatever is left was claimed by a worker that died, or has no
+        // worker left to claim it. This process's scene view is posed for
+        // the frame already.
+        if (!accumulators) {
+            int tile_size = pool->settings.tile_size;
+            accumulators = (PixelAccumulator*)malloc((size_t)tile_size * tile_size * sizeof(PixelAccumulator));
+            if (!accumulators) {
+                fprintf(stderr, "Error: Could not allocate tile buffer\n");
+                ok = 0;
+                break;
+            }
+        }
+        fprintf(stderr, "\nRendering %d tiles left by exited workers\n", tile_count - finished);
+        int tile;
+        while ((tile = process_pool_claim(shared, generation, tile_count)) >= 0) {
+            process_pool_render_tile(pool, tile, accumulators);
+        }
+        for (tile = 0; tile < tile_count; tile++) {
+            if (!atomic_load(&tile_flags[tile])) {
+                process_pool_render_tile(pool, tile, accumulators);
+            }
+        }
+        if (process_pool_tiles_finished(pool) == tile_count) break;
+    }
+    free(accumulators);
+
+    if (ok) {
+        memcpy(pixels, process_pool_framebuffer(pool),
+               (size_t)pool->settings.width * pool->settings.height * sizeof(Vector3));
+    }
+    if (stats) {
+        stats->paths = atomic_load(&shared->paths);
+    }
+    return ok;
+}
+
+void process_pool_finish(ProcessPool* pool) {
+    if (!pool->shared) return;
+
+    atomic_store(&pool->shared->frame, PROCESS_POOL_EXIT);
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pool->workers[i] > 0) sem_post(&pool->shared->start);
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pool->workers[i] > 0) waitpid(pool->workers[i], NULL, 0);
+        pool->workers[i] = 0;
+    }
+    pool->worker_count = 0;
+
+    sem_destroy(&pool->shared->start);
+    sem_destroy(&pool->shared->progress);
+    munmap(pool->shared, pool->shared_size);
+    pool->shared = NULL;
+    tile_scheduler_destroy(&pool->layout);
+}
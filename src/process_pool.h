@@ -0,0 +1,44 @@
+#ifndef PROCESS_POOL_H
+#define PROCESS_POOL_H
+
+#include "render.h"
+#include <sys/types.h>
+
+// Multi-process rendering on one host. Worker processes are forked from a
+// view of a shared scene image (see scene_image.h), so they share its pages,
+// and render into one shared-memory framebuffer. Each claims its next tile
+// from an atomic counter in the shared segment. A worker that dies only
+// costs its unfinished tile, which the pool renders itself once the other
+// workers have run out of tiles.
+
+#define PROCESS_POOL_MAX_WORKERS 256
+
+typedef struct ProcessPoolShared ProcessPoolShared;
+
+typedef struct {
+    ProcessPoolShared* shared;  // Control block, tile flags and framebuffer
+    size_t shared_size;
+    TileScheduler layout;       // Tile rectangles, claimed in index order
+    pid_t workers[PROCESS_POOL_MAX_WORKERS];  // 0 once a worker has exited
+    int worker_count;
+    Scene* scene;
+    Camera camera;
+    RenderSettings settings;
+    double frame_rate;
+} ProcessPool;
+
+// Map the shared segment and fork worker_count workers rendering scene, a
+// view of a scene image. Call before starting any threads. Returns 0 on
+// failure.
+int process_pool_init(ProcessPool* pool, Scene* scene, const Camera* camera, const RenderSettings* settings,
+                      double frame_rate, int worker_count);
+
+// Render the scene's current frame through the workers into pixels
+// (width * height, row 0 at the top). Fills stats when given. Returns 0 on
+// failure.
+int process_pool_render_frame(ProcessPool* pool, Vector3* pixels, RenderStats* stats);
+
+// Stop the workers and unmap the shared segment
+void process_pool_finish(ProcessPool* pool);
+
+#endif
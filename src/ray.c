@@ -1,4 +1,5 @@
 #include "ray.h"
+#include <math.h>
 
 Ray ray_create(Vector3 origin, Vector3 direction) {
     Ray r = {
@@ -13,3 +14,8 @@ Ray ray_create(Vector3 origin, Vector3 direction) {
 Vector3 ray_point_at(Ray r, double t) {
     return vector_add(r.origin, vector_multiply(r.direction, t));
 }
+
+double ray_t_min(Vector3 origin) {
+    double extent = fmax(fabs(origin.x), fmax(fabs(origin.y), fabs(origin.z)));
+    return fmax(RAY_T_MIN, RAY_T_MIN_ULPS * VECTOR_REAL_EPSILON * extent);
+}
@@ -10,7 +10,18 @@ typedef struct {
     double time;              // Time parameter for motion blur
 } Ray;
 
+// Fixed self-intersection offset, and the floor of ray_t_min
+#define RAY_T_MIN 0.001
+// Rounding error allowance, in units of the component epsilon, for positions
+// a ray starts from
+#define RAY_T_MIN_ULPS 128.0
+
 Ray ray_create(Vector3 origin, Vector3 direction);
 Vector3 ray_point_at(Ray r, double t);
 
+// Smallest hit distance accepted for a ray leaving origin. The offset grows
+// with the origin's magnitude once a fixed RAY_T_MIN falls below the rounding
+// error of the position, which float builds reach within a few hundred units.
+double ray_t_min(Vector3 origin);
+
 #endif
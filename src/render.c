@@ -0,0 +1,492 @@
+#include "render.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+Camera camera_create(Vector3 position, double viewport_height, double aspect_ratio, double focal_length) {
+    double viewport_width = viewport_height * aspect_ratio;
+
+    Camera camera;
+    camera.origin = position;
+    camera.horizontal = vector_create(viewport_width, 0, 0);
+    camera.vertical = vector_create(0, viewport_height, 0);
+    camera.lower_left_corner = vector_subtract(
+        vector_subtract(
+            vector_subtract(position, vector_divide(camera.horizontal, 2.0)),
+            vector_divide(camera.vertical, 2.0)
+        ),
+        vector_create(0, 0, focal_length)
+    );
+    return camera;
+}
+
+RenderSettings render_settings_default(int width, int height) {
+    RenderSettings settings = {
+        .width = width,
+        .height = height,
+        .tile_size = DEFAULT_TILE_SIZE,
+        .thread_count = render_default_thread_count(),
+        .samples_per_pixel = 4,  // Reduced samples for better performance
+        .packet_size = DEFAULT_PACKET_SIZE,
+        .min_samples = DEFAULT_MIN_SAMPLES,
+        .adaptive_threshold = 0.0
+    };
+    return settings;
+}
+
+int render_default_thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Shared state for all workers rendering one frame
+typedef struct {
+    Scene* scene;
+    const Camera* camera;
+    const RenderSettings* settings;
+    PixelAccumulator* accumulators;
+    int origin_x, origin_y;  // Image position of accumulators[0]
+    int stride;              // Accumulators per row
+    int sample_end;  // Samples each pixel is brought up to
+    TileScheduler* scheduler;
+    atomic_int tiles_done;
+    atomic_llong paths;
+} FrameJob;
+
+typedef struct {
+    FrameJob* job;
+    int worker;
+} WorkerArgs;
+
+// Camera ray through pixel (x, y) for motion sample m, jittered by the
+// path's own sampler
+static Ray render_camera_ray(const FrameJob* job, int x, int y, int m, Sampler* sampler) {
+    const Camera* camera = job->camera;
+    const RenderSettings* settings = job->settings;
+    int j = settings->height - 1 - y;  // Camera space counts scanlines from the bottom
+
+    double u = ((double)x + sampler_next_double(sampler)) / (settings->width - 1);
+    double v = ((double)j + sampler_next_double(sampler)) / (settings->height - 1);
+
+    Vector3 direction = vector_subtract(
+        vector_add(
+            vector_add(camera->lower_left_corner,
+                vector_multiply(camera->horizontal, u)),
+            vector_multiply(camera->vertical, v)
+        ),
+        camera->origin
+    );
+
+    Ray ray = ray_create(camera->origin, direction);
+    // Motion blur times come from the scene's sample grid, which
+    // animated mesh instances are posed for
+    ray.time = scene_motion_sample_time(job->scene, m);
+    return ray;
+}
+
+// Each path owns its random sequence, keyed by where and when it is traced
+static void render_sampler_init(const FrameJob* job, Sampler* sampler, int x, int y, int s, int m) {
+    uint32_t pixel = (uint32_t)(y * job->settings->width + x);
+    int motion_samples = scene_motion_samples(job->scene);
+    sampler_init(sampler, (uint32_t)job->scene->animation_state.current_frame, pixel,
+                 (uint32_t)(s * motion_samples + m));
+}
+
+// Add one sample, the sum of its motion_samples paths, to the pixel's
+// luminance moments. Channels are clamped as they are when the image is
+// written, since error above white never shows.
+static void pixel_accumulator_add_sample(PixelAccumulator* pixel, Vector3 sample, int motion_samples) {
+    double luminance = (0.2126 * fmin(1.0, fmax(0.0, sample.x / motion_samples)) +
+                        0.7152 * fmin(1.0, fmax(0.0, sample.y / motion_samples)) +
+                        0.0722 * fmin(1.0, fmax(0.0, sample.z / motion_samples)));
+    pixel->luminance_sum += luminance;
+    pixel->luminance_squares += luminance * luminance;
+    pixel->samples++;
+}
+
+// Whether a pixel's mean is known well enough to stop sampling it
+static int pixel_accumulator_converged(const PixelAccumulator* pixel, const RenderSettings* settings) {
+    int n = pixel->samples;
+    if (settings->adaptive_threshold <= 0.0 || n < settings->min_samples || n < 2) return 0;
+    double mean = pixel->luminance_sum / n;
+    double variance = fmax(0.0, (pixel->luminance_squares - pixel->luminance_sum * mean) / (n - 1));
+    return sqrt(variance / n) <= settings->adaptive_threshold;
+}
+
+static PixelAccumulator* frame_job_accumulator(const FrameJob* job, int x, int y) {
+    return &job->accumulators[(y - job->origin_y) * job->stride + (x - job->origin_x)];
+}
+
+// Bring one pixel up to the job's sample count, returning the samples taken
+static int render_pixel(const FrameJob* job, int x, int y) {
+    Scene* scene = job->scene;
+    PixelAccumulator* pixel = frame_job_accumulator(job, x, y);
+    const int motion_samples = scene_motion_samples(scene);
+    int taken = 0;
+
+    // Anti-aliasing and motion blur sampling
+    while (pixel->samples < job->sample_end && !pixel_accumulator_converged(pixel, job->settings)) {
+        Vector3 sample = vector_create(0, 0, 0);
+        for (int m = 0; m < motion_samples; m++) {
+            Sampler sampler;
+            render_sampler_init(job, &sampler, x, y, pixel->samples, m);
+            Ray ray = render_camera_ray(job, x, y, m, &sampler);
+            Vector3 path = scene_trace(scene, ray, MAX_DEPTH, &sampler);
+            pixel->sum = vector_add(pixel->sum, path);
+            sample = vector_add(sample, path);
+        }
+        pixel_accumulator_add_sample(pixel, sample, motion_samples);
+        taken++;
+    }
+    return taken;
+}
+
+// Sample a block of pixels by tracing, for each sample, the camera rays of
+// all its pixels still sampling as one packet. Every pixel sums its samples
+// in the same order as render_pixel, so both paths produce identical images.
+// Returns the number of pixel samples taken.
+static int render_block(const FrameJob* job, int x0, int y0, int x1, int y1) {
+    Scene* scene = job->scene;
+    const RenderSettings* settings = job->settings;
+    const int motion_samples = scene_motion_samples(scene);
+    const int width = x1 - x0;
+
+    PixelAccumulator* pixels[BVH_PACKET_MAX];
+    Vector3 samples[BVH_PACKET_MAX];
+    int active[BVH_PACKET_MAX];  // Block indices of pixels taking the current sample
+    Vector3 colors[BVH_PACKET_MAX];
+    Sampler samplers[BVH_PACKET_MAX];
+    Ray rays[BVH_PACKET_MAX];
+    int count = width * (y1 - y0);
+    int taken = 0;
+
+    // Resumed pixels may start at different samples; each joins the packets
+    // from its own next sample on
+    int first_sample = job->sample_end;
+    for (int i = 0; i < count; i++) {
+        pixels[i] = frame_job_accumulator(job, x0 + i % width, y0 + i / width);
+        if (pixels[i]->samples < first_sample) first_sample = pixels[i]->samples;
+    }
+
+    for (int s = first_sample; s < job->sample_end; s++) {
+        int active_count = 0;
+        for (int i = 0; i < count; i++) {
+            if (pixels[i]->samples == s && !pixel_accumulator_converged(pixels[i], settings)) {
+                samples[i] = vector_create(0, 0, 0);
+                active[active_count++] = i;
+            }
+        }
+        if (active_count == 0) continue;
+
+        for (int m = 0; m < motion_samples; m++) {
+            for (int a = 0; a < active_count; a++) {
+                int x = x0 + active[a] % width;
+                int y = y0 + active[a] / width;
+                render_sampler_init(job, &samplers[a], x, y, s, m);
+                rays[a] = render_camera_ray(job, x, y, m, &samplers[a]);
+            }
+
+            scene_trace_packet(scene, rays, active_count, samplers, colors);
+            for (int a = 0; a < active_count; a++) {
+                PixelAccumulator* pixel = pixels[active[a]];
+                pixel->sum = vector_add(pixel->sum, colors[a]);
+                samples[active[a]] = vector_add(samples[active[a]], colors[a]);
+            }
+        }
+
+        for (int a = 0; a < active_count; a++) {
+            pixel_accumulator_add_sample(pixels[active[a]], samples[active[a]], motion_samples);
+        }
+        taken += active_count;
+    }
+    return taken;
+}
+
+static void render_tile(FrameJob* job, const Tile* tile) {
+    int packet = job->settings->packet_size;
+    long long samples = 0;
+
+    // Tiles are disjoint, so each pixel has exactly one writer
+    if (packet > 0 && packet * packet <= BVH_PACKET_MAX) {
+        for (int y = tile->y0; y < tile->y1; y += packet) {
+            for (int x = tile->x0; x < tile->x1; x += packet) {
+                int x1 = x + packet < tile->x1 ? x + packet : tile->x1;
+                int y1 = y + packet < tile->y1 ? y + packet : tile->y1;
+                samples += render_block(job, x, y, x1, y1);
+            }
+        }
+    } else {
+        for (int y = tile->y0; y < tile->y1; y++) {
+            for (int x = tile->x0; x < tile->x1; x++) {
+                samples += render_pixel(job, x, y);
+            }
+        }
+    }
+
+    atomic_fetch_add(&job->paths, samples * scene_motion_samples(job->scene));
+}
+
+static void* render_worker(void* arg) {
+    WorkerArgs* args = (WorkerArgs*)arg;
+    FrameJob* job = args->job;
+
+    int index;
+    while ((index = tile_scheduler_next(job->scheduler, args->worker)) >= 0) {
+        render_tile(job, &job->scheduler->tiles[index]);
+
+        int done = atomic_fetch_add(&job->tiles_done, 1) + 1;
+        if (args->worker == 0 || done == job->scheduler->tile_count) {
+            fprintf(stderr, "\rTiles remaining: %d ", job->scheduler->tile_count - done);
+        }
+    }
+    return NULL;
+}
+
+int render_pass(Scene* scene, const Camera* camera, const RenderSettings* settings,
+                PixelAccumulator* accumulators, int sample_end, RenderStats* stats) {
+    int thread_count = settings->thread_count > 0 ? settings->thread_count : 1;
+
+    TileScheduler scheduler;
+    if (!tile_scheduler_init(&scheduler, settings->width, settings->height,
+                             settings->tile_size, thread_count)) {
+        fprintf(stderr, "Error: Could not allocate tile scheduler\n");
+        return 0;
+    }
+
+    FrameJob job = {
+        .scene = scene,
+        .camera = camera,
+        .settings = settings,
+        .accumulators = accumulators,
+        .stride = settings->width,
+        .sample_end = sample_end,
+        .scheduler = &scheduler
+    };
+    atomic_init(&job.tiles_done, 0);
+    atomic_init(&job.paths, 0);
+
+    pthread_t* threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+    WorkerArgs* args = (WorkerArgs*)malloc(thread_count * sizeof(WorkerArgs));
+    if (!threads || !args) {
+        fprintf(stderr, "Error: Could not allocate render workers\n");
+        free(threads);
+        free(args);
+        tile_scheduler_destroy(&scheduler);
+        return 0;
+    }
+
+    // The calling thread doubles as worker 0
+    int started = 1;
+    for (int w = 0; w < thread_count; w++) {
+        args[w].job = &job;
+        args[w].worker = w;
+    }
+    for (int w = 1; w < thread_count; w++) {
+        if (pthread_create(&threads[w], NULL, render_worker, &args[w]) != 0) {
+            fprintf(stderr, "Warning: Could only start %d render threads\n", started);
+            break;
+        }
+        started++;
+    }
+
+    // Workers that failed to start simply have their tiles stolen
+    render_worker(&args[0]);
+
+    for (int w = 1; w < started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+
+    free(threads);
+    free(args);
+    tile_scheduler_destroy(&scheduler);
+    if (stats) {
+        stats->paths = atomic_load(&job.paths);
+    }
+    return 1;
+}
+
+void render_resolve(const Scene* scene, const RenderSettings* settings,
+                    const PixelAccumulator* accumulators, Vector3* pixels) {
+    const int motion_samples = scene_motion_samples(scene);
+    for (int i = 0; i < settings->width * settings->height; i++) {
+        // Average the color samples (including motion blur samples)
+        pixels[i] = pixel_accumulator_resolve(&accumulators[i], motion_samples);
+    }
+}
+
+Vector3 pixel_accumulator_resolve(const PixelAccumulator* pixel, int motion_samples) {
+    return pixel->samples > 0
+        ? vector_divide(pixel->sum, pixel->samples * motion_samples)
+        : vector_create(0, 0, 0);
+}
+
+int render_tile_pass(Scene* scene, const Camera* camera, const RenderSettings* settings, const Tile* tile,
+                     PixelAccumulator* accumulators, int sample_end, RenderStats* stats) {
+    FrameJob job = {
+        .scene = scene,
+        .camera = camera,
+        .settings = settings,
+        .accumulators = accumulators,
+        .origin_x = tile->x0,
+        .origin_y = tile->y0,
+        .stride = tile->x1 - tile->x0,
+        .sample_end = sample_end
+    };
+    atomic_init(&job.tiles_done, 0);
+    atomic_init(&job.paths, 0);
+
+    render_tile(&job, tile);
+    if (stats) {
+        stats->paths = atomic_load(&job.paths);
+    }
+    return 1;
+}
+
+int render_frame(Scene* scene, const Camera* camera, const RenderSettings* settings, Vector3* pixels,
+                 RenderStats* stats) {
+    size_t count = (size_t)settings->width * settings->height;
+    PixelAccumulator* accumulators = (PixelAccumulator*)calloc(count, sizeof(PixelAccumulator));
+    if (!accumulators) {
+        fprintf(stderr, "Error: Could not allocate accumulation buffer\n");
+        return 0;
+    }
+
+    int ok = render_pass(scene, camera, settings, accumulators, settings->samples_per_pixel, stats);
+    if (ok) {
+        render_resolve(scene, settings, accumulators, pixels);
+    }
+    free(accumulators);
+    return ok;
+}
+
+#define CHECKPOINT_MAGIC "RTCP"
+#define CHECKPOINT_VERSION 2
+
+// Checkpoint files are a RenderCheckpointHeader followed by one
+// CheckpointPixel per pixel, row 0 first. Sums are stored as doubles in
+// every build.
+typedef struct {
+    char magic[4];
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t frame;
+    int32_t motion_samples;
+    // What the samples were drawn from; only the sample budget may change
+    // when a checkpoint is resumed
+    int32_t min_samples;
+    int32_t precision;
+    uint64_t scene_hash;
+    double adaptive_threshold;
+} RenderCheckpointHeader;
+
+typedef struct {
+    double sum[3];
+    double luminance_sum;
+    double luminance_squares;
+    int32_t samples;
+    int32_t reserved;
+} CheckpointPixel;
+
+int render_checkpoint_save(const char* filename, const Scene* scene, const RenderSettings* settings,
+                           const PixelAccumulator* accumulators) {
+    // Write beside the old checkpoint and swap it in, so a job killed
+    // mid-write still leaves the previous checkpoint intact
+    char temp_filename[1024];
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+    FILE* fp = fopen(temp_filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open checkpoint file for writing: %s\n", temp_filename);
+        return 0;
+    }
+
+    RenderCheckpointHeader header = {
+        .version = CHECKPOINT_VERSION,
+        .width = settings->width,
+        .height = settings->height,
+        .frame = scene->animation_state.current_frame,
+        .motion_samples = scene_motion_samples(scene),
+        .min_samples = settings->min_samples,
+        .precision = vector_get_precision_mode(),
+        .scene_hash = scene_hash(scene),
+        .adaptive_threshold = settings->adaptive_threshold
+    };
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int i = 0; ok && i < settings->width * settings->height; i++) {
+        const PixelAccumulator* pixel = &accumulators[i];
+        CheckpointPixel record = {
+            .sum = {pixel->sum.x, pixel->sum.y, pixel->sum.z},
+            .luminance_sum = pixel->luminance_sum,
+            .luminance_squares = pixel->luminance_squares,
+            .samples = pixel->samples
+        };
+        ok = fwrite(&record, sizeof(record), 1, fp) == 1;
+    }
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(temp_filename, filename) != 0) {
+        fprintf(stderr, "Error: Could not write checkpoint file: %s\n", filename);
+        remove(temp_filename);
+        return 0;
+    }
+    return 1;
+}
+
+int render_checkpoint_load(const char* filename, const Scene* scene, const RenderSettings* settings,
+                           PixelAccumulator* accumulators) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open checkpoint file: %s\n", filename);
+        return 0;
+    }
+
+    RenderCheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 ||
+        header.version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "Error: %s is not a render checkpoint\n", filename);
+        fclose(fp);
+        return 0;
+    }
+
+    // Samples only combine with more of the same frame's samples
+    if (header.width != settings->width || header.height != settings->height ||
+        header.frame != scene->animation_state.current_frame ||
+        header.motion_samples != scene_motion_samples(scene)) {
+        fprintf(stderr, "Error: Checkpoint %s is for a %dx%d render of frame %d with %d motion samples\n",
+                filename, header.width, header.height, header.frame, header.motion_samples);
+        fclose(fp);
+        return 0;
+    }
+    if (header.scene_hash != scene_hash(scene) || header.precision != (int32_t)vector_get_precision_mode()) {
+        fprintf(stderr, "Error: Checkpoint %s is for another scene or build\n", filename);
+        fclose(fp);
+        return 0;
+    }
+    if (header.min_samples != settings->min_samples || header.adaptive_threshold != settings->adaptive_threshold) {
+        fprintf(stderr, "Error: Checkpoint %s was sampled with --min-samples %d and --adaptive %g\n",
+                filename, header.min_samples, header.adaptive_threshold);
+        fclose(fp);
+        return 0;
+    }
+
+    for (int i = 0; i < settings->width * settings->height; i++) {
+        CheckpointPixel record;
+        if (fread(&record, sizeof(record), 1, fp) != 1 || record.samples < 0) {
+            fprintf(stderr, "Error: Truncated checkpoint file: %s\n", filename);
+            fclose(fp);
+            return 0;
+        }
+        accumulators[i].sum = vector_create(record.sum[0], record.sum[1], record.sum[2]);
+        accumulators[i].luminance_sum = record.luminance_sum;
+        accumulators[i].luminance_squares = record.luminance_squares;
+        accumulators[i].samples = record.samples;
+    }
+    fclose(fp);
+    return 1;
+}
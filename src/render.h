@@ -0,0 +1,87 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "scene.h"
+#include "tile_scheduler.h"
+
+#define DEFAULT_PACKET_SIZE 8
+#define DEFAULT_MIN_SAMPLES 3  // Fewest samples an adaptive pixel's variance is judged on
+
+// Pinhole camera description used to generate primary rays
+typedef struct {
+    Vector3 origin;
+    Vector3 lower_left_corner;
+    Vector3 horizontal;
+    Vector3 vertical;
+} Camera;
+
+// Frame-independent render configuration
+typedef struct {
+    int width;
+    int height;
+    int tile_size;
+    int thread_count;
+    int samples_per_pixel;  // Sample budget per pixel, each traced at every motion sample time
+    int packet_size;  // Side of the pixel blocks traced as primary ray packets; 0 traces single rays
+    // Adaptive sampling: once a pixel has min_samples samples, it stops as soon
+    // as the standard error of its luminance falls to adaptive_threshold.
+    // A threshold of 0 spends the full budget on every pixel.
+    int min_samples;
+    double adaptive_threshold;
+} RenderSettings;
+
+// Running sums of one pixel's samples. A frame accumulates into one of these
+// per pixel, so its sampling can be spread over passes, checkpointed and
+// resumed.
+typedef struct {
+    Vector3 sum;               // All paths traced through the pixel, added in sample order
+    double luminance_sum;      // Moments of the per-sample luminance, for adaptive sampling
+    double luminance_squares;
+    int samples;               // Samples taken; each traces every motion sample time
+} PixelAccumulator;
+
+// Work done by render_frame or render_pass
+typedef struct {
+    long long paths;  // Camera paths traced, over all pixels and motion samples
+} RenderStats;
+
+Camera camera_create(Vector3 position, double viewport_height, double aspect_ratio, double focal_length);
+
+RenderSettings render_settings_default(int width, int height);
+int render_default_thread_count(void);
+
+// Render one frame of the scene at its current animation time into pixels
+// (width * height, row 0 at the top). Tiles are distributed over
+// settings->thread_count workers. Fills stats when given. Returns 0 on failure.
+int render_frame(Scene* scene, const Camera* camera, const RenderSettings* settings, Vector3* pixels,
+                 RenderStats* stats);
+
+// Progressive rendering. render_pass brings every pixel of accumulators
+// (width * height, zeroed for a fresh frame) up to sample_end samples, or
+// until it converges, and render_resolve averages them into pixels. A frame
+// rendered over several passes matches one rendered by render_frame with the
+// final sample count.
+int render_pass(Scene* scene, const Camera* camera, const RenderSettings* settings,
+                PixelAccumulator* accumulators, int sample_end, RenderStats* stats);
+void render_resolve(const Scene* scene, const RenderSettings* settings,
+                    const PixelAccumulator* accumulators, Vector3* pixels);
+// Final color of one pixel
+Vector3 pixel_accumulator_resolve(const PixelAccumulator* pixel, int motion_samples);
+
+// Sample one tile on the calling thread, for distributed and process pool workers.
+// accumulators covers just the tile, row by row. Pixels match those of a
+// whole-frame render_pass.
+int render_tile_pass(Scene* scene, const Camera* camera, const RenderSettings* settings, const Tile* tile,
+                     PixelAccumulator* accumulators, int sample_end, RenderStats* stats);
+
+// Save or restore a frame's accumulators. Saving replaces filename only once
+// the new checkpoint is complete. Loading fails for a checkpoint of another
+// scene, frame, resolution, motion sample count, precision or adaptive
+// sampling setting; only the sample budget may differ. Both return 0 on
+// failure.
+int render_checkpoint_save(const char* filename, const Scene* scene, const RenderSettings* settings,
+                           const PixelAccumulator* accumulators);
+int render_checkpoint_load(const char* filename, const Scene* scene, const RenderSettings* settings,
+                           PixelAccumulator* accumulators);
+
+#endif
@@ -0,0 +1,20 @@
+#include "sampler.h"
+
+// SplitMix64 finalizer, used to scatter structured seeds across the state space
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void sampler_init(Sampler* sampler, uint32_t frame, uint32_t pixel, uint32_t sample_index) {
+    uint64_t key = mix64(((uint64_t)frame << 32) | pixel);
+    uint64_t seed = mix64(key ^ (0x9E3779B97F4A7C15ULL * ((uint64_t)sample_index + 1)));
+
+    // Standard PCG32 seeding: pick a stream, then advance once past the seed
+    sampler->state = 0;
+    sampler->increment = (mix64(seed) << 1) | 1u;
+    sampler_next_u32(sampler);
+    sampler->state += seed;
+    sampler_next_u32(sampler);
+}
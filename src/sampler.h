@@ -0,0 +1,29 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+
+// Per-path random number state (PCG32). A sampler is seeded from the
+// (frame, pixel, sample) it belongs to, so every path draws the same numbers
+// regardless of which thread renders it or in what order tiles complete.
+typedef struct {
+    uint64_t state;
+    uint64_t increment;
+} Sampler;
+
+void sampler_init(Sampler* sampler, uint32_t frame, uint32_t pixel, uint32_t sample_index);
+
+static inline uint32_t sampler_next_u32(Sampler* sampler) {
+    uint64_t old = sampler->state;
+    sampler->state = old * 6364136223846793005ULL + sampler->increment;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Uniform double in [0, 1)
+static inline double sampler_next_double(Sampler* sampler) {
+    return sampler_next_u32(sampler) * 2.3283064365386963e-10;
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -13,30 +14,44 @@ Texture* scene_load_normal_map(Scene* scene, const char* filename) {
 
 void scene_free_textures(Scene* scene) {
     for (int i = 0; i < scene->texture_count; i++) {
-        if (scene->textures[i].data) {
-            stbi_image_free(scene->textures[i].data);
+        if (scene->textures[i]->data) {
+            stbi_image_free(scene->textures[i]->data);
+            scene->textures[i]->data = NULL;
         }
     }
     scene->texture_count = 0;
     
     if (scene->environment_map && scene->environment_map->data) {
         stbi_image_free(scene->environment_map->data);
+        free(scene->environment_map);
         scene->environment_map = NULL;
     }
 }
 
 Texture* scene_load_texture(Scene* scene, const char* filename, int type) {
-    if (scene->texture_count >= MAX_TEXTURES) return NULL;
-    
-    Texture* tex = &scene->textures[scene->texture_count];
-    tex->data = stbi_load(filename, &tex->width, &tex->height, &tex->channels, 3);
-    tex->type = type;
-    
-    if (tex->data) {
-        scene->texture_count++;
-        return tex;
+    if (scene->texture_count == scene->texture_capacity) {
+        int capacity = scene->texture_capacity > 0 ? 2 * scene->texture_capacity : 8;
+        Texture** textures = (Texture**)arena_grow(&scene->arena, scene->textures,
+                                                   scene->texture_count * sizeof(Texture*),
+                                                   capacity * sizeof(Texture*));
+        if (!textures) return NULL;
+        scene->textures = textures;
+        scene->texture_capacity = capacity;
     }
-    return NULL;
+
+    Texture tex;
+    tex.data = stbi_load(filename, &tex.width, &tex.height, &tex.channels, 3);
+    tex.type = type;
+    if (!tex.data) return NULL;
+
+    Texture* stored = (Texture*)arena_alloc(&scene->arena, sizeof(Texture));
+    if (!stored) {
+        stbi_image_free(tex.data);
+        return NULL;
+    }
+    *stored = tex;
+    scene->textures[scene->texture_count++] = stored;
+    return stored;
 }
 
 Texture* scene_load_environment_map(Scene* scene, const char* filename) {
@@ -99,108 +114,823 @@ Scene scene_create() {
         .animation_state = animation_state_create(30.0),  // Default 30 FPS
         .motion_blur_intensity = 0.5  // Default motion blur intensity
     };
-    
-    // Initialize animation tracks
-    for (int i = 0; i < MAX_SPHERES; i++) {
-        scene.sphere_animations[i] = NULL;
+
+    // Blocks are only allocated on first use, so returning by value is safe
+    arena_init(&scene.arena, ARENA_DEFAULT_BLOCK_SIZE);
+    return scene;
+}
+
+// Each container grows to at least the requested capacity, together with its
+// parallel arrays. New slots are zeroed, so animation tracks start out NULL.
+static int scene_grow_spheres(Scene* scene, int capacity) {
+    if (capacity <= scene->sphere_capacity) return 1;
+    Sphere* spheres = (Sphere*)arena_grow(&scene->arena, scene->spheres,
+                                          scene->sphere_count * sizeof(Sphere), capacity * sizeof(Sphere));
+    AnimationTrack** animations = (AnimationTrack**)arena_grow(&scene->arena, scene->sphere_animations,
+                                                               scene->sphere_count * sizeof(AnimationTrack*),
+                                                               capacity * sizeof(AnimationTrack*));
+    Vector3 (*centers)[MOTION_BLUR_SAMPLES] = arena_grow(
+        &scene->arena, scene->sphere_centers,
+        scene->sphere_count * sizeof(*scene->sphere_centers), capacity * sizeof(*scene->sphere_centers));
+    if (!spheres || !animations || !centers) {
+        fprintf(stderr, "Error: Could not allocate room for %d spheres\n", capacity);
+        return 0;
     }
-    for (int i = 0; i < MAX_MESHES; i++) {
-        scene.mesh_animations[i] = NULL;
+    scene->spheres = spheres;
+    scene->sphere_animations = animations;
+    scene->sphere_centers = centers;
+    scene->sphere_capacity = capacity;
+    return 1;
+}
+
+static int scene_grow_meshes(Scene* scene, int capacity) {
+    if (capacity <= scene->mesh_capacity) return 1;
+    Mesh* meshes = (Mesh*)arena_grow(&scene->arena, scene->meshes,
+                                     scene->mesh_count * sizeof(Mesh), capacity * sizeof(Mesh));
+    AnimationTrack** animations = (AnimationTrack**)arena_grow(&scene->arena, scene->mesh_animations,
+                                                               scene->mesh_count * sizeof(AnimationTrack*),
+                                                               capacity * sizeof(AnimationTrack*));
+    MeshTransform (*instances)[MOTION_BLUR_SAMPLES] = arena_grow(
+        &scene->arena, scene->mesh_instances,
+        scene->mesh_count * sizeof(*scene->mesh_instances), capacity * sizeof(*scene->mesh_instances));
+    if (!meshes || !animations || !instances) {
+        fprintf(stderr, "Error: Could not allocate room for %d meshes\n", capacity);
+        return 0;
     }
-    for (int i = 0; i < MAX_LIGHTS; i++) {
-        scene.light_animations[i] = NULL;
+    scene->meshes = meshes;
+    scene->mesh_animations = animations;
+    scene->mesh_instances = instances;
+    scene->mesh_capacity = capacity;
+    return 1;
+}
+
+static int scene_grow_lights(Scene* scene, int capacity) {
+    if (capacity <= scene->light_capacity) return 1;
+    Light* lights = (Light*)arena_grow(&scene->arena, scene->lights,
+                                       scene->light_count * sizeof(Light), capacity * sizeof(Light));
+    AnimationTrack** animations = (AnimationTrack**)arena_grow(&scene->arena, scene->light_animations,
+                                                               scene->light_count * sizeof(AnimationTrack*),
+                                                               capacity * sizeof(AnimationTrack*));
+    Vector3 (*positions)[MOTION_BLUR_SAMPLES] = arena_grow(
+        &scene->arena, scene->light_positions,
+        scene->light_count * sizeof(*scene->light_positions), capacity * sizeof(*scene->light_positions));
+    if (!lights || !animations || !positions) {
+        fprintf(stderr, "Error: Could not allocate room for %d lights\n", capacity);
+        return 0;
     }
-    
-    return scene;
+    scene->lights = lights;
+    scene->light_animations = animations;
+    scene->light_positions = positions;
+    scene->light_capacity = capacity;
+    return 1;
+}
+
+// Geometric growth keeps appends amortised O(1) when nothing was reserved
+static int next_capacity(int capacity) {
+    return capacity > 0 ? 2 * capacity : 8;
 }
 
-void scene_add_sphere(Scene* scene, Sphere sphere) {
-    if (scene->sphere_count < MAX_SPHERES) {
-        scene->spheres[scene->sphere_count++] = sphere;
+int scene_reserve(Scene* scene, int sphere_count, int mesh_count, int light_count) {
+    return scene_grow_spheres(scene, sphere_count) &&
+           scene_grow_meshes(scene, mesh_count) &&
+           scene_grow_lights(scene, light_count);
+}
+
+// Releases everything the scene owns, including assigned animation tracks
+void scene_destroy(Scene* scene) {
+    scene_free_bvh(scene);
+    if (!scene->mapped) {
+        for (int i = 0; i < scene->sphere_count; i++) {
+            animation_track_destroy(scene->sphere_animations[i]);
+        }
+        for (int i = 0; i < scene->mesh_count; i++) {
+            mesh_free(&scene->meshes[i]);
+            animation_track_destroy(scene->mesh_animations[i]);
+        }
+        for (int i = 0; i < scene->light_count; i++) {
+            animation_track_destroy(scene->light_animations[i]);
+        }
+        scene_free_textures(scene);
     }
+    arena_free(&scene->arena);
+
+    scene->spheres = NULL;
+    scene->meshes = NULL;
+    scene->lights = NULL;
+    scene->textures = NULL;
+    scene->sphere_animations = NULL;
+    scene->mesh_animations = NULL;
+    scene->light_animations = NULL;
+    scene->mesh_instances = NULL;
+    scene->sphere_centers = NULL;
+    scene->light_positions = NULL;
+    scene->object_bounds = NULL;
+    scene->object_end_bounds = NULL;
+    scene->sphere_count = scene->sphere_capacity = 0;
+    scene->mesh_count = scene->mesh_capacity = 0;
+    scene->light_count = scene->light_capacity = 0;
+    scene->texture_count = scene->texture_capacity = 0;
+    scene->environment_map = NULL;
+    scene->object_bounds_capacity = 0;
+    scene->sphere_batch = (SphereBatch){0};
+    scene->sphere_batch_capacity = 0;
 }
 
-void scene_add_light(Scene* scene, Light light) {
-    if (scene->light_count < MAX_LIGHTS) {
-        scene->lights[scene->light_count++] = light;
+int scene_add_sphere(Scene* scene, Sphere sphere) {
+    if (scene->sphere_count == scene->sphere_capacity &&
+        !scene_grow_spheres(scene, next_capacity(scene->sphere_capacity))) {
+        return 0;
     }
+    scene_free_bvh(scene);  // Object ids shift, so any tree is stale
+    scene->spheres[scene->sphere_count++] = sphere;
+    return 1;
 }
 
-void scene_add_mesh(Scene* scene, Mesh mesh) {
-    if (scene->mesh_count < MAX_MESHES) {
-        scene->meshes[scene->mesh_count++] = mesh;
+int scene_add_light(Scene* scene, Light light) {
+    if (scene->light_count == scene->light_capacity &&
+        !scene_grow_lights(scene, next_capacity(scene->light_capacity))) {
+        return 0;
     }
+    scene->lights[scene->light_count++] = light;
+    return 1;
 }
 
-int scene_closest_hit(Scene* scene, Ray ray, double t_min, double t_max, Hit* hit) {
-    Hit temp_hit;
-    int hit_anything = 0;
-    double closest_so_far = t_max;
+// The scene takes ownership of the mesh's triangle and vertex buffers, and
+// frees them if the mesh cannot be added
+int scene_add_mesh(Scene* scene, Mesh mesh) {
+    if (scene->mesh_count == scene->mesh_capacity &&
+        !scene_grow_meshes(scene, next_capacity(scene->mesh_capacity))) {
+        mesh_free(&mesh);
+        return 0;
+    }
+    scene_free_bvh(scene);
+    // Hand-assembled meshes get their triangle hierarchy here
+    if (mesh.bvh.node_count == 0 && mesh.triangle_count > 0) {
+        mesh_build_bvh(&mesh);
+    }
+    mesh_update_transform(&mesh);
+    scene->meshes[scene->mesh_count++] = mesh;
+    return 1;
+}
+
+double scene_shutter_half_width(const Scene* scene) {
+    // Motion samples span current_time +/- half the blurred frame step
+    if (scene->motion_blur_intensity <= 0.0) return 0.0;
+    return 0.5 * scene->motion_blur_intensity * scene->animation_state.time_step;
+}
+
+int scene_motion_samples(const Scene* scene) {
+    return scene->motion_blur_intensity > 0.0 ? MOTION_BLUR_SAMPLES : 1;
+}
+
+double scene_motion_sample_time(const Scene* scene, int sample) {
+    double time = scene->animation_state.current_time;
+    int samples = scene_motion_samples(scene);
+    if (samples > 1) {
+        time += (2.0 * sample / (samples - 1) - 1.0) * scene_shutter_half_width(scene);
+    }
+    return time;
+}
+
+uint64_t scene_hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Records are hashed field by field, so padding and pointers stay out
+static uint64_t hash_double(uint64_t hash, double value) {
+    return scene_hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_int(uint64_t hash, int value) {
+    return scene_hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_vector(uint64_t hash, Vector3 v) {
+    hash = hash_double(hash, v.x);
+    hash = hash_double(hash, v.y);
+    return hash_double(hash, v.z);
+}
+
+static uint64_t hash_texture(uint64_t hash, const Texture* texture) {
+    hash = hash_int(hash, texture != NULL);
+    if (!texture) return hash;
+    hash = hash_int(hash, texture->width);
+    hash = hash_int(hash, texture->height);
+    hash = hash_int(hash, texture->type);
+    if (texture->data) {
+        hash = scene_hash_bytes(hash, texture->data, (size_t)texture->width * texture->height * 3);
+    }
+    return hash;
+}
+
+static uint64_t hash_track(uint64_t hash, const AnimationTrack* track) {
+    hash = hash_int(hash, track != NULL);
+    if (!track) return hash;
+    hash = hash_int(hash, track->keyframe_count);
+    hash = hash_double(hash, track->duration);
+    for (int i = 0; i < track->keyframe_count; i++) {
+        const Keyframe* key = &track->keyframes[i];
+        hash = hash_double(hash, key->time);
+        hash = hash_vector(hash, key->position);
+        hash = hash_vector(hash, key->rotation);
+        hash = hash_vector(hash, key->scale);
+        hash = hash_vector(hash, key->velocity);
+    }
+    return hash;
+}
+
+uint64_t scene_hash(const Scene* scene) {
+    uint64_t hash = SCENE_HASH_SEED;
+    hash = hash_double(hash, scene->aperture);
+    hash = hash_double(hash, scene->focal_distance);
+    hash = hash_vector(hash, scene->background_color);
+    hash = hash_double(hash, scene->motion_blur_intensity);
+    hash = hash_int(hash, scene->refine_hits);
+    hash = hash_texture(hash, scene->environment_map);
+
+    hash = hash_int(hash, scene->texture_count);
+    for (int i = 0; i < scene->texture_count; i++) {
+        hash = hash_texture(hash, scene->textures[i]);
+    }
 
-    // Check sphere intersections with animation support
+    hash = hash_int(hash, scene->sphere_count);
     for (int i = 0; i < scene->sphere_count; i++) {
-        Sphere current_sphere = scene->spheres[i];
-        
-        // Apply animation if exists
-        if (scene->sphere_animations[i]) {
-            Keyframe current_state = animation_track_interpolate(
-                scene->sphere_animations[i],
-                ray.time
-            );
-            
-            // Update sphere transform
-            current_sphere.center = current_state.position;
-            // Store velocity for motion blur calculations
-            Vector3 velocity = current_state.velocity;
-            
-            // Apply velocity-based motion blur
-            if (scene->motion_blur_intensity > 0.0) {
-                current_sphere.center = vector_add(
-                    current_sphere.center,
-                    vector_multiply(velocity, ray.time - scene->animation_state.current_time)
-                );
+        const Sphere* sphere = &scene->spheres[i];
+        hash = hash_vector(hash, sphere->center);
+        hash = hash_double(hash, sphere->radius);
+        hash = hash_vector(hash, sphere->color);
+        hash = hash_double(hash, sphere->reflectivity);
+        hash = hash_double(hash, sphere->fresnel_ior);
+        hash = hash_double(hash, sphere->fresnel_power);
+        hash = hash_double(hash, sphere->dispersion);
+        hash = hash_double(hash, sphere->glossiness);
+        hash = hash_double(hash, sphere->roughness);
+        hash = hash_double(hash, sphere->metallic);
+        hash = hash_int(hash, sphere->color_texture);
+        hash = hash_double(hash, sphere->texture_scale);
+        hash = hash_int(hash, (int)sphere->pattern.type);
+        hash = hash_double(hash, sphere->pattern.scale);
+        hash = hash_vector(hash, sphere->pattern.color1);
+        hash = hash_vector(hash, sphere->pattern.color2);
+        hash = hash_int(hash, sphere->casts_shadow);
+        hash = hash_track(hash, scene->sphere_animations[i]);
+    }
+
+    hash = hash_int(hash, scene->light_count);
+    for (int i = 0; i < scene->light_count; i++) {
+        const Light* light = &scene->lights[i];
+        hash = hash_vector(hash, light->position);
+        hash = hash_vector(hash, light->color);
+        hash = hash_double(hash, light->intensity);
+        hash = hash_double(hash, light->radius);
+        hash = hash_vector(hash, light->width);
+        hash = hash_vector(hash, light->height);
+        hash = hash_int(hash, light->light_type);
+        hash = hash_track(hash, scene->light_animations[i]);
+    }
+
+    hash = hash_int(hash, scene->mesh_count);
+    for (int i = 0; i < scene->mesh_count; i++) {
+        const Mesh* mesh = &scene->meshes[i];
+        hash = hash_vector(hash, mesh->position);
+        hash = hash_vector(hash, mesh->rotation);
+        hash = hash_vector(hash, mesh->scale);
+        hash = hash_vector(hash, mesh->color);
+        hash = hash_double(hash, mesh->reflectivity);
+        hash = hash_double(hash, mesh->fresnel_ior);
+        hash = hash_double(hash, mesh->fresnel_power);
+        hash = hash_int(hash, mesh->normal_map);
+        hash = hash_int(hash, mesh->use_smooth_shading);
+        hash = hash_int(hash, mesh->casts_shadow);
+        hash = hash_int(hash, mesh->triangle_count);
+        for (int t = 0; t < mesh->triangle_count; t++) {
+            const Triangle* triangle = &mesh->triangles[t];
+            for (int v = 0; v < 3; v++) {
+                hash = hash_vector(hash, triangle->vertices[v]);
+                hash = hash_vector(hash, triangle->normals[v]);
             }
+            hash = hash_int(hash, triangle->smooth_shading);
         }
-        
-        if (sphere_intersect(&current_sphere, ray, t_min, closest_so_far, &temp_hit)) {
-            hit_anything = 1;
-            closest_so_far = temp_hit.t;
-            *hit = temp_hit;
-        }
+        hash = hash_track(hash, scene->mesh_animations[i]);
+    }
+    return hash;
+}
+
+// Center of animated sphere i at the given time. Spheres are also pushed
+// along their velocity across the shutter, which is what makes them blur.
+static Vector3 scene_sphere_center_at(const Scene* scene, int i, double time) {
+    Keyframe state = animation_track_interpolate(scene->sphere_animations[i], time);
+    Vector3 center = state.position;
+    if (scene->motion_blur_intensity > 0.0) {
+        center = vector_add(center, vector_multiply(state.velocity, time - scene->animation_state.current_time));
+    }
+    return center;
+}
+
+// Pose every animated object and light once per motion sample time of the
+// current frame
+static void scene_update_poses(Scene* scene) {
+    scene->instance_time_count = scene_motion_samples(scene);
+    for (int k = 0; k < scene->instance_time_count; k++) {
+        scene->instance_times[k] = scene_motion_sample_time(scene, k);
     }
 
-    // Check mesh intersections with animation support
     for (int i = 0; i < scene->mesh_count; i++) {
-        Mesh current_mesh = scene->meshes[i];
-        
-        // Apply animation if exists
-        if (scene->mesh_animations[i]) {
-            Keyframe current_state = animation_track_interpolate(
-                scene->mesh_animations[i],
-                ray.time
-            );
-            
-            // Update mesh transform
-            current_mesh.position = current_state.position;
-            current_mesh.rotation = current_state.rotation;
-            current_mesh.scale = current_state.scale;
+        if (!scene->mesh_animations[i]) continue;
+        for (int k = 0; k < scene->instance_time_count; k++) {
+            Keyframe state = animation_track_interpolate(scene->mesh_animations[i], scene->instance_times[k]);
+            scene->mesh_instances[i][k] = mesh_transform_create(state.position, state.rotation, state.scale);
         }
-        
-        if (mesh_intersect(&current_mesh, ray, t_min, closest_so_far, &temp_hit)) {
+    }
+    for (int i = 0; i < scene->sphere_count; i++) {
+        if (!scene->sphere_animations[i]) continue;
+        for (int k = 0; k < scene->instance_time_count; k++) {
+            scene->sphere_centers[i][k] = scene_sphere_center_at(scene, i, scene->instance_times[k]);
+        }
+    }
+    for (int i = 0; i < scene->light_count; i++) {
+        if (!scene->light_animations[i]) continue;
+        for (int k = 0; k < scene->instance_time_count; k++) {
+            scene->light_positions[i][k] =
+                animation_track_interpolate(scene->light_animations[i], scene->instance_times[k]).position;
+        }
+    }
+}
+
+// Index of a ray time in the current frame's pose cache, or -1 for a time
+// off the sample grid, which callers pose on demand
+static inline int scene_pose_index(const Scene* scene, double time) {
+    for (int k = 0; k < scene->instance_time_count; k++) {
+        if (scene->instance_times[k] == time) return k;
+    }
+    return -1;
+}
+
+// Transform placing mesh i at the given ray time
+static const MeshTransform* scene_mesh_instance(const Scene* scene, int i, double time,
+                                                MeshTransform* scratch) {
+    if (!scene->mesh_animations[i]) {
+        return &scene->meshes[i].transform;
+    }
+    int k = scene_pose_index(scene, time);
+    if (k >= 0) {
+        return &scene->mesh_instances[i][k];
+    }
+    Keyframe state = animation_track_interpolate(scene->mesh_animations[i], time);
+    *scratch = mesh_transform_create(state.position, state.rotation, state.scale);
+    return scratch;
+}
+
+// Position of light i at the given ray time
+static Vector3 scene_light_position(const Scene* scene, int i, double time) {
+    if (!scene->light_animations[i]) {
+        return scene->lights[i].position;
+    }
+    int k = scene_pose_index(scene, time);
+    if (k >= 0) {
+        return scene->light_positions[i][k];
+    }
+    return animation_track_interpolate(scene->light_animations[i], time).position;
+}
+
+static AnimationTrack* object_animation(const Scene* scene, int object) {
+    if (object < scene->sphere_count) {
+        return scene->sphere_animations[object];
+    }
+    return scene->mesh_animations[object - scene->sphere_count];
+}
+
+// Instance bounds covering every ray time in [t0, t1], a slice of the
+// current frame's shutter
+static AABB scene_object_bounds(Scene* scene, int object, double t0, double t1) {
+    AnimationTrack* track = object_animation(scene, object);
+    int is_sphere = object < scene->sphere_count;
+
+    if (!track) {
+        return is_sphere ? sphere_bounds(&scene->spheres[object])
+                         : mesh_bounds(&scene->meshes[object - scene->sphere_count]);
+    }
+
+    double half_width = scene_shutter_half_width(scene);
+    AnimationExtent extent = animation_track_extent(track, t0, t1);
+
+    Vector3 reach;
+    if (is_sphere) {
+        // Spheres are also pushed along their velocity (see scene_intersect_object)
+        double r = scene->spheres[object].radius;
+        reach = vector_add(vector_create(r, r, r), vector_multiply(extent.max_velocity, half_width));
+    } else {
+        // Any rotation of the mesh stays inside its bounding sphere
+        double r = mesh_local_radius(&scene->meshes[object - scene->sphere_count]) * extent.max_scale;
+        reach = vector_create(r, r, r);
+    }
+
+    AABB box = {
+        .min = vector_subtract(extent.position_min, reach),
+        .max = vector_add(extent.position_max, reach)
+    };
+    return box;
+}
+
+// Bounds over the whole shutter of the current frame
+static AABB scene_shutter_bounds(Scene* scene, int object) {
+    double time = scene->animation_state.current_time;
+    double half_width = scene_shutter_half_width(scene);
+    return scene_object_bounds(scene, object, time - half_width, time + half_width);
+}
+
+// Boxes at shutter open and close whose linear interpolation contains the
+// object at every time in between. Each slice between neighbouring sample
+// times is bounded on its own, and both ends are then grown until the
+// interpolated box holds the slices meeting at every sample time; a box that
+// holds a slice at both its ends holds it throughout.
+static void scene_object_motion_bounds(Scene* scene, int object, AABB* start, AABB* end) {
+    int count = scene->instance_time_count;
+    const double* times = scene->instance_times;
+    AABB at_sample[MOTION_BLUR_SAMPLES];
+    for (int k = 0; k < MOTION_BLUR_SAMPLES; k++) {
+        at_sample[k] = aabb_empty();
+    }
+    for (int k = 0; k + 1 < count; k++) {
+        AABB slice = scene_object_bounds(scene, object, times[k], times[k + 1]);
+        at_sample[k] = aabb_union(at_sample[k], slice);
+        at_sample[k + 1] = aabb_union(at_sample[k + 1], slice);
+    }
+
+    *start = at_sample[0];
+    *end = at_sample[count - 1];
+    // Largest shortfall of the interpolated box at any sample: the low
+    // corner's in shortfall_min.min, the high corner's in shortfall_max.max
+    AABB shortfall_min = {vector_create(0, 0, 0), vector_create(0, 0, 0)};
+    AABB shortfall_max = shortfall_min;
+    for (int k = 1; k + 1 < count; k++) {
+        double u = (times[k] - times[0]) / (times[count - 1] - times[0]);
+        Vector3 lerp_min = vector_add(start->min, vector_multiply(vector_subtract(end->min, start->min), u));
+        Vector3 lerp_max = vector_add(start->max, vector_multiply(vector_subtract(end->max, start->max), u));
+        shortfall_min = aabb_grow(shortfall_min, vector_subtract(at_sample[k].min, lerp_min));
+        shortfall_max = aabb_grow(shortfall_max, vector_subtract(at_sample[k].max, lerp_max));
+    }
+    start->min = vector_add(start->min, shortfall_min.min);
+    start->max = vector_add(start->max, shortfall_max.max);
+    end->min = vector_add(end->min, shortfall_min.min);
+    end->max = vector_add(end->max, shortfall_max.max);
+}
+
+// Refit the tree to the current frame's object bounds. Blurred frames get
+// motion bounds when objects travel far for their size during the shutter,
+// so each ray only meets objects near where they are at its time rather
+// than anywhere along their path. Interpolating costs every node visit, so
+// short blurs keep the swept boxes.
+static int scene_refit_bvh(Scene* scene) {
+    int object_count = scene->sphere_count + scene->mesh_count;
+    int blurred = scene->instance_time_count > 1;
+    double swept_area = 0.0;
+    double midpoint_area = 0.0;
+    for (int object = 0; blurred && object < object_count; object++) {
+        if (!object_animation(scene, object)) continue;
+        AABB* start = &scene->object_bounds[object];
+        AABB* end = &scene->object_end_bounds[object];
+        scene_object_motion_bounds(scene, object, start, end);
+        AABB midpoint = {
+            .min = vector_multiply(vector_add(start->min, end->min), 0.5),
+            .max = vector_multiply(vector_add(start->max, end->max), 0.5)
+        };
+        swept_area += aabb_surface_area(aabb_union(*start, *end));
+        midpoint_area += aabb_surface_area(midpoint);
+    }
+
+    if (blurred && midpoint_area <= 0.75 * swept_area) {
+        int last = scene->instance_time_count - 1;
+        if (!bvh_refit_motion(&scene->bvh, scene->object_bounds, scene->object_end_bounds,
+                              scene->instance_times[0], scene->instance_times[last])) {
+            fprintf(stderr, "Error: Could not allocate scene BVH\n");
+            return 0;
+        }
+        return 1;
+    }
+
+    for (int object = 0; object < object_count; object++) {
+        if (!object_animation(scene, object)) continue;
+        scene->object_bounds[object] = scene->object_end_bounds[object] = scene_shutter_bounds(scene, object);
+    }
+    bvh_refit(&scene->bvh, scene->object_bounds);
+    return 1;
+}
+
+// Lay static sphere hit data out in the tree's leaf order. Refits keep the
+// topology, so this only has to happen after a full build.
+static int scene_build_sphere_batch(Scene* scene) {
+    SphereBatch* batch = &scene->sphere_batch;
+    int slots = scene->bvh.index_count;
+    int padded = slots + SPHERE_BATCH_WIDTH - 1;  // Whole-register loads may overrun a leaf
+
+    if (padded > scene->sphere_batch_capacity) {
+        int capacity = scene->sphere_capacity + scene->mesh_capacity + SPHERE_BATCH_WIDTH - 1;
+        if (capacity < padded) capacity = padded;
+        size_t size = capacity * sizeof(vector_real);
+        batch->center_x = (vector_real*)arena_alloc(&scene->arena, size);
+        batch->center_y = (vector_real*)arena_alloc(&scene->arena, size);
+        batch->center_z = (vector_real*)arena_alloc(&scene->arena, size);
+        batch->radius_squared = (vector_real*)arena_alloc(&scene->arena, size);
+        batch->shadow_radius_squared = (vector_real*)arena_alloc(&scene->arena, size);
+        if (!batch->center_x || !batch->center_y || !batch->center_z ||
+            !batch->radius_squared || !batch->shadow_radius_squared) {
+            scene->sphere_batch_capacity = 0;
+            return 0;
+        }
+        scene->sphere_batch_capacity = capacity;
+    }
+
+    for (int slot = 0; slot < padded; slot++) {
+        int object = slot < slots ? scene->bvh.indices[slot] : -1;
+        if (object >= 0 && object < scene->sphere_count && !scene->sphere_animations[object]) {
+            const Sphere* sphere = &scene->spheres[object];
+            batch->center_x[slot] = sphere->center.x;
+            batch->center_y[slot] = sphere->center.y;
+            batch->center_z[slot] = sphere->center.z;
+            batch->radius_squared[slot] = sphere->radius * sphere->radius;
+            batch->shadow_radius_squared[slot] = sphere->casts_shadow ? batch->radius_squared[slot] : -INFINITY;
+        } else {
+            batch->center_x[slot] = batch->center_y[slot] = batch->center_z[slot] = 0.0;
+            batch->radius_squared[slot] = batch->shadow_radius_squared[slot] = -INFINITY;
+        }
+    }
+    batch->count = slots;
+    return 1;
+}
+
+int scene_build_bvh(Scene* scene) {
+    scene_free_bvh(scene);
+    scene_update_poses(scene);
+
+    int object_count = scene->sphere_count + scene->mesh_count;
+    if (object_count > scene->object_bounds_capacity) {
+        int capacity = scene->sphere_capacity + scene->mesh_capacity;
+        AABB* bounds = (AABB*)arena_alloc(&scene->arena, capacity * sizeof(AABB));
+        AABB* end_bounds = (AABB*)arena_alloc(&scene->arena, capacity * sizeof(AABB));
+        if (!bounds || !end_bounds) {
+            fprintf(stderr, "Error: Could not allocate scene BVH\n");
+            return 0;
+        }
+        scene->object_bounds = bounds;
+        scene->object_end_bounds = end_bounds;
+        scene->object_bounds_capacity = capacity;
+    }
+    // The topology is chosen for the boxes objects sweep over the shutter
+    for (int object = 0; object < object_count; object++) {
+        scene->object_bounds[object] = scene_shutter_bounds(scene, object);
+        if (!aabb_is_finite(scene->object_bounds[object])) {
+            fprintf(stderr, "Error: Object %d has non-finite bounds\n", object);
+            scene->animated_object_count = 0;
+            return 0;
+        }
+        scene->object_end_bounds[object] = scene->object_bounds[object];
+        if (object_animation(scene, object)) {
+            scene->animated_object_count++;
+        }
+    }
+
+    if (!bvh_build_batched(&scene->bvh, scene->object_bounds, NULL, object_count, SPHERE_BATCH_WIDTH)) {
+        fprintf(stderr, "Error: Could not allocate scene BVH\n");
+        scene->animated_object_count = 0;
+        return 0;
+    }
+    if (!scene_build_sphere_batch(scene)) {
+        fprintf(stderr, "Error: Could not allocate scene BVH\n");
+        bvh_free(&scene->bvh);
+        scene->animated_object_count = 0;
+        return 0;
+    }
+    if (scene->animated_object_count > 0 && scene->instance_time_count > 1 && !scene_refit_bvh(scene)) {
+        bvh_free(&scene->bvh);
+        scene->animated_object_count = 0;
+        return 0;
+    }
+    scene->bvh_built = 1;
+    scene->bvh_built_cost = bvh_sah_cost(&scene->bvh);
+    return 1;
+}
+
+int scene_update_bvh(Scene* scene) {
+    if (!scene->bvh_built) {
+        return scene_build_bvh(scene);
+    }
+    // Lights are posed too, even when no object moves
+    scene_update_poses(scene);
+    if (scene->animated_object_count == 0) {
+        return 1;
+    }
+
+    // Only animated instances move; the mesh-level trees are untouched
+    if (!scene_refit_bvh(scene)) {
+        return 0;
+    }
+
+    // Objects that have travelled far leave badly overlapping nodes behind
+    if (bvh_sah_cost(&scene->bvh) > 2.0 * scene->bvh_built_cost) {
+        return scene_build_bvh(scene);
+    }
+    return 1;
+}
+
+void scene_free_bvh(Scene* scene) {
+    bvh_free(&scene->bvh);
+    scene->bvh_built = 0;
+    scene->animated_object_count = 0;
+}
+
+// Sphere i as placed at the given time: the scene's own record when it is
+// static, otherwise an animated copy in scratch
+static Sphere* scene_posed_sphere(Scene* scene, int i, double time, Sphere* scratch) {
+    Sphere* sphere = &scene->spheres[i];
+    if (!scene->sphere_animations[i]) return sphere;
+
+    *scratch = *sphere;
+    int k = scene_pose_index(scene, time);
+    scratch->center = k >= 0 ? scene->sphere_centers[i][k] : scene_sphere_center_at(scene, i, time);
+    return scratch;
+}
+
+// Intersect a single scene object at the ray's time (BVHIntersectFn)
+static int scene_intersect_object(void* context, int object, const Ray* ray,
+                                  double t_min, double t_max, Hit* hit) {
+    Scene* scene = (Scene*)context;
+
+    if (object < scene->sphere_count) {
+        Sphere scratch;
+        Sphere* posed = scene_posed_sphere(scene, object, ray->time, &scratch);
+        if (!sphere_intersect(posed, *ray, t_min, t_max, hit)) return 0;
+
+        hit->object = object;
+        hit->is_mesh = 0;
+        return 1;
+    }
+
+    // Animated meshes share their triangles; only the instance transform moves
+    int i = object - scene->sphere_count;
+    MeshTransform scratch;
+    const MeshTransform* transform = scene_mesh_instance(scene, i, ray->time, &scratch);
+    if (!mesh_intersect_instance(&scene->meshes[i], transform, ray, t_min, t_max, hit)) return 0;
+
+    hit->object = i;
+    hit->is_mesh = 1;
+    return 1;
+}
+
+// Intersect one leaf of the scene BVH (BVHLeafIntersectFn). Static spheres
+// go through the batched kernel, and only the winner is re-intersected to
+// fill in its hit record; meshes and animated spheres are tested one by one.
+static int scene_intersect_leaf(void* context, int first, int count, const Ray* ray,
+                                double t_min, double t_max, Hit* hit) {
+    Scene* scene = (Scene*)context;
+    const int* objects = scene->bvh.indices;
+    double closest = t_max;
+    int hit_anything = 0;
+
+    // The kernel works in vector_real, so arbitrary precision keeps the scalar path
+    int batched = vector_get_precision_mode() != PRECISION_ARBITRARY;
+    int slot;
+    double t;
+    if (batched && sphere_batch_intersect(&scene->sphere_batch, first, count, ray,
+                                          t_min, closest, &slot, &t)) {
+        if (scene_intersect_object(scene, objects[slot], ray, t_min, closest, hit)) {
             hit_anything = 1;
-            closest_so_far = temp_hit.t;
-            temp_hit.mesh = &current_mesh;
-            *hit = temp_hit;
+            closest = hit->t;
         }
     }
 
+    for (slot = first; slot < first + count; slot++) {
+        if (batched && scene->sphere_batch.radius_squared[slot] != -INFINITY) continue;
+        if (scene_intersect_object(scene, objects[slot], ray, t_min, closest, hit)) {
+            hit_anything = 1;
+            closest = hit->t;
+        }
+    }
     return hit_anything;
 }
 
-static Ray generate_defocus_ray(Scene* scene, Ray original_ray, Vector3 focal_point) {
+// Recompute a closest hit in double-double against the object it was found
+// on, posed at the ray's time
+static void scene_refine_hit(Scene* scene, const Ray* ray, Hit* hit) {
+    if (!hit->is_mesh) {
+        Sphere scratch;
+        sphere_refine_hit(scene_posed_sphere(scene, hit->object, ray->time, &scratch), ray, hit);
+        return;
+    }
+
+    int i = hit->object;
+    MeshTransform scratch;
+    mesh_refine_hit(&scene->meshes[i], scene_mesh_instance(scene, i, ray->time, &scratch), ray, hit);
+}
+
+int scene_closest_hit(Scene* scene, Ray ray, double t_min, double t_max, Hit* hit) {
+    Hit temp_hit;
+    int hit_anything = 0;
+    double closest_so_far = t_max;
+
+    if (!scene->bvh_built) {
+        // No tree yet: test every object
+        int object_count = scene->sphere_count + scene->mesh_count;
+        for (int object = 0; object < object_count; object++) {
+            if (scene_intersect_object(scene, object, &ray, t_min, closest_so_far, &temp_hit)) {
+                hit_anything = 1;
+                closest_so_far = temp_hit.t;
+                *hit = temp_hit;
+            }
+        }
+    } else if (bvh_intersect_leaves(&scene->bvh, &ray, t_min, closest_so_far, scene_intersect_leaf, scene,
+                                    &temp_hit)) {
+        hit_anything = 1;
+        *hit = temp_hit;
+    }
+
+    if (hit_anything && scene->refine_hits) {
+        scene_refine_hit(scene, &ray, hit);
+    }
+    return hit_anything;
+}
+
+// Whether a single scene object blocks the ray, skipping objects that cast
+// no shadow
+static int scene_object_occludes(Scene* scene, int object, const Ray* ray, double t_min, double t_max) {
+    if (object < scene->sphere_count) {
+        if (!scene->spheres[object].casts_shadow) return 0;
+        Sphere scratch;
+        return sphere_occludes(scene_posed_sphere(scene, object, ray->time, &scratch), ray, t_min, t_max);
+    }
+
+    int i = object - scene->sphere_count;
+    if (!scene->meshes[i].casts_shadow) return 0;
+    MeshTransform scratch;
+    const MeshTransform* transform = scene_mesh_instance(scene, i, ray->time, &scratch);
+    return mesh_occluded_instance(&scene->meshes[i], transform, ray, t_min, t_max);
+}
+
+// Any-hit test of one scene BVH leaf (BVHLeafOccludedFn)
+static int scene_occluded_leaf(void* context, int first, int count, const Ray* ray,
+                               double t_min, double t_max) {
+    Scene* scene = (Scene*)context;
+    int batched = vector_get_precision_mode() != PRECISION_ARBITRARY;
+    if (batched && sphere_batch_occluded(&scene->sphere_batch, first, count, ray, t_min, t_max)) {
+        return 1;
+    }
+
+    for (int slot = first; slot < first + count; slot++) {
+        if (batched && scene->sphere_batch.radius_squared[slot] != -INFINITY) continue;
+        if (scene_object_occludes(scene, scene->bvh.indices[slot], ray, t_min, t_max)) return 1;
+    }
+    return 0;
+}
+
+int scene_occluded(Scene* scene, Ray ray, double t_max) {
+    const double t_min = ray_t_min(ray.origin);  // Same self-intersection offset as scene_trace's queries
+
+    if (!scene->bvh_built) {
+        int object_count = scene->sphere_count + scene->mesh_count;
+        for (int object = 0; object < object_count; object++) {
+            if (scene_object_occludes(scene, object, &ray, t_min, t_max)) return 1;
+        }
+        return 0;
+    }
+    return bvh_occluded(&scene->bvh, &ray, t_min, t_max, scene_occluded_leaf, scene);
+}
+
+void scene_closest_hit_packet(Scene* scene, const Ray* rays, int count, double t_min, double t_max,
+                              Hit* hits, int* found) {
+    if (scene->bvh_built && bvh_intersect_packet(&scene->bvh, rays, count, t_min, t_max,
+                                                 scene_intersect_leaf, scene, hits, found)) {
+        for (int i = 0; i < count && scene->refine_hits; i++) {
+            if (found[i]) scene_refine_hit(scene, &rays[i], &hits[i]);
+        }
+        return;
+    }
+
+    // Divergent bundle, or no tree to share: one ray at a time
+    for (int i = 0; i < count; i++) {
+        found[i] = scene_closest_hit(scene, rays[i], t_min, t_max, &hits[i]);
+    }
+}
+
+// Material a hit is shaded with. Meshes carry only a color, reflectivity and
+// Fresnel terms, so they shade as an untextured sphere material built from those.
+static const Sphere* scene_hit_material(const Scene* scene, const Hit* hit, Sphere* scratch) {
+    if (!hit->is_mesh) {
+        return &scene->spheres[hit->object];
+    }
+    const Mesh* mesh = &scene->meshes[hit->object];
+    *scratch = sphere_create(vector_create(0, 0, 0), 0.0, mesh->color, mesh->reflectivity,
+                             mesh->fresnel_ior, mesh->fresnel_power);
+    return scratch;
+}
+
+static Ray generate_defocus_ray(Scene* scene, Ray original_ray, Vector3 focal_point, Sampler* sampler) {
     // Generate random point in aperture disk
-    double r = scene->aperture * sqrt((double)rand() / RAND_MAX);
-    double theta = 2.0 * M_PI * ((double)rand() / RAND_MAX);
+    double r = scene->aperture * sqrt(sampler_next_double(sampler));
+    double theta = 2.0 * M_PI * sampler_next_double(sampler);
     
     Vector3 offset = vector_create(
         r * cos(theta),
@@ -211,11 +941,16 @@ static Ray generate_defocus_ray(Scene* scene, Ray original_ray, Vector3 focal_po
     Vector3 origin = vector_add(original_ray.origin, offset);
     Vector3 direction = vector_normalize(vector_subtract(focal_point, origin));
     
-    return ray_create(origin, direction);
+    Ray ray = ray_create(origin, direction);
+    ray.time = original_ray.time;
+    ray.wavelength_offset = original_ray.wavelength_offset;
+    return ray;
 }
 
-static Vector3 trace_chromatic(Scene* scene, Ray ray, int depth, double wavelength_offset) {
-    Hit hit;
+// Wavelength only changes how the primary hit refracts, not what the ray
+// hits, so all three channels share one closest-hit query (NULL on a miss)
+static Vector3 trace_chromatic(Scene* scene, Ray ray, const Hit* primary_hit, int depth,
+                               double wavelength_offset, Sampler* sampler) {
     if (depth <= 0) return vector_create(0, 0, 0);
     
     // Adjust IOR based on wavelength for chromatic aberration
@@ -223,41 +958,60 @@ static Vector3 trace_chromatic(Scene* scene, Ray ray, int depth, double waveleng
         ray.wavelength_offset = wavelength_offset;
     }
 
-    if (scene_closest_hit(scene, ray, 0.001, DBL_MAX, &hit)) {
-        Vector3 color = vector_create(0, 0, 0);
+    if (primary_hit) {
+        const Hit* hit = primary_hit;
+        Sphere scratch;
+        const Sphere* material = scene_hit_material(scene, hit, &scratch);
         
         // Adjust IOR for chromatic aberration
-        if (hit.sphere) {
-            double wavelength_ior = hit.sphere->fresnel_ior + 
-                (wavelength_offset * hit.sphere->dispersion);
-            
-            // Calculate refraction
-            Vector3 view_dir = vector_normalize(vector_multiply(ray.direction, -1.0));
-            double cos_theta = vector_dot(view_dir, hit.normal);
-            double ior_ratio = cos_theta > 0 ? 1.0 / wavelength_ior : wavelength_ior;
-            
-            Vector3 refracted = vector_multiply(ray.direction, ior_ratio);
-            Ray refract_ray = ray_create(hit.point, refracted);
-            color = scene_trace(scene, refract_ray, depth - 1);
-        }
+        double wavelength_ior = material->fresnel_ior + 
+            (wavelength_offset * material->dispersion);
         
-        return color;
+        // Calculate refraction
+        Vector3 view_dir = vector_normalize(vector_multiply(ray.direction, -1.0));
+        double cos_theta = vector_dot(view_dir, hit->normal);
+        double ior_ratio = cos_theta > 0 ? 1.0 / wavelength_ior : wavelength_ior;
+        
+        Vector3 refracted = vector_multiply(ray.direction, ior_ratio);
+        Ray refract_ray = ray_create(hit->point, refracted);
+        refract_ray.time = ray.time;
+        return scene_trace(scene, refract_ray, depth - 1, sampler);
     }
     
     return scene->background_color;
 }
 
-Vector3 scene_trace(Scene* scene, Ray ray, int depth) {
+Vector3 scene_trace_primary(Scene* scene, Ray ray, const Hit* hit, Sampler* sampler) {
+    // For transparent objects, trace different wavelengths
+    Vector3 color = vector_create(0, 0, 0);
+    color.x = trace_chromatic(scene, ray, hit, MAX_DEPTH, 0.02, sampler).x;  // Red wavelength
+    color.y = trace_chromatic(scene, ray, hit, MAX_DEPTH, 0.0, sampler).y;   // Green wavelength
+    color.z = trace_chromatic(scene, ray, hit, MAX_DEPTH, -0.02, sampler).z; // Blue wavelength
+    return color;
+}
+
+void scene_trace_packet(Scene* scene, const Ray* rays, int count, Sampler* samplers, Vector3* colors) {
+    Hit hits[BVH_PACKET_MAX];
+    int found[BVH_PACKET_MAX];
+
+    for (int first = 0; first < count; first += BVH_PACKET_MAX) {
+        int n = count - first < BVH_PACKET_MAX ? count - first : BVH_PACKET_MAX;
+        // Packet rays share their origin, and so their offset
+        scene_closest_hit_packet(scene, rays + first, n, ray_t_min(rays[first].origin), DBL_MAX, hits, found);
+        for (int i = 0; i < n; i++) {
+            colors[first + i] = scene_trace_primary(scene, rays[first + i], found[i] ? &hits[i] : NULL,
+                                                    &samplers[first + i]);
+        }
+    }
+}
+
+Vector3 scene_trace(Scene* scene, Ray ray, int depth, Sampler* sampler) {
     Hit hit;
     if (depth <= 0) return vector_create(0, 0, 0);
     
-    // For transparent objects, trace different wavelengths
-    Vector3 color = vector_create(0, 0, 0);
     if (depth == MAX_DEPTH) {  // Only do chromatic aberration on primary rays
-        color.x = trace_chromatic(scene, ray, depth, 0.02).x;  // Red wavelength
-        color.y = trace_chromatic(scene, ray, depth, 0.0).y;   // Green wavelength
-        color.z = trace_chromatic(scene, ray, depth, -0.02).z; // Blue wavelength
-        return color;
+        int found = scene_closest_hit(scene, ray, ray_t_min(ray.origin), DBL_MAX, &hit);
+        return scene_trace_primary(scene, ray, found ? &hit : NULL, sampler);
     }
 
     // Calculate focal point for depth of field
@@ -265,59 +1019,52 @@ Vector3 scene_trace(Scene* scene, Ray ray, int depth) {
     
     // If aperture is significant, use depth of field
     if (scene->aperture > 0.001) {
-        ray = generate_defocus_ray(scene, ray, focal_point);
+        ray = generate_defocus_ray(scene, ray, focal_point, sampler);
     }
 
-    if (scene_closest_hit(scene, ray, 0.001, DBL_MAX, &hit)) {
+    if (scene_closest_hit(scene, ray, ray_t_min(ray.origin), DBL_MAX, &hit)) {
         Vector3 color = vector_create(0, 0, 0);
+        Sphere scratch;
+        const Sphere* material = scene_hit_material(scene, &hit, &scratch);
         
         // Calculate lighting with animated lights
         for (int i = 0; i < scene->light_count; i++) {
             Light current_light = scene->lights[i];
+            current_light.position = scene_light_position(scene, i, ray.time);
             
-            // Apply animation if exists
-            if (scene->light_animations[i]) {
-                Keyframe current_state = animation_track_interpolate(
-                    scene->light_animations[i],
-                    ray.time
-                );
-                
-                // Update light position
-                current_light.position = current_state.position;
-            }
-            
-            const int shadow_samples = 8;   // Reduced samples for better performance
+            const int shadow_samples = light_shadow_samples(current_light);
             Vector3 light_contribution = vector_create(0, 0, 0);
             
             for (int sample = 0; sample < shadow_samples; sample++) {
-                Vector3 light_pos = light_random_position(current_light);
+                Vector3 light_pos = light_random_position(current_light, sampler, sample, shadow_samples);
                 Vector3 light_dir = vector_normalize(vector_subtract(light_pos, hit.point));
                 
                 // Shadow ray
                 Ray shadow_ray = ray_create(hit.point, light_dir);
-                Hit shadow_hit;
+                shadow_ray.time = ray.time;  // Occluders are posed when the path is
                 double light_distance = vector_length(vector_subtract(light_pos, hit.point));
                 
-                if (!scene_closest_hit(scene, shadow_ray, 0.001, light_distance, &shadow_hit)) {
+                if (!scene_occluded(scene, shadow_ray, light_distance)) {
                     // Calculate diffuse component with surface normal
                     double diff = fmax(0.0, vector_dot(hit.normal, light_dir));
                     
                     // Get texture color if available
-                    Vector3 surface_color = hit.sphere->color;
-                    if (hit.sphere->color_texture) {
-                        Vector2Double tex_coord = calculate_sphere_uv(hit.point, hit.sphere->center, hit.sphere->texture_scale);
-                        surface_color = vector_multiply_vec(surface_color, sample_texture(tex_coord, hit.sphere->color_texture));
+                    Vector3 surface_color = material->color;
+                    if (material->color_texture >= 0) {
+                        Vector2Double tex_coord = calculate_sphere_uv(hit.point, material->center, material->texture_scale);
+                        surface_color = vector_multiply_vec(surface_color,
+                                                            sample_texture(tex_coord, scene->textures[material->color_texture]));
                     }
                     
                     // Calculate specular component with glossiness
                     Vector3 view_dir = vector_normalize(vector_multiply(ray.direction, -1));
                     Vector3 reflect_dir = vector_reflect(vector_multiply(light_dir, -1), hit.normal);
-                    double gloss_power = 2.0 + hit.sphere->glossiness * 126.0;
+                    double gloss_power = 2.0 + material->glossiness * 126.0;
                     double spec = pow(fmax(vector_dot(view_dir, reflect_dir), 0.0), gloss_power);
                     
                     // Combine diffuse and specular components
                     Vector3 diffuse = vector_multiply_vec(surface_color, current_light.color);
-                    Vector3 specular = vector_multiply(current_light.color, hit.sphere->glossiness * spec);
+                    Vector3 specular = vector_multiply(current_light.color, material->glossiness * spec);
                     Vector3 sample_contribution = vector_multiply(
                         vector_add(diffuse, specular),
                         diff * current_light.intensity
@@ -332,27 +1079,27 @@ Vector3 scene_trace(Scene* scene, Ray ray, int depth) {
         }
 
         // Calculate Fresnel reflection
-        if (depth > 0 && hit.sphere) {
+        if (depth > 0) {
             Vector3 view_dir = vector_normalize(vector_multiply(ray.direction, -1.0));
             double cos_theta = fabs(vector_dot(view_dir, hit.normal));
             
-            double r0 = (hit.sphere->fresnel_ior - 1.0) / (hit.sphere->fresnel_ior + 1.0);
+            double r0 = (material->fresnel_ior - 1.0) / (material->fresnel_ior + 1.0);
             r0 = r0 * r0;
             
-            double roughness_factor = hit.sphere->roughness * hit.sphere->roughness;
-            double fresnel_factor = r0 + (1.0 - r0) * pow(1.0 - cos_theta, 5.0) * hit.sphere->fresnel_power;
+            double roughness_factor = material->roughness * material->roughness;
+            double fresnel_factor = r0 + (1.0 - r0) * pow(1.0 - cos_theta, 5.0) * material->fresnel_power;
             
-            if (hit.sphere->metallic > 0.0) {
-                fresnel_factor = fresnel_factor * (1.0 - roughness_factor) + hit.sphere->metallic * roughness_factor;
+            if (material->metallic > 0.0) {
+                fresnel_factor = fresnel_factor * (1.0 - roughness_factor) + material->metallic * roughness_factor;
             }
             
-            double final_reflectivity = hit.sphere->reflectivity * fresnel_factor;
+            double final_reflectivity = material->reflectivity * fresnel_factor;
             
             if (final_reflectivity > 0.0) {
                 Vector3 reflected = vector_reflect(ray.direction, hit.normal);
                 Ray reflect_ray = ray_create(hit.point, reflected);
                 reflect_ray.time = ray.time;
-                Vector3 reflect_color = scene_trace(scene, reflect_ray, depth - 1);
+                Vector3 reflect_color = scene_trace(scene, reflect_ray, depth - 1, sampler);
                 color = vector_add(color, vector_multiply(reflect_color, final_reflectivity));
             }
         }
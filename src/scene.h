@@ -7,44 +7,128 @@
 #include "light.h"
 #include "mesh.h"
 #include "animation.h"
+#include "sampler.h"
+#include "bvh.h"
+#include "arena.h"
+#include <stddef.h>
+#include <stdint.h>
 
-#define MAX_SPHERES 10
-#define MAX_LIGHTS 5
-#define MAX_MESHES 10
 #define MAX_DEPTH 5
 #define MAX_NORMAL_MAPS 10
+#define MOTION_BLUR_SAMPLES 4  // Ray times per pixel sample when motion blur is on
 
-// Scene structure definition
+// Scene structure definition. Object containers are contiguous arrays carved
+// from the scene's arena; they grow on demand, or can be sized up front with
+// scene_reserve. Arrays marked "parallel" share their container's capacity.
+// Outgrown arrays stay in the arena until scene_destroy, so appending many
+// objects without reserving keeps about twice their final size alive; call
+// scene_reserve before adding more than a handful.
 typedef struct Scene {
     double aperture;       // Camera aperture size
     double focal_distance; // Distance to focal plane
-    struct Sphere spheres[MAX_SPHERES];
+    Arena arena;           // Owns every container below
+    struct Sphere* spheres;
     int sphere_count;
-    Light lights[MAX_LIGHTS];
+    int sphere_capacity;
+    Light* lights;
     int light_count;
-    struct Mesh meshes[MAX_MESHES];
+    int light_capacity;
+    struct Mesh* meshes;   // Triangle buffers stay owned by each mesh
     int mesh_count;
-    #define MAX_TEXTURES 20
-    Texture textures[MAX_TEXTURES];
+    int mesh_capacity;
+    Texture** textures;    // Individually allocated, so texture pointers stay valid
     int texture_count;
+    int texture_capacity;
     Texture* environment_map;
     Vector3 background_color;
     
     // Animation support
     AnimationState animation_state;
-    AnimationTrack* sphere_animations[MAX_SPHERES];
-    AnimationTrack* mesh_animations[MAX_MESHES];
-    AnimationTrack* light_animations[MAX_LIGHTS];
+    AnimationTrack** sphere_animations;  // Parallel to spheres
+    AnimationTrack** mesh_animations;    // Parallel to meshes
+    AnimationTrack** light_animations;   // Parallel to lights
     double motion_blur_intensity;  // Controls strength of motion blur effect
+
+    // Mixed precision: traversal and intersection stay in double, and only
+    // each confirmed closest hit is refined in double-double
+    int refine_hits;
+
+    // Pixel sampling requested by the scene file; zeros leave the renderer's
+    // settings alone (see RenderSettings)
+    int samples_per_pixel;
+    int min_samples_per_pixel;
+    double adaptive_threshold;
+
+    // Two-level acceleration: this top-level BVH over object instances sits
+    // above each mesh's own triangle BVH. Object ids are sphere indices,
+    // followed by mesh indices offset by sphere_count. Animated instances are
+    // refitted every frame. When they move far for their size under motion
+    // blur, the tree carries bounds at the shutter's open and close, which
+    // each ray interpolates to its own time; otherwise it bounds everything
+    // they sweep over the shutter.
+    BVH bvh;
+    int bvh_built;
+    double bvh_built_cost;     // SAH cost right after the last full build
+    AABB* object_bounds;       // Instance bounds, indexed by object id; at shutter open in a motion tree
+    AABB* object_end_bounds;   // Same at shutter close
+    int object_bounds_capacity;
+    int animated_object_count;
+    // Static spheres' hit data in BVH leaf order, so a leaf's spheres are
+    // tested in one batched pass; other slots are left unhittable
+    SphereBatch sphere_batch;
+    int sphere_batch_capacity;
+
+    // Poses of animated objects and lights at each motion sample time of the
+    // current frame, evaluated once per frame. Rays look their pose up here by
+    // time instead of interpolating keyframes.
+    double instance_times[MOTION_BLUR_SAMPLES];
+    int instance_time_count;
+    MeshTransform (*mesh_instances)[MOTION_BLUR_SAMPLES];  // Parallel to meshes
+    Vector3 (*sphere_centers)[MOTION_BLUR_SAMPLES];        // Parallel to spheres
+    Vector3 (*light_positions)[MOTION_BLUR_SAMPLES];       // Parallel to lights
+
+    // Set for a view of a shared scene image (see scene_image.h), whose
+    // geometry, textures and animation tracks belong to the image
+    int mapped;
 } Scene;
 
 // Function declarations
 Scene scene_create(void);
-void scene_add_sphere(Scene* scene, struct Sphere sphere);
-void scene_add_light(Scene* scene, Light light);
-void scene_add_mesh(Scene* scene, struct Mesh mesh);
-Vector3 scene_trace(Scene* scene, Ray ray, int depth);
+int scene_reserve(Scene* scene, int sphere_count, int mesh_count, int light_count);
+void scene_destroy(Scene* scene);
+// Appends return 0, leaving the scene unchanged, when the container cannot grow
+int scene_add_sphere(Scene* scene, struct Sphere sphere);
+int scene_add_light(Scene* scene, Light light);
+int scene_add_mesh(Scene* scene, struct Mesh mesh);
+Vector3 scene_trace(Scene* scene, Ray ray, int depth, Sampler* sampler);
 int scene_closest_hit(Scene* scene, Ray ray, double t_min, double t_max, Hit* hit);
+// Whether anything that casts shadows blocks the ray before t_max. Stops at
+// the first blocker and computes no hit attributes.
+int scene_occluded(Scene* scene, Ray ray, double t_max);
+
+// Closest hits for a bundle of rays sharing an origin, traversing the scene
+// BVH once for the bundle where the rays are coherent enough. found[i]
+// reports whether hits[i] was filled.
+void scene_closest_hit_packet(Scene* scene, const Ray* rays, int count, double t_min, double t_max,
+                              Hit* hits, int* found);
+// Shade a camera ray whose closest hit is already known (NULL on a miss)
+Vector3 scene_trace_primary(Scene* scene, Ray ray, const Hit* hit, Sampler* sampler);
+// Trace camera rays sharing an origin as packets; same result as calling
+// scene_trace at MAX_DEPTH on each ray with its own sampler
+void scene_trace_packet(Scene* scene, const Ray* rays, int count, Sampler* samplers, Vector3* colors);
+int scene_build_bvh(Scene* scene);
+int scene_update_bvh(Scene* scene);
+void scene_free_bvh(Scene* scene);
+double scene_shutter_half_width(const Scene* scene);
+int scene_motion_samples(const Scene* scene);
+double scene_motion_sample_time(const Scene* scene, int sample);
+// Fingerprint of everything that shapes the scene's image: materials,
+// geometry, textures, lights and animation tracks, but not the current pose
+// or acceleration structures. scene_hash_bytes folds more data into a hash
+// (64-bit FNV-1a) started from SCENE_HASH_SEED.
+#define SCENE_HASH_SEED 0xcbf29ce484222325ULL
+uint64_t scene_hash_bytes(uint64_t hash, const void* data, size_t size);
+uint64_t scene_hash(const Scene* scene);
 Texture* scene_load_texture(Scene* scene, const char* filename, int type);
 Texture* scene_load_environment_map(Scene* scene, const char* filename);
 void scene_free_textures(Scene* scene);
@@ -1,6 +1,8 @@
 #include "scene_config.h"
 #include "json_parser.h"
 #include "xml_parser.h"
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +29,77 @@ static double get_json_number(JsonValue* value, double default_value) {
     return success ? result : default_value;
 }
 
+// Whole XML attribute as a number, or NaN if it is not one
+static double parse_xml_number(const char* text) {
+    char* end;
+    double value = strtod(text, &end);
+    return end != text && *end == '\0' ? value : NAN;
+}
+
+// Scene sampling settings are validated like the matching command line
+// options; out of range values fail the load instead of being ignored
+static int check_sample_count(double value, const char* name, int* count) {
+    if (!(value >= 1.0 && value <= INT_MAX) || value != floor(value)) {
+        fprintf(stderr, "Error: Sampling %s must be a whole number of at least 1\n", name);
+        return 0;
+    }
+    *count = (int)value;
+    return 1;
+}
+
+static int check_adaptive_threshold(double value, double* threshold) {
+    if (!isfinite(value) || value < 0.0) {
+        fprintf(stderr, "Error: Sampling adaptive_threshold must be a non-negative number\n");
+        return 0;
+    }
+    *threshold = value;
+    return 1;
+}
+
+static int load_sampling_json(JsonObject* obj, Scene* scene) {
+    JsonValue* value;
+    int success;
+    if ((value = json_object_get(obj, "samples_per_pixel"))) {
+        double number = json_get_number(value, &success);
+        if (!check_sample_count(success ? number : NAN, "samples_per_pixel", &scene->samples_per_pixel)) {
+            return 0;
+        }
+    }
+    if ((value = json_object_get(obj, "min_samples"))) {
+        double number = json_get_number(value, &success);
+        if (!check_sample_count(success ? number : NAN, "min_samples", &scene->min_samples_per_pixel)) {
+            return 0;
+        }
+    }
+    if ((value = json_object_get(obj, "adaptive_threshold"))) {
+        double number = json_get_number(value, &success);
+        if (!check_adaptive_threshold(success ? number : NAN, &scene->adaptive_threshold)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int load_sampling_xml(XmlNode* node, Scene* scene) {
+    const char* samples_per_pixel = xml_get_attribute(node, "samples_per_pixel");
+    const char* min_samples = xml_get_attribute(node, "min_samples");
+    const char* adaptive_threshold = xml_get_attribute(node, "adaptive_threshold");
+
+    if (samples_per_pixel && !check_sample_count(parse_xml_number(samples_per_pixel), "samples_per_pixel",
+                                                 &scene->samples_per_pixel)) {
+        return 0;
+    }
+    if (min_samples && !check_sample_count(parse_xml_number(min_samples), "min_samples",
+                                           &scene->min_samples_per_pixel)) {
+        return 0;
+    }
+    if (adaptive_threshold && !check_adaptive_threshold(parse_xml_number(adaptive_threshold),
+                                                        &scene->adaptive_threshold)) {
+        return 0;
+    }
+    return 1;
+}
+
 static Vector3 parse_vector3_xml(XmlNode* node) {
     Vector3 vec = {0};
     if (!node) return vec;
@@ -59,7 +132,7 @@ static Vector3 parse_vector3_json(JsonValue* value) {
     return vec;
 }
 
-static void load_texture_config(JsonValue* tex_val, Texture** texture, Scene* scene) {
+static void load_texture_config(JsonValue* tex_val, int* texture, Scene* scene) {
     if (!tex_val || tex_val->type != JSON_OBJECT) return;
     
     JsonObject* tex_obj = tex_val->value.object;
@@ -68,12 +141,14 @@ static void load_texture_config(JsonValue* tex_val, Texture** texture, Scene* sc
     int success;
     const char* path = json_get_string(path_val, &success);
     if (success && path) {
-        *texture = scene_load_texture(scene, path, TEXTURE_TYPE_COLOR);
+        if (scene_load_texture(scene, path, TEXTURE_TYPE_COLOR)) {
+            *texture = scene->texture_count - 1;
+        }
     }
 }
 
-void load_sphere_config(JsonObject* obj, Scene* scene) {
-    if (!obj) return;
+int load_sphere_config(JsonObject* obj, Scene* scene) {
+    if (!obj) return 1;
     
     JsonValue* center_val = json_object_get(obj, "center");
     JsonValue* radius_val = json_object_get(obj, "radius");
@@ -92,6 +167,13 @@ void load_sphere_config(JsonObject* obj, Scene* scene) {
     
     Sphere sphere = sphere_create(center, radius, color, reflectivity, fresnel_ior, fresnel_power);
     
+    // Shadow casting is on unless explicitly disabled
+    int has_casts_shadow;
+    int casts_shadow = json_get_boolean(json_object_get(obj, "casts_shadow"), &has_casts_shadow);
+    if (has_casts_shadow) {
+        sphere.casts_shadow = casts_shadow;
+    }
+    
     // Load texture if present
     if (texture_val) {
         load_texture_config(texture_val, &sphere.color_texture, scene);
@@ -127,11 +209,11 @@ void load_sphere_config(JsonObject* obj, Scene* scene) {
         }
     }
     
-    scene_add_sphere(scene, sphere);
+    return scene_add_sphere(scene, sphere);
 }
 
-void load_light_config(JsonObject* obj, Scene* scene) {
-    if (!obj) return;
+int load_light_config(JsonObject* obj, Scene* scene) {
+    if (!obj) return 1;
     
     JsonValue* position_val = json_object_get(obj, "position");
     JsonValue* color_val = json_object_get(obj, "color");
@@ -154,7 +236,7 @@ void load_light_config(JsonObject* obj, Scene* scene) {
         light = light_create(position, color, intensity);
     }
     
-    scene_add_light(scene, light);
+    return scene_add_light(scene, light);
 }
 
 AnimationTrack* load_animation_track_config(JsonObject* obj) {
@@ -191,6 +273,14 @@ AnimationTrack* load_animation_track_config(JsonObject* obj) {
     return track;
 }
 
+static int count_xml_children(XmlNode* parent, const char* name) {
+    int count = 0;
+    for (XmlNode* child = parent ? parent->first_child : NULL; child; child = child->next_sibling) {
+        if (strcmp(child->name, name) == 0) count++;
+    }
+    return count;
+}
+
 static Scene* load_scene_from_xml(const char* config_file) {
     XmlDocument* doc = xml_parse_file(config_file);
     if (!doc || !doc->root) {
@@ -211,9 +301,32 @@ static Scene* load_scene_from_xml(const char* config_file) {
         if (aperture) scene->aperture = atof(aperture);
         if (focal_distance) scene->focal_distance = atof(focal_distance);
     }
+
+    // Load sampling settings
+    XmlNode* sampling = xml_find_element(doc->root, "sampling");
+    if (sampling && !load_sampling_xml(sampling, scene)) {
+        xml_free_document(doc);
+        scene_destroy(scene);
+        free(scene);
+        return NULL;
+    }
+
+    const char* refine_hits = xml_get_attribute(doc->root, "refine_hits");
+    if (refine_hits) {
+        scene->refine_hits = strcmp(refine_hits, "false") != 0 && strcmp(refine_hits, "0") != 0;
+    }
     
-    // Load spheres
+    // Size the scene containers before populating them
     XmlNode* spheres = xml_find_element(doc->root, "spheres");
+    XmlNode* lights = xml_find_element(doc->root, "lights");
+    if (!scene_reserve(scene, count_xml_children(spheres, "sphere"), 0, count_xml_children(lights, "light"))) {
+        xml_free_document(doc);
+        scene_destroy(scene);
+        free(scene);
+        return NULL;
+    }
+
+    // Load spheres
     if (spheres) {
         XmlNode* sphere = spheres->first_child;
         while (sphere) {
@@ -230,6 +343,11 @@ static Scene* load_scene_from_xml(const char* config_file) {
                     atof(xml_get_attribute(sphere, "fresnel_power") ?: "1.0")
                 );
                 
+                const char* casts_shadow = xml_get_attribute(sphere, "casts_shadow");
+                if (casts_shadow) {
+                    s.casts_shadow = strcmp(casts_shadow, "false") != 0 && strcmp(casts_shadow, "0") != 0;
+                }
+                
                 // Load pattern configuration if present
                 XmlNode* pattern = xml_find_child(sphere, "pattern");
                 if (pattern) {
@@ -254,14 +372,18 @@ static Scene* load_scene_from_xml(const char* config_file) {
                     }
                 }
                 
-                scene_add_sphere(scene, s);
+                if (!scene_add_sphere(scene, s)) {
+                    xml_free_document(doc);
+                    scene_destroy(scene);
+                    free(scene);
+                    return NULL;
+                }
             }
             sphere = sphere->next_sibling;
         }
     }
     
     // Load lights
-    XmlNode* lights = xml_find_element(doc->root, "lights");
     if (lights) {
         XmlNode* light = lights->first_child;
         while (light) {
@@ -285,7 +407,12 @@ static Scene* load_scene_from_xml(const char* config_file) {
                     l = light_create(pos, col, intensity);
                 }
                 
-                scene_add_light(scene, l);
+                if (!scene_add_light(scene, l)) {
+                    xml_free_document(doc);
+                    scene_destroy(scene);
+                    free(scene);
+                    return NULL;
+                }
             }
             light = light->next_sibling;
         }
@@ -298,7 +425,7 @@ static Scene* load_scene_from_xml(const char* config_file) {
         if (sphere_anims) {
             int anim_index = 0;
             XmlNode* anim = sphere_anims->first_child;
-            while (anim && anim_index < MAX_SPHERES) {
+            while (anim && anim_index < scene->sphere_count) {
                 if (strcmp(anim->name, "animation") == 0) {
                     AnimationTrack* track = animation_track_create();
                     if (track) {
@@ -388,25 +515,56 @@ static Scene* load_scene_from_json(const char* config_file) {
         scene->aperture = get_json_number(aperture_val, scene->aperture);
         scene->focal_distance = get_json_number(focal_distance_val, scene->focal_distance);
     }
+
+    // Load sampling settings
+    JsonValue* sampling_val = json_object_get(root_obj, "sampling");
+    if (sampling_val && sampling_val->type == JSON_OBJECT &&
+        !load_sampling_json(sampling_val->value.object, scene)) {
+        json_free(root);
+        scene_destroy(scene);
+        free(scene);
+        return NULL;
+    }
+
+    int has_refine_hits;
+    int refine_hits = json_get_boolean(json_object_get(root_obj, "refine_hits"), &has_refine_hits);
+    if (has_refine_hits) {
+        scene->refine_hits = refine_hits;
+    }
     
+    // Size the scene containers before populating them
+    JsonArray* spheres_arr = json_get_array(json_object_get(root_obj, "spheres"), NULL);
+    JsonArray* lights_arr = json_get_array(json_object_get(root_obj, "lights"), NULL);
+    if (!scene_reserve(scene, spheres_arr ? (int)spheres_arr->length : 0, 0,
+                       lights_arr ? (int)lights_arr->length : 0)) {
+        json_free(root);
+        scene_destroy(scene);
+        free(scene);
+        return NULL;
+    }
+
     // Load spheres
-    JsonValue* spheres_val = json_object_get(root_obj, "spheres");
-    JsonArray* spheres_arr = json_get_array(spheres_val, NULL);
     if (spheres_arr) {
         for (JsonArrayElement* elem = spheres_arr->head; elem; elem = elem->next) {
-            if (elem->value && elem->value->type == JSON_OBJECT) {
-                load_sphere_config(elem->value->value.object, scene);
+            if (elem->value && elem->value->type == JSON_OBJECT &&
+                !load_sphere_config(elem->value->value.object, scene)) {
+                json_free(root);
+                scene_destroy(scene);
+                free(scene);
+                return NULL;
             }
         }
     }
     
     // Load lights
-    JsonValue* lights_val = json_object_get(root_obj, "lights");
-    JsonArray* lights_arr = json_get_array(lights_val, NULL);
     if (lights_arr) {
         for (JsonArrayElement* elem = lights_arr->head; elem; elem = elem->next) {
-            if (elem->value && elem->value->type == JSON_OBJECT) {
-                load_light_config(elem->value->value.object, scene);
+            if (elem->value && elem->value->type == JSON_OBJECT &&
+                !load_light_config(elem->value->value.object, scene)) {
+                json_free(root);
+                scene_destroy(scene);
+                free(scene);
+                return NULL;
             }
         }
     }
@@ -421,7 +579,7 @@ static Scene* load_scene_from_json(const char* config_file) {
         if (sphere_anims_arr) {
             int anim_index = 0;
             for (JsonArrayElement* elem = sphere_anims_arr->head; 
-                 elem && anim_index < MAX_SPHERES; 
+                 elem && anim_index < scene->sphere_count; 
                  elem = elem->next, anim_index++) {
                 if (elem->value && elem->value->type == JSON_OBJECT) {
                     scene->sphere_animations[anim_index] = 
@@ -7,11 +7,11 @@
 // Function to load scene from configuration file (JSON or XML)
 Scene* load_scene_from_config(const char* config_file);
 
-// Function to load sphere configuration
-void load_sphere_config(JsonObject* sphere_obj, Scene* scene);
+// Function to load sphere configuration; returns 0 if the sphere could not be added
+int load_sphere_config(JsonObject* sphere_obj, Scene* scene);
 
-// Function to load light configuration
-void load_light_config(JsonObject* light_obj, Scene* scene);
+// Function to load light configuration; returns 0 if the light could not be added
+int load_light_config(JsonObject* light_obj, Scene* scene);
 
 // Function to load animation track configuration
 AnimationTrack* load_animation_track_config(JsonObject* anim_obj);
@@ -0,0 +1,398 @@
+#include "scene_image.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define SCENE_IMAGE_MAGIC "RTSI"
+#define SCENE_IMAGE_VERSION 1
+#define SCENE_IMAGE_ALIGNMENT 64  // Arrays start on their own cache lines
+
+// Bytes from the start of the image. The header sits at offset 0, so 0 also
+// stands for an absent array.
+typedef uint64_t SceneImageOffset;
+
+typedef struct {
+    SceneImageOffset keyframes;
+    int32_t keyframe_count;
+    int32_t present;  // 0 for an object without a track
+    double duration;
+} SceneImageTrack;
+
+typedef struct {
+    SceneImageOffset data;  // Three bytes per texel, as loaded
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t type;
+} SceneImageTexture;
+
+typedef struct {
+    SceneImageOffset nodes;
+    SceneImageOffset indices;
+    int32_t node_count;
+    int32_t index_count;
+    BVHStats stats;
+} SceneImageBVH;
+
+// A mesh's placement, material and read-only geometry. Vertex and index
+// buffers only serve loading and saving, and stay out of the image.
+typedef struct {
+    SceneImageOffset triangles;
+    int32_t triangle_count;
+    int32_t normal_map;
+    SceneImageBVH bvh;
+    SceneImageOffset triangle_batch;  // v0, edge1 and edge2 axes, triangle_batch_stride slots each
+    int32_t triangle_batch_count;
+    int32_t triangle_batch_stride;
+    Vector3 position;
+    Vector3 rotation;
+    Vector3 scale;
+    Vector3 color;
+    double reflectivity;
+    double fresnel_ior;
+    double fresnel_power;
+    int32_t use_smooth_shading;
+    int32_t casts_shadow;
+    MeshTransform transform;
+} SceneImageMesh;
+
+typedef struct {
+    char magic[4];
+    int32_t version;
+    uint64_t size;
+    int32_t component_size;  // sizeof(vector_real) of the build that wrote the image
+
+    double aperture;
+    double focal_distance;
+    Vector3 background_color;
+    AnimationState animation_state;
+    double motion_blur_intensity;
+    int32_t refine_hits;
+    int32_t samples_per_pixel;
+    int32_t min_samples_per_pixel;
+    double adaptive_threshold;
+
+    int32_t sphere_count;
+    int32_t light_count;
+    int32_t mesh_count;
+    int32_t texture_count;
+    SceneImageOffset spheres;        // Sphere records, used in place
+    SceneImageOffset lights;         // Light records, used in place
+    SceneImageOffset meshes;         // SceneImageMesh records
+    SceneImageOffset textures;       // SceneImageTexture records
+    SceneImageOffset environment_map;  // One SceneImageTexture, if any
+    SceneImageOffset sphere_tracks;  // SceneImageTrack records, parallel to spheres
+    SceneImageOffset light_tracks;
+    SceneImageOffset mesh_tracks;
+} SceneImageHeader;
+
+// Lays the image out, first with no base to measure it, then again to fill
+// the mapping, so both passes agree on every offset
+typedef struct {
+    unsigned char* base;  // NULL while measuring
+    size_t size;
+} SceneImageWriter;
+
+// Append size bytes copied from data (left zeroed when data is NULL)
+static SceneImageOffset scene_image_place(SceneImageWriter* writer, const void* data, size_t size) {
+    if (size == 0) return 0;
+    size_t offset = (writer->size + SCENE_IMAGE_ALIGNMENT - 1) & ~(size_t)(SCENE_IMAGE_ALIGNMENT - 1);
+    if (writer->base && data) {
+        memcpy(writer->base + offset, data, size);
+    }
+    writer->size = offset + size;
+    return offset;
+}
+
+// Fill in one record of an array placed earlier
+static void scene_image_store(SceneImageWriter* writer, SceneImageOffset array, int index,
+                              const void* record, size_t size) {
+    if (writer->base) {
+        memcpy(writer->base + array + (size_t)index * size, record, size);
+    }
+}
+
+static SceneImageOffset scene_image_write_tracks(SceneImageWriter* writer, AnimationTrack* const* tracks,
+                                                 int count) {
+    SceneImageOffset records = scene_image_place(writer, NULL, (size_t)count * sizeof(SceneImageTrack));
+    for (int i = 0; i < count; i++) {
+        SceneImageTrack record = {0};
+        if (tracks[i]) {
+            record.keyframes = scene_image_place(writer, tracks[i]->keyframes,
+                                                 (size_t)tracks[i]->keyframe_count * sizeof(Keyframe));
+            record.keyframe_count = tracks[i]->keyframe_count;
+            record.present = 1;
+            record.duration = tracks[i]->duration;
+        }
+        scene_image_store(writer, records, i, &record, sizeof(record));
+    }
+    return records;
+}
+
+static SceneImageTexture scene_image_write_texture(SceneImageWriter* writer, const Texture* texture) {
+    SceneImageTexture record = {0};
+    if (texture->data) {
+        // Textures are always loaded with three components, whatever the file held
+        record.data = scene_image_place(writer, texture->data, (size_t)texture->width * texture->height * 3);
+    }
+    record.width = texture->width;
+    record.height = texture->height;
+    record.channels = texture->channels;
+    record.type = texture->type;
+    return record;
+}
+
+static SceneImageBVH scene_image_write_bvh(SceneImageWriter* writer, const BVH* bvh) {
+    SceneImageBVH record = {0};
+    record.nodes = scene_image_place(writer, bvh->nodes, (size_t)bvh->node_count * sizeof(BVHNode));
+    record.indices = scene_image_place(writer, bvh->indices, (size_t)bvh->index_count * sizeof(int));
+    record.node_count = bvh->node_count;
+    record.index_count = bvh->index_count;
+    record.stats = bvh->stats;
+    return record;
+}
+
+static SceneImageMesh scene_image_write_mesh(SceneImageWriter* writer, const Mesh* mesh) {
+    SceneImageMesh record;
+    memset(&record, 0, sizeof(record));
+    record.triangles = scene_image_place(writer, mesh->triangles, (size_t)mesh->triangle_count * sizeof(Triangle));
+    record.triangle_count = mesh->triangle_count;
+    record.normal_map = mesh->normal_map;
+    record.bvh = scene_image_write_bvh(writer, &mesh->bvh);
+
+    // The batch is one block of nine axis arrays (see mesh_build_triangle_batch)
+    const TriangleBatch* batch = &mesh->triangle_batch;
+    if (batch->v0[0]) {
+        int stride = batch->count + TRIANGLE_BATCH_WIDTH - 1;
+        record.triangle_batch = scene_image_place(writer, batch->v0[0], (size_t)stride * 9 * sizeof(vector_real));
+        record.triangle_batch_count = batch->count;
+        record.triangle_batch_stride = stride;
+    }
+
+    record.position = mesh->position;
+    record.rotation = mesh->rotation;
+    record.scale = mesh->scale;
+    record.color = mesh->color;
+    record.reflectivity = mesh->reflectivity;
+    record.fresnel_ior = mesh->fresnel_ior;
+    record.fresnel_power = mesh->fresnel_power;
+    record.use_smooth_shading = mesh->use_smooth_shading;
+    record.casts_shadow = mesh->casts_shadow;
+    record.transform = mesh->transform;
+    return record;
+}
+
+static void scene_image_write(SceneImageWriter* writer, const Scene* scene) {
+    scene_image_place(writer, NULL, sizeof(SceneImageHeader));  // Filled in last, at offset 0
+
+    SceneImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENE_IMAGE_MAGIC, 4);
+    header.version = SCENE_IMAGE_VERSION;
+    header.component_size = (int32_t)sizeof(vector_real);
+    header.aperture = scene->aperture;
+    header.focal_distance = scene->focal_distance;
+    header.background_color = scene->background_color;
+    header.animation_state = scene->animation_state;
+    header.motion_blur_intensity = scene->motion_blur_intensity;
+    header.refine_hits = scene->refine_hits;
+    header.samples_per_pixel = scene->samples_per_pixel;
+    header.min_samples_per_pixel = scene->min_samples_per_pixel;
+    header.adaptive_threshold = scene->adaptive_threshold;
+
+    header.sphere_count = scene->sphere_count;
+    header.light_count = scene->light_count;
+    header.mesh_count = scene->mesh_count;
+    header.texture_count = scene->texture_count;
+    header.spheres = scene_image_place(writer, scene->spheres, (size_t)scene->sphere_count * sizeof(Sphere));
+    header.lights = scene_image_place(writer, scene->lights, (size_t)scene->light_count * sizeof(Light));
+    header.sphere_tracks = scene_image_write_tracks(writer, scene->sphere_animations, scene->sphere_count);
+    header.light_tracks = scene_image_write_tracks(writer, scene->light_animations, scene->light_count);
+    header.mesh_tracks = scene_image_write_tracks(writer, scene->mesh_animations, scene->mesh_count);
+
+    header.textures = scene_image_place(writer, NULL, (size_t)scene->texture_count * sizeof(SceneImageTexture));
+    for (int i = 0; i < scene->texture_count; i++) {
+        SceneImageTexture record = scene_image_write_texture(writer, scene->textures[i]);
+        scene_image_store(writer, header.textures, i, &record, sizeof(record));
+    }
+    if (scene->environment_map) {
+        header.environment_map = scene_image_place(writer, NULL, sizeof(SceneImageTexture));
+        SceneImageTexture record = scene_image_write_texture(writer, scene->environment_map);
+        scene_image_store(writer, header.environment_map, 0, &record, sizeof(record));
+    }
+
+    header.meshes = scene_image_place(writer, NULL, (size_t)scene->mesh_count * sizeof(SceneImageMesh));
+    for (int i = 0; i < scene->mesh_count; i++) {
+        SceneImageMesh record = scene_image_write_mesh(writer, &scene->meshes[i]);
+        scene_image_store(writer, header.meshes, i, &record, sizeof(record));
+    }
+
+    header.size = writer->size;
+    scene_image_store(writer, 0, 0, &header, sizeof(header));
+}
+
+int scene_image_create(SceneImage* image, const Scene* scene) {
+    SceneImageWriter writer = {NULL, 0};
+    scene_image_write(&writer, scene);
+
+    // Anonymous shared memory is inherited by forked processes as the same
+    // pages, and starts zeroed
+    void* base = mmap(NULL, writer.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map a %zu byte scene image\n", writer.size);
+        return 0;
+    }
+    writer.base = (unsigned char*)base;
+    writer.size = 0;
+    scene_image_write(&writer, scene);
+
+    // Views only ever read the image; a stray write faults instead of
+    // silently changing every process's scene
+    mprotect(base, writer.size, PROT_READ);
+    image->base = base;
+    image->size = writer.size;
+    return 1;
+}
+
+// Private track records whose keyframes stay in the image
+static int scene_image_attach_tracks(const unsigned char* base, SceneImageOffset records, int count,
+                                     Arena* arena, AnimationTrack*** tracks) {
+    *tracks = (AnimationTrack**)arena_alloc(arena, (size_t)count * sizeof(AnimationTrack*));
+    if (!*tracks) return 0;
+    for (int i = 0; i < count; i++) {
+        const SceneImageTrack* record = (const SceneImageTrack*)(base + records) + i;
+        if (!record->present) continue;
+        AnimationTrack* track = (AnimationTrack*)arena_alloc(arena, sizeof(AnimationTrack));
+        if (!track) return 0;
+        track->keyframes = record->keyframes ? (Keyframe*)(base + record->keyframes) : NULL;
+        track->keyframe_count = record->keyframe_count;
+        track->max_keyframes = record->keyframe_count;
+        track->duration = record->duration;
+        (*tracks)[i] = track;
+    }
+    return 1;
+}
+
+static Texture* scene_image_attach_texture(const unsigned char* base, const SceneImageTexture* record,
+                                           Arena* arena) {
+    Texture* texture = (Texture*)arena_alloc(arena, sizeof(Texture));
+    if (!texture) return NULL;
+    texture->data = record->data ? (unsigned char*)(base + record->data) : NULL;
+    texture->width = record->width;
+    texture->height = record->height;
+    texture->channels = record->channels;
+    texture->type = record->type;
+    return texture;
+}
+
+static Mesh scene_image_attach_mesh(const unsigned char* base, const SceneImageMesh* record) {
+    Mesh mesh = mesh_create(record->position, record->rotation, record->scale, record->color,
+                            record->reflectivity);
+    mesh.triangles = record->triangles ? (Triangle*)(base + record->triangles) : NULL;
+    mesh.triangle_count = mesh.triangle_capacity = record->triangle_count;
+    mesh.fresnel_ior = record->fresnel_ior;
+    mesh.fresnel_power = record->fresnel_power;
+    mesh.normal_map = record->normal_map;
+    mesh.use_smooth_shading = record->use_smooth_shading;
+    mesh.casts_shadow = record->casts_shadow;
+    mesh.transform = record->transform;
+
+    mesh.bvh.nodes = record->bvh.nodes ? (BVHNode*)(base + record->bvh.nodes) : NULL;
+    mesh.bvh.indices = record->bvh.indices ? (int*)(base + record->bvh.indices) : NULL;
+    mesh.bvh.node_count = record->bvh.node_count;
+    mesh.bvh.index_count = record->bvh.index_count;
+    mesh.bvh.stats = record->bvh.stats;
+
+    if (record->triangle_batch) {
+        vector_real* data = (vector_real*)(base + record->triangle_batch);
+        size_t stride = (size_t)record->triangle_batch_stride;
+        for (int axis = 0; axis < 3; axis++) {
+            mesh.triangle_batch.v0[axis] = data + axis * stride;
+            mesh.triangle_batch.edge1[axis] = data + (3 + axis) * stride;
+            mesh.triangle_batch.edge2[axis] = data + (6 + axis) * stride;
+        }
+        mesh.triangle_batch.count = record->triangle_batch_count;
+    }
+    return mesh;
+}
+
+int scene_image_attach(const SceneImage* image, Scene* scene) {
+    const unsigned char* base = (const unsigned char*)image->base;
+    const SceneImageHeader* header = (const SceneImageHeader*)base;
+    if (image->size < sizeof(SceneImageHeader) || memcmp(header->magic, SCENE_IMAGE_MAGIC, 4) != 0 ||
+        header->version != SCENE_IMAGE_VERSION || header->size != image->size ||
+        header->component_size != (int32_t)sizeof(vector_real)) {
+        fprintf(stderr, "Error: Scene image is damaged or from another build\n");
+        return 0;
+    }
+
+    *scene = scene_create();
+    scene->mapped = 1;
+    scene->aperture = header->aperture;
+    scene->focal_distance = header->focal_distance;
+    scene->background_color = header->background_color;
+    scene->animation_state = header->animation_state;
+    scene->motion_blur_intensity = header->motion_blur_intensity;
+    scene->refine_hits = header->refine_hits;
+    scene->samples_per_pixel = header->samples_per_pixel;
+    scene->min_samples_per_pixel = header->min_samples_per_pixel;
+    scene->adaptive_threshold = header->adaptive_threshold;
+
+    // Sphere and light records hold no pointers, so the view uses the
+    // image's copies directly; the mapping is read-only, as is rendering
+    scene->spheres = header->spheres ? (Sphere*)(base + header->spheres) : NULL;
+    scene->sphere_count = scene->sphere_capacity = header->sphere_count;
+    scene->lights = header->lights ? (Light*)(base + header->lights) : NULL;
+    scene->light_count = scene->light_capacity = header->light_count;
+
+    Arena* arena = &scene->arena;
+    scene->sphere_centers = arena_alloc(arena, (size_t)header->sphere_count * sizeof(*scene->sphere_centers));
+    scene->light_positions = arena_alloc(arena, (size_t)header->light_count * sizeof(*scene->light_positions));
+    int ok = scene->sphere_centers && scene->light_positions &&
+             scene_image_attach_tracks(base, header->sphere_tracks, header->sphere_count, arena,
+                                       &scene->sphere_animations) &&
+             scene_image_attach_tracks(base, header->light_tracks, header->light_count, arena,
+                                       &scene->light_animations) &&
+             scene_image_attach_tracks(base, header->mesh_tracks, header->mesh_count, arena,
+                                       &scene->mesh_animations);
+
+    scene->textures = ok ? (Texture**)arena_alloc(arena, (size_t)header->texture_count * sizeof(Texture*)) : NULL;
+    ok = ok && scene->textures;
+    for (int i = 0; ok && i < header->texture_count; i++) {
+        const SceneImageTexture* record = (const SceneImageTexture*)(base + header->textures) + i;
+        scene->textures[i] = scene_image_attach_texture(base, record, arena);
+        ok = scene->textures[i] != NULL;
+        scene->texture_count = scene->texture_capacity = i + 1;
+    }
+    if (ok && header->environment_map) {
+        const SceneImageTexture* record = (const SceneImageTexture*)(base + header->environment_map);
+        scene->environment_map = scene_image_attach_texture(base, record, arena);
+        ok = scene->environment_map != NULL;
+    }
+
+    scene->meshes = ok ? (Mesh*)arena_alloc(arena, (size_t)header->mesh_count * sizeof(Mesh)) : NULL;
+    scene->mesh_instances = ok ? arena_alloc(arena, (size_t)header->mesh_count * sizeof(*scene->mesh_instances))
+                               : NULL;
+    ok = ok && scene->meshes && scene->mesh_instances;
+    for (int i = 0; ok && i < header->mesh_count; i++) {
+        const SceneImageMesh* record = (const SceneImageMesh*)(base + header->meshes) + i;
+        scene->meshes[i] = scene_image_attach_mesh(base, record);
+        scene->mesh_count = scene->mesh_capacity = i + 1;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Could not allocate a view of the scene image\n");
+        scene_destroy(scene);
+        return 0;
+    }
+    return scene_build_bvh(scene);
+}
+
+void scene_image_release(SceneImage* image) {
+    if (image->base) {
+        munmap(image->base, image->size);
+    }
+    image->base = NULL;
+    image->size = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef SCENE_IMAGE_H
+#define SCENE_IMAGE_H
+
+#include "scene.h"
+#include <stddef.h>
+
+// Position-independent snapshot of a loaded scene in a single shared
+// mapping. Everything the image refers to is stored inside it and addressed
+// by byte offset from its start, so it holds no pointers and reads the same
+// wherever a process maps it. Processes forked after scene_image_create share
+// its pages, and the scene data is never copied per process.
+typedef struct {
+    void* base;
+    size_t size;
+} SceneImage;
+
+// Copy scene, with its mesh hierarchies built, into a new shared mapping,
+// which is then made read-only. Returns 0 on failure.
+int scene_image_create(SceneImage* image, const Scene* scene);
+
+// Set scene up as a view of image, ready to render. Spheres, lights, mesh
+// geometry and hierarchies, texels and keyframes are read in place from the
+// mapping; only per-object records, pose caches and the top-level BVH,
+// which are re-posed every frame, are private to the view. Release the view with
+// scene_destroy before the image. Returns 0 on failure.
+int scene_image_attach(const SceneImage* image, Scene* scene);
+
+void scene_image_release(SceneImage* image);
+
+#endif
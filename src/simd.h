@@ -0,0 +1,65 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "vector.h"
+
+// Register-wide operations on vector_real for the batched intersection
+// kernels, so each kernel is written once for both component types. An AVX2
+// register holds 4 doubles, or 8 floats in VECTOR_FLOAT builds. Without AVX2
+// the kernels use their scalar loops and SIMD_WIDTH is 1.
+#ifdef __AVX2__
+#include <immintrin.h>
+
+#ifdef VECTOR_FLOAT
+#define SIMD_WIDTH 8
+typedef __m256 SimdReal;
+
+static inline SimdReal simd_set1(vector_real x) { return _mm256_set1_ps(x); }
+static inline SimdReal simd_load(const vector_real* p) { return _mm256_loadu_ps(p); }
+static inline void simd_store(vector_real* p, SimdReal a) { _mm256_storeu_ps(p, a); }
+static inline SimdReal simd_add(SimdReal a, SimdReal b) { return _mm256_add_ps(a, b); }
+static inline SimdReal simd_sub(SimdReal a, SimdReal b) { return _mm256_sub_ps(a, b); }
+static inline SimdReal simd_mul(SimdReal a, SimdReal b) { return _mm256_mul_ps(a, b); }
+static inline SimdReal simd_div(SimdReal a, SimdReal b) { return _mm256_div_ps(a, b); }
+static inline SimdReal simd_sqrt(SimdReal a) { return _mm256_sqrt_ps(a); }
+static inline SimdReal simd_fmadd(SimdReal a, SimdReal b, SimdReal c) { return _mm256_fmadd_ps(a, b, c); }
+static inline SimdReal simd_fmsub(SimdReal a, SimdReal b, SimdReal c) { return _mm256_fmsub_ps(a, b, c); }
+static inline SimdReal simd_negate(SimdReal a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+static inline SimdReal simd_abs(SimdReal a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline SimdReal simd_and(SimdReal a, SimdReal b) { return _mm256_and_ps(a, b); }
+static inline SimdReal simd_select(SimdReal mask, SimdReal a, SimdReal b) { return _mm256_blendv_ps(b, a, mask); }
+static inline SimdReal simd_less(SimdReal a, SimdReal b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline SimdReal simd_less_equal(SimdReal a, SimdReal b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline SimdReal simd_greater(SimdReal a, SimdReal b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline SimdReal simd_greater_equal(SimdReal a, SimdReal b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline int simd_mask(SimdReal a) { return _mm256_movemask_ps(a); }
+#else
+#define SIMD_WIDTH 4
+typedef __m256d SimdReal;
+
+static inline SimdReal simd_set1(vector_real x) { return _mm256_set1_pd(x); }
+static inline SimdReal simd_load(const vector_real* p) { return _mm256_loadu_pd(p); }
+static inline void simd_store(vector_real* p, SimdReal a) { _mm256_storeu_pd(p, a); }
+static inline SimdReal simd_add(SimdReal a, SimdReal b) { return _mm256_add_pd(a, b); }
+static inline SimdReal simd_sub(SimdReal a, SimdReal b) { return _mm256_sub_pd(a, b); }
+static inline SimdReal simd_mul(SimdReal a, SimdReal b) { return _mm256_mul_pd(a, b); }
+static inline SimdReal simd_div(SimdReal a, SimdReal b) { return _mm256_div_pd(a, b); }
+static inline SimdReal simd_sqrt(SimdReal a) { return _mm256_sqrt_pd(a); }
+static inline SimdReal simd_fmadd(SimdReal a, SimdReal b, SimdReal c) { return _mm256_fmadd_pd(a, b, c); }
+static inline SimdReal simd_fmsub(SimdReal a, SimdReal b, SimdReal c) { return _mm256_fmsub_pd(a, b, c); }
+static inline SimdReal simd_negate(SimdReal a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+static inline SimdReal simd_abs(SimdReal a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+static inline SimdReal simd_and(SimdReal a, SimdReal b) { return _mm256_and_pd(a, b); }
+static inline SimdReal simd_select(SimdReal mask, SimdReal a, SimdReal b) { return _mm256_blendv_pd(b, a, mask); }
+static inline SimdReal simd_less(SimdReal a, SimdReal b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+static inline SimdReal simd_less_equal(SimdReal a, SimdReal b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+static inline SimdReal simd_greater(SimdReal a, SimdReal b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+static inline SimdReal simd_greater_equal(SimdReal a, SimdReal b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+static inline int simd_mask(SimdReal a) { return _mm256_movemask_pd(a); }
+#endif
+
+#else
+#define SIMD_WIDTH 1
+#endif
+
+#endif
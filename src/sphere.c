@@ -1,6 +1,7 @@
 #include "sphere.h"
 #include "vector.h"
 #include "scene.h"  // For Texture type
+#include "double_double.h"
 #include <math.h>
 
 // Create a new sphere
@@ -14,11 +15,12 @@ Sphere sphere_create(Vector3 center, double radius, Vector3 color, double reflec
         .fresnel_ior = fresnel_ior,
         .fresnel_power = fresnel_power,
         .texture_scale = 1.0,
-        .color_texture = NULL,
+        .color_texture = -1,
         .dispersion = 0.0,
         .metallic = 0.0,
         .roughness = 0.5,
         .glossiness = 0.5,
+        .casts_shadow = 1,
         .pattern = {
             .type = PATTERN_SOLID,
             .scale = 1.0,
@@ -29,6 +31,15 @@ Sphere sphere_create(Vector3 center, double radius, Vector3 color, double reflec
     return sphere;
 }
 
+AABB sphere_bounds(const Sphere* sphere) {
+    Vector3 extent = {sphere->radius, sphere->radius, sphere->radius};
+    AABB box = {
+        .min = vector_subtract(sphere->center, extent),
+        .max = vector_add(sphere->center, extent)
+    };
+    return box;
+}
+
 // Calculate UV coordinates for sphere texture mapping
 Vector2Double calculate_sphere_uv(Vector3 point, Vector3 center, double scale) {
     const double POLE_EPSILON = 1e-6;
@@ -115,29 +126,30 @@ Vector3 sample_texture(Vector2Double tex_coord, Texture* texture) {
     return color;
 }
 
-// Sphere intersection test with improved precision
+// Sphere intersection test with improved precision. The root solve runs in
+// the component precision, as the batched kernel does.
 int sphere_intersect(Sphere* sphere, Ray ray, double t_min, double t_max, Hit* hit) {
     const double INTERSECTION_EPSILON = 1e-8;
     
     Vector3 oc = vector_subtract(ray.origin, sphere->center);
-    double a = vector_dot(ray.direction, ray.direction);
+    vector_real a = vector_dot(ray.direction, ray.direction);
     
     // Check for degenerate ray direction
     if (a < INTERSECTION_EPSILON) {
         return 0;
     }
     
-    double b = vector_dot(oc, ray.direction);
-    double c = vector_dot(oc, oc) - sphere->radius * sphere->radius;
-    double discriminant = b*b - a*c;
+    vector_real b = vector_dot(oc, ray.direction);
+    vector_real c = vector_dot(oc, oc) - (vector_real)(sphere->radius * sphere->radius);
+    vector_real discriminant = b*b - a*c;
     
     // Check for near-zero discriminant
     if (discriminant < INTERSECTION_EPSILON) {
         return 0;
     }
     
-    double sqrt_discriminant = sqrt(discriminant);
-    double inv_a = 1.0 / a;
+    vector_real sqrt_discriminant = VECTOR_SQRT(discriminant);
+    vector_real inv_a = 1.0 / a;
     
     // Try both intersection points
     double temp = (-b - sqrt_discriminant) * inv_a;
@@ -151,8 +163,6 @@ int sphere_intersect(Sphere* sphere, Ray ray, double t_min, double t_max, Hit* h
         
         // Calculate UV coordinates
         hit->tex_coord = calculate_sphere_uv(hit->point, sphere->center, sphere->texture_scale);
-        
-        hit->sphere = sphere;
         return 1;
     }
     
@@ -167,10 +177,171 @@ int sphere_intersect(Sphere* sphere, Ray ray, double t_min, double t_max, Hit* h
         
         // Calculate UV coordinates
         hit->tex_coord = calculate_sphere_uv(hit->point, sphere->center, sphere->texture_scale);
-        
-        hit->sphere = sphere;
         return 1;
     }
     
     return 0;
 }
+
+// Same roots and bounds as sphere_intersect, without the hit attributes
+int sphere_occludes(const Sphere* sphere, const Ray* ray, double t_min, double t_max) {
+    const double INTERSECTION_EPSILON = 1e-8;
+
+    Vector3 oc = vector_subtract(ray->origin, sphere->center);
+    vector_real a = vector_dot(ray->direction, ray->direction);
+    if (a < INTERSECTION_EPSILON) {
+        return 0;
+    }
+
+    vector_real b = vector_dot(oc, ray->direction);
+    vector_real c = vector_dot(oc, oc) - (vector_real)(sphere->radius * sphere->radius);
+    vector_real discriminant = b*b - a*c;
+    if (discriminant < INTERSECTION_EPSILON) {
+        return 0;
+    }
+
+    vector_real sqrt_discriminant = VECTOR_SQRT(discriminant);
+    vector_real inv_a = 1.0 / a;
+    double t0 = (-b - sqrt_discriminant) * inv_a;
+    double t1 = (-b + sqrt_discriminant) * inv_a;
+    return (t0 < t_max && t0 > t_min) || (t1 < t_max && t1 > t_min);
+}
+
+void sphere_refine_hit(const Sphere* sphere, const Ray* ray, Hit* hit) {
+    DoubleDoubleVector3 origin = dd_vector_from(ray->origin);
+    DoubleDoubleVector3 direction = dd_vector_from(ray->direction);
+    DoubleDoubleVector3 oc = dd_vector_subtract(origin, dd_vector_from(sphere->center));
+
+    DoubleDouble a = dd_vector_dot(direction, direction);
+    DoubleDouble b = dd_vector_dot(oc, direction);
+    DoubleDouble c = dd_subtract(dd_vector_dot(oc, oc), dd_two_prod(sphere->radius, sphere->radius));
+    DoubleDouble discriminant = dd_subtract(dd_multiply(b, b), dd_multiply(a, c));
+    if (discriminant.hi <= 0.0 || a.hi <= 0.0) return;
+
+    // Cancellation-free roots q / a and c / q; keep whichever the double
+    // test found
+    DoubleDouble root = dd_sqrt(discriminant);
+    DoubleDouble q = dd_negate(b.hi < 0.0 ? dd_subtract(b, root) : dd_add(b, root));
+    if (q.hi == 0.0) return;
+    DoubleDouble t0 = dd_divide(q, a);
+    DoubleDouble t1 = dd_divide(c, q);
+    DoubleDouble t = fabs(dd_to_double(t0) - hit->t) <= fabs(dd_to_double(t1) - hit->t) ? t0 : t1;
+
+    DoubleDoubleVector3 point = dd_ray_point_at(origin, direction, t);
+    hit->t = dd_to_double(t);
+    hit->point = dd_vector_to(point);
+    // The normal follows the refined point, taken relative to the center
+    // before rounding so large coordinates keep its low bits
+    hit->normal = vector_normalize(dd_vector_to(dd_vector_subtract(point, dd_vector_from(sphere->center))));
+}
+
+// The batched kernel mirrors sphere_intersect operation for operation,
+// including its fma-based dot products, so both agree on every hit.
+// radius_squared selects which spheres take part; any_hit stops at the
+// first pass that finds a hit.
+static int sphere_batch_test(const SphereBatch* batch, const vector_real* radius_squared, int any_hit,
+                             int first, int count, const Ray* ray, double t_min, double t_max,
+                             int* hit_slot, double* hit_t) {
+    const double INTERSECTION_EPSILON = 1e-8;
+    Vector3 o = ray->origin;
+    Vector3 d = ray->direction;
+
+    vector_real a = VECTOR_FMA(d.x, d.x, VECTOR_FMA(d.y, d.y, d.z * d.z));
+    if (a < INTERSECTION_EPSILON) {
+        return 0;
+    }
+    vector_real inv_a = 1.0 / a;
+
+    int best = -1;
+    double closest = t_max;
+    int end = first + count;
+    int slot = first;
+
+#ifdef __AVX2__
+    const SimdReal ox = simd_set1(o.x), oy = simd_set1(o.y), oz = simd_set1(o.z);
+    const SimdReal dx = simd_set1(d.x), dy = simd_set1(d.y), dz = simd_set1(d.z);
+    const SimdReal va = simd_set1(a);
+    const SimdReal vinv_a = simd_set1(inv_a);
+    const SimdReal eps = simd_set1(INTERSECTION_EPSILON);
+    const SimdReal lo = simd_set1(t_min);
+    const SimdReal miss = simd_set1(INFINITY);
+
+    // Padding makes whole-register loads past the leaf safe; surplus lanes
+    // are discarded below
+    for (; slot < end; slot += SPHERE_BATCH_WIDTH) {
+        SimdReal ocx = simd_sub(ox, simd_load(batch->center_x + slot));
+        SimdReal ocy = simd_sub(oy, simd_load(batch->center_y + slot));
+        SimdReal ocz = simd_sub(oz, simd_load(batch->center_z + slot));
+
+        SimdReal b = simd_fmadd(ocx, dx, simd_fmadd(ocy, dy, simd_mul(ocz, dz)));
+        SimdReal c = simd_sub(simd_fmadd(ocx, ocx, simd_fmadd(ocy, ocy, simd_mul(ocz, ocz))),
+                              simd_load(radius_squared + slot));
+        SimdReal disc = simd_sub(simd_mul(b, b), simd_mul(va, c));
+        SimdReal live = simd_greater_equal(disc, eps);
+        if (simd_mask(live) == 0) continue;
+
+        SimdReal root = simd_sqrt(disc);
+        SimdReal neg_b = simd_negate(b);
+        SimdReal t0 = simd_mul(simd_sub(neg_b, root), vinv_a);
+        SimdReal t1 = simd_mul(simd_add(neg_b, root), vinv_a);
+
+        // Nearer root if it is in range, else the farther one
+        SimdReal hi = simd_set1(closest);
+        SimdReal in0 = simd_and(simd_less(t0, hi), simd_greater(t0, lo));
+        SimdReal in1 = simd_and(simd_less(t1, hi), simd_greater(t1, lo));
+        SimdReal t = simd_select(in0, t0, simd_select(in1, t1, miss));
+        t = simd_select(live, t, miss);
+        if (simd_mask(simd_less(t, hi)) == 0) continue;
+
+        vector_real lanes[SPHERE_BATCH_WIDTH];
+        simd_store(lanes, t);
+        for (int lane = 0; lane < SPHERE_BATCH_WIDTH && slot + lane < end; lane++) {
+            if (lanes[lane] < closest) {
+                closest = lanes[lane];
+                best = slot + lane;
+            }
+        }
+        if (any_hit && best >= 0) break;
+    }
+#else
+    for (; slot < end; slot++) {
+        vector_real ocx = o.x - batch->center_x[slot];
+        vector_real ocy = o.y - batch->center_y[slot];
+        vector_real ocz = o.z - batch->center_z[slot];
+
+        vector_real b = VECTOR_FMA(ocx, d.x, VECTOR_FMA(ocy, d.y, ocz * d.z));
+        vector_real c = VECTOR_FMA(ocx, ocx, VECTOR_FMA(ocy, ocy, ocz * ocz)) - radius_squared[slot];
+        vector_real disc = b * b - a * c;
+        if (disc < INTERSECTION_EPSILON) continue;
+
+        vector_real root = VECTOR_SQRT(disc);
+        double t = (-b - root) * inv_a;
+        if (!(t < closest && t > t_min)) {
+            t = (-b + root) * inv_a;
+            if (!(t < closest && t > t_min)) continue;
+        }
+        closest = t;
+        best = slot;
+        if (any_hit) break;
+    }
+#endif
+
+    if (best < 0) return 0;
+    *hit_slot = best;
+    *hit_t = closest;
+    return 1;
+}
+
+int sphere_batch_intersect(const SphereBatch* batch, int first, int count, const Ray* ray,
+                           double t_min, double t_max, int* hit_slot, double* hit_t) {
+    return sphere_batch_test(batch, batch->radius_squared, 0, first, count, ray, t_min, t_max,
+                             hit_slot, hit_t);
+}
+
+int sphere_batch_occluded(const SphereBatch* batch, int first, int count, const Ray* ray,
+                          double t_min, double t_max) {
+    int slot;
+    double t;
+    return sphere_batch_test(batch, batch->shadow_radius_squared, 1, first, count, ray, t_min, t_max,
+                             &slot, &t);
+}
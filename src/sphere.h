@@ -3,6 +3,8 @@
 
 #include "common.h"
 #include "ray.h"
+#include "bvh.h"
+#include "simd.h"
 #include <stddef.h>
 
 // Pattern type enumeration
@@ -36,11 +38,29 @@ typedef struct Sphere {
     double glossiness;     // Controls the sharpness of reflections (0-1)
     double roughness;      // Surface roughness for microfacet BRDF
     double metallic;       // Metallic factor for PBR
-    Texture* color_texture;// Color texture map
+    int color_texture;     // Index into the scene's textures, or -1 for none
     double texture_scale;  // Texture tiling scale
     Pattern pattern;       // Material pattern
+    int casts_shadow;      // 0 leaves the sphere out of shadow rays
 } Sphere;
 
+// Spheres tested per pass of the batched kernel: one AVX2 register of
+// components, or one at a time where the scalar fallback is compiled in
+#define SPHERE_BATCH_WIDTH SIMD_WIDTH
+
+// Hot intersection data for many spheres, split from the material-heavy
+// Sphere records into structure-of-arrays form. Slots that hold no batchable
+// sphere carry a radius_squared of -INFINITY and can never be hit. Arrays hold
+// SPHERE_BATCH_WIDTH - 1 such slots past count so whole batches can be loaded.
+typedef struct {
+    vector_real* center_x;
+    vector_real* center_y;
+    vector_real* center_z;
+    vector_real* radius_squared;
+    vector_real* shadow_radius_squared;  // As radius_squared, minus spheres that cast no shadow
+    int count;
+} SphereBatch;
+
 // Function declarations
 Vector3 sample_texture(Vector2Double tex_coord, Texture* texture);
 Vector2Double calculate_sphere_uv(Vector3 point, Vector3 center, double scale);
@@ -48,5 +68,19 @@ Vector2Double calculate_sphere_uv(Vector3 point, Vector3 center, double scale);
 struct Sphere sphere_create(Vector3 center, double radius, Vector3 color, double reflectivity, 
                           double fresnel_ior, double fresnel_power);
 int sphere_intersect(struct Sphere* sphere, Ray ray, double t_min, double t_max, Hit* hit);
+// Whether the ray hits the sphere within (t_min, t_max), computing no hit attributes
+int sphere_occludes(const struct Sphere* sphere, const Ray* ray, double t_min, double t_max);
+// Recompute a confirmed hit's distance, point and normal in double-double
+// precision, for scenes whose coordinates dwarf their feature sizes
+void sphere_refine_hit(const struct Sphere* sphere, const Ray* ray, Hit* hit);
+AABB sphere_bounds(const struct Sphere* sphere);
+
+// Closest hit among batch slots [first, first + count). Reports the slot and
+// distance only; the caller fills in hit attributes for that one sphere.
+int sphere_batch_intersect(const SphereBatch* batch, int first, int count, const Ray* ray,
+                           double t_min, double t_max, int* hit_slot, double* hit_t);
+// Whether any shadow-casting sphere in [first, first + count) is hit
+int sphere_batch_occluded(const SphereBatch* batch, int first, int count, const Ray* ray,
+                          double t_min, double t_max);
 
 #endif
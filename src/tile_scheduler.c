@@ -0,0 +1,117 @@
+#include "tile_scheduler.h"
+#include <stdlib.h>
+
+static inline uint64_t pack_range(uint32_t top, uint32_t bottom) {
+    return ((uint64_t)top << 32) | bottom;
+}
+
+static inline uint32_t range_top(uint64_t range) {
+    return (uint32_t)(range >> 32);
+}
+
+static inline uint32_t range_bottom(uint64_t range) {
+    return (uint32_t)range;
+}
+
+int tile_scheduler_init(TileScheduler* sched, int width, int height, int tile_size, int worker_count) {
+    if (tile_size <= 0) tile_size = DEFAULT_TILE_SIZE;
+    if (worker_count <= 0) worker_count = 1;
+
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    sched->tile_count = tiles_x * tiles_y;
+    sched->worker_count = worker_count;
+    sched->tiles = (Tile*)malloc(sched->tile_count * sizeof(Tile));
+    sched->deques = (TileDeque*)calloc(worker_count, sizeof(TileDeque));
+
+    if (!sched->tiles || !sched->deques) {
+        tile_scheduler_destroy(sched);
+        return 0;
+    }
+
+    // Row-major tile order keeps each worker's initial block spatially coherent
+    int index = 0;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            Tile* tile = &sched->tiles[index++];
+            tile->x0 = tx * tile_size;
+            tile->y0 = ty * tile_size;
+            tile->x1 = tile->x0 + tile_size < width ? tile->x0 + tile_size : width;
+            tile->y1 = tile->y0 + tile_size < height ? tile->y0 + tile_size : height;
+        }
+    }
+
+    tile_scheduler_reset(sched);
+    return 1;
+}
+
+void tile_scheduler_reset(TileScheduler* sched) {
+    for (int w = 0; w < sched->worker_count; w++) {
+        uint32_t top = (uint32_t)((long)sched->tile_count * w / sched->worker_count);
+        uint32_t bottom = (uint32_t)((long)sched->tile_count * (w + 1) / sched->worker_count);
+        atomic_store(&sched->deques[w].range, pack_range(top, bottom));
+    }
+}
+
+static int pop_own(TileDeque* deque) {
+    uint64_t range = atomic_load(&deque->range);
+    while (range_top(range) < range_bottom(range)) {
+        uint64_t taken = pack_range(range_top(range) + 1, range_bottom(range));
+        if (atomic_compare_exchange_weak(&deque->range, &range, taken)) {
+            return (int)range_top(range);
+        }
+    }
+    return -1;
+}
+
+// Take the bottom half of a victim's range. The first stolen tile is returned
+// for immediate use and the remainder becomes the thief's own deque.
+static int steal_half(TileDeque* victim, TileDeque* own) {
+    uint64_t range = atomic_load(&victim->range);
+    while (range_top(range) < range_bottom(range)) {
+        uint32_t top = range_top(range);
+        uint32_t bottom = range_bottom(range);
+        uint32_t mid = top + (bottom - top) / 2;
+        if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(top, mid))) {
+            // Own deque is empty here, so no thief can be racing on it
+            atomic_store(&own->range, pack_range(mid + 1, bottom));
+            return (int)mid;
+        }
+    }
+    return -1;
+}
+
+int tile_scheduler_next(TileScheduler* sched, int worker) {
+    TileDeque* own = &sched->deques[worker];
+    int index = pop_own(own);
+    if (index >= 0) return index;
+
+    // Steal from whichever worker has the most work left
+    for (;;) {
+        int victim = -1;
+        uint32_t most = 0;
+        for (int w = 0; w < sched->worker_count; w++) {
+            if (w == worker) continue;
+            uint64_t range = atomic_load(&sched->deques[w].range);
+            uint32_t remaining = range_bottom(range) - range_top(range);
+            if (range_top(range) < range_bottom(range) && remaining > most) {
+                most = remaining;
+                victim = w;
+            }
+        }
+        if (victim < 0) return -1;
+
+        index = steal_half(&sched->deques[victim], own);
+        if (index >= 0) return index;
+    }
+}
+
+void tile_scheduler_destroy(TileScheduler* sched) {
+    free(sched->tiles);
+    free(sched->deques);
+    sched->tiles = NULL;
+    sched->deques = NULL;
+    sched->tile_count = 0;
+    sched->worker_count = 0;
+}
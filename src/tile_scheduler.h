@@ -0,0 +1,45 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define DEFAULT_TILE_SIZE 16
+
+// Rectangular block of the framebuffer rendered as a single unit of work.
+// Coordinates are in image space (row 0 is the top scanline).
+typedef struct {
+    int x0, y0;  // Inclusive start
+    int x1, y1;  // Exclusive end
+} Tile;
+
+// Per-worker deque of tile indices. Tiles handed to a worker are always a
+// contiguous index range, so the deque is just [top, bottom) packed into one
+// word: the owner pops from the top, thieves split off the bottom half, and
+// both sides resolve with a single compare-and-swap.
+typedef struct {
+    _Atomic uint64_t range;
+    char padding[64 - sizeof(uint64_t)];  // Keep deques on separate cache lines
+} TileDeque;
+
+typedef struct {
+    Tile* tiles;
+    int tile_count;
+    TileDeque* deques;
+    int worker_count;
+} TileScheduler;
+
+// Split a width x height image into tile_size squares for worker_count workers.
+// Returns 0 on allocation failure.
+int tile_scheduler_init(TileScheduler* sched, int width, int height, int tile_size, int worker_count);
+
+// Hand every tile back out, each worker starting on its own contiguous block
+void tile_scheduler_reset(TileScheduler* sched);
+
+// Fetch the next tile for a worker, stealing from other workers once its own
+// deque runs dry. Returns the tile index, or -1 when the frame is exhausted.
+int tile_scheduler_next(TileScheduler* sched, int worker);
+
+void tile_scheduler_destroy(TileScheduler* sched);
+
+#endif
@@ -10,16 +10,30 @@
 #define EPSILON 1e-8
 #define MIN_DENOMINATOR 1e-10
 
-// Global precision mode setting
-static PrecisionMode current_precision_mode = PRECISION_DOUBLE;
+#ifdef VECTOR_ARBITRARY_PRECISION
+// Global precision mode setting. Arbitrary-precision builds render in
+// arbitrary precision unless switched back to double (--precision double).
+static PrecisionMode current_precision_mode = PRECISION_ARBITRARY;
 
 void vector_set_precision_mode(PrecisionMode mode) {
+    if (mode == PRECISION_FLOAT) {
+        fprintf(stderr, "Warning: Single precision needs a VECTOR_FLOAT build; using double precision\n");
+        mode = PRECISION_DOUBLE;
+    }
     current_precision_mode = mode;
 }
 
 PrecisionMode vector_get_precision_mode(void) {
     return current_precision_mode;
 }
+#else
+void vector_set_precision_mode(PrecisionMode mode) {
+    if (mode != vector_get_precision_mode()) {
+        fprintf(stderr, "Warning: Precision is fixed when building (see make arbitrary and make float); "
+                        "keeping the build's precision\n");
+    }
+}
+#endif
 
 // String-based vector implementation
 Vector3String vector3_string_create(const char* x, const char* y, const char* z) {
@@ -123,6 +137,7 @@ Vector3String vector3_double_to_string(const Vector3* v) {
     return vector3_string_create(x, y, z);
 }
 
+#ifdef VECTOR_ARBITRARY_PRECISION
 Vector3 vector_create(double x, double y, double z) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         char x_str[64], y_str[64], z_str[64];
@@ -142,14 +157,14 @@ Vector3 vector_add(Vector3 a, Vector3 b) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_add(a, b);
     }
-    return vector_create(a.x + b.x, a.y + b.y, a.z + b.z);
+    return vector3_kernel_add(a, b);
 }
 
 Vector3 vector_subtract(Vector3 a, Vector3 b) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_subtract(a, b);
     }
-    return vector_create(a.x - b.x, a.y - b.y, a.z - b.z);
+    return vector3_kernel_subtract(a, b);
 }
 
 Vector3 vector_multiply(Vector3 v, double scalar) {
@@ -158,11 +173,7 @@ Vector3 vector_multiply(Vector3 v, double scalar) {
         snprintf(scalar_str, sizeof(scalar_str), "%.20f", scalar);
         return aplib_vector_multiply(v, scalar_str);
     }
-    // Handle very small numbers
-    if (fabs(scalar) < EPSILON) {
-        return vector_create(0.0, 0.0, 0.0);
-    }
-    return vector_create(v.x * scalar, v.y * scalar, v.z * scalar);
+    return vector3_kernel_multiply(v, scalar);
 }
 
 Vector3 vector_multiply_precise(Vector3 v, double scalar) {
@@ -200,46 +211,37 @@ double vector_dot(Vector3 a, Vector3 b) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_dot(a, b);
     }
-    // Use fma for higher precision dot product
-    return fma(a.x, b.x, fma(a.y, b.y, a.z * b.z));
+    return vector3_kernel_dot(a, b);
 }
 
 Vector3 vector_cross(Vector3 a, Vector3 b) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_cross(a, b);
     }
-    return vector_create(
-        fma(a.y, b.z, -a.z * b.y),
-        fma(a.z, b.x, -a.x * b.z),
-        fma(a.x, b.y, -a.y * b.x)
-    );
+    return vector3_kernel_cross(a, b);
 }
 
 double vector_length(Vector3 v) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_length(v);
     }
-    double dot = vector_dot(v, v);
-    return sqrt(fmax(0.0, dot));  // Prevent negative sqrt input
+    return vector3_kernel_length(v);
 }
 
 Vector3 vector_normalize(Vector3 v) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_normalize(v);
     }
-    double length = vector_length(v);
-    return vector_safe_divide(v, length, v);
+    return vector3_kernel_normalize(v);
 }
 
 Vector3 vector_reflect(Vector3 v, Vector3 normal) {
     if (current_precision_mode == PRECISION_ARBITRARY) {
         return aplib_vector_reflect(v, normal);
     }
-    double dot = vector_dot(v, normal);
-    Vector3 scaled = vector_multiply_precise(normal, 2.0 * dot);
-    return vector_subtract(v, scaled);
+    return vector3_kernel_reflect(v, normal);
 }
-
+#endif
 
 // Vector2Double operations implementation
 Vector2Double vector2_double_create(double u, double v) {
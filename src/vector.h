@@ -2,13 +2,29 @@
 #define VECTOR_H
 
 #include "stringy.h"
+#include <float.h>
 
 // Precision mode enumeration
 typedef enum {
     PRECISION_DOUBLE,    // Standard double precision
-    PRECISION_ARBITRARY  // Arbitrary precision using APDecimal
+    PRECISION_ARBITRARY, // Arbitrary precision using APDecimal
+    PRECISION_FLOAT      // Single precision components (VECTOR_FLOAT builds)
 } PrecisionMode;
 
+// Component type of Vector3. Float builds (make float) store geometry, rays
+// and the framebuffer in single precision; scalars passed to and returned by
+// the vector operations stay double.
+#ifdef VECTOR_FLOAT
+#ifdef VECTOR_ARBITRARY_PRECISION
+#error "VECTOR_FLOAT and VECTOR_ARBITRARY_PRECISION cannot be combined"
+#endif
+typedef float vector_real;
+#define VECTOR_REAL_EPSILON FLT_EPSILON
+#else
+typedef double vector_real;
+#define VECTOR_REAL_EPSILON DBL_EPSILON
+#endif
+
 // Double-based vector2 representation
 typedef struct {
     double u, v;
@@ -52,16 +68,22 @@ typedef struct {
     StringHandle* z;
 } Vector3String;
 
-// Double-based vector representation
+// Numeric vector representation
 typedef struct {
-    double x, y, z;
+    vector_real x, y, z;
 } Vector3;
 
-// Precision mode control
+#include "vector_kernel.h"
+
+// Precision mode control. Arbitrary precision is only available in builds
+// with VECTOR_ARBITRARY_PRECISION (make arbitrary), where it is the default;
+// other builds always run in their component precision.
 void vector_set_precision_mode(PrecisionMode mode);
+
+#ifdef VECTOR_ARBITRARY_PRECISION
 PrecisionMode vector_get_precision_mode(void);
 
-// Standard double precision operations
+// Operations dispatching on the runtime precision mode
 Vector3 vector_create(double x, double y, double z);
 Vector3 vector_add(Vector3 a, Vector3 b);
 Vector3 vector_subtract(Vector3 a, Vector3 b);
@@ -75,6 +97,31 @@ Vector3 vector_cross(Vector3 a, Vector3 b);
 double vector_length(Vector3 v);
 Vector3 vector_normalize(Vector3 v);
 Vector3 vector_reflect(Vector3 v, Vector3 normal);
+#else
+// Without arbitrary precision the operations bind straight to the inline
+// kernel, so hot loops pay no call or mode check
+#ifdef VECTOR_FLOAT
+static inline PrecisionMode vector_get_precision_mode(void) { return PRECISION_FLOAT; }
+#else
+static inline PrecisionMode vector_get_precision_mode(void) { return PRECISION_DOUBLE; }
+#endif
+
+static inline Vector3 vector_create(double x, double y, double z) { return vector3_kernel_create(x, y, z); }
+static inline Vector3 vector_add(Vector3 a, Vector3 b) { return vector3_kernel_add(a, b); }
+static inline Vector3 vector_subtract(Vector3 a, Vector3 b) { return vector3_kernel_subtract(a, b); }
+static inline Vector3 vector_multiply(Vector3 v, double scalar) { return vector3_kernel_multiply(v, scalar); }
+static inline Vector3 vector_multiply_precise(Vector3 v, double scalar) { return vector3_kernel_multiply_precise(v, scalar); }
+static inline Vector3 vector_multiply_vec(Vector3 a, Vector3 b) { return vector3_kernel_multiply_vec(a, b); }
+static inline Vector3 vector_divide(Vector3 v, double scalar) { return vector3_kernel_divide(v, scalar); }
+static inline Vector3 vector_safe_divide(Vector3 v, double scalar, Vector3 fallback) {
+    return vector3_kernel_safe_divide(v, scalar, fallback);
+}
+static inline double vector_dot(Vector3 a, Vector3 b) { return vector3_kernel_dot(a, b); }
+static inline Vector3 vector_cross(Vector3 a, Vector3 b) { return vector3_kernel_cross(a, b); }
+static inline double vector_length(Vector3 v) { return vector3_kernel_length(v); }
+static inline Vector3 vector_normalize(Vector3 v) { return vector3_kernel_normalize(v); }
+static inline Vector3 vector_reflect(Vector3 v, Vector3 normal) { return vector3_kernel_reflect(v, normal); }
+#endif
 
 // String-based vector operations
 Vector3String vector3_string_create(const char* x, const char* y, const char* z);
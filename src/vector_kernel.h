@@ -0,0 +1,98 @@
+#ifndef VECTOR_KERNEL_H
+#define VECTOR_KERNEL_H
+
+// Inline Vector3 kernel, computing in the build's component precision
+// (vector_real). Included by vector.h once Vector3 is defined; include
+// vector.h rather than this header.
+
+#include <math.h>
+
+#define VECTOR_EPSILON 1e-8
+#define VECTOR_MIN_DENOMINATOR 1e-10
+
+#ifdef VECTOR_FLOAT
+#define VECTOR_FMA fmaf
+#define VECTOR_SQRT sqrtf
+#define VECTOR_FMAX fmaxf
+#define VECTOR_FABS fabsf
+#else
+#define VECTOR_FMA fma
+#define VECTOR_SQRT sqrt
+#define VECTOR_FMAX fmax
+#define VECTOR_FABS fabs
+#endif
+
+static inline Vector3 vector3_kernel_create(vector_real x, vector_real y, vector_real z) {
+    Vector3 v = {x, y, z};
+    return v;
+}
+
+static inline Vector3 vector3_kernel_add(Vector3 a, Vector3 b) {
+    return vector3_kernel_create(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline Vector3 vector3_kernel_subtract(Vector3 a, Vector3 b) {
+    return vector3_kernel_create(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline Vector3 vector3_kernel_multiply(Vector3 v, vector_real scalar) {
+    // Handle very small numbers
+    if (VECTOR_FABS(scalar) < VECTOR_EPSILON) {
+        return vector3_kernel_create(0, 0, 0);
+    }
+    return vector3_kernel_create(v.x * scalar, v.y * scalar, v.z * scalar);
+}
+
+static inline Vector3 vector3_kernel_multiply_precise(Vector3 v, vector_real scalar) {
+    // Use fma for higher precision multiplication
+    return vector3_kernel_create(VECTOR_FMA(v.x, scalar, 0), VECTOR_FMA(v.y, scalar, 0),
+                                 VECTOR_FMA(v.z, scalar, 0));
+}
+
+static inline Vector3 vector3_kernel_multiply_vec(Vector3 a, Vector3 b) {
+    return vector3_kernel_create(VECTOR_FMA(a.x, b.x, 0), VECTOR_FMA(a.y, b.y, 0), VECTOR_FMA(a.z, b.z, 0));
+}
+
+static inline Vector3 vector3_kernel_divide(Vector3 v, vector_real scalar) {
+    // Prevent division by very small numbers
+    if (VECTOR_FABS(scalar) < VECTOR_EPSILON) {
+        scalar = scalar < 0 ? -VECTOR_EPSILON : VECTOR_EPSILON;
+    }
+    return vector3_kernel_create(v.x / scalar, v.y / scalar, v.z / scalar);
+}
+
+static inline Vector3 vector3_kernel_safe_divide(Vector3 v, vector_real scalar, Vector3 fallback) {
+    if (VECTOR_FABS(scalar) < VECTOR_MIN_DENOMINATOR) {
+        return fallback;
+    }
+    return vector3_kernel_create(v.x / scalar, v.y / scalar, v.z / scalar);
+}
+
+static inline vector_real vector3_kernel_dot(Vector3 a, Vector3 b) {
+    // Use fma for higher precision dot product
+    return VECTOR_FMA(a.x, b.x, VECTOR_FMA(a.y, b.y, a.z * b.z));
+}
+
+static inline Vector3 vector3_kernel_cross(Vector3 a, Vector3 b) {
+    return vector3_kernel_create(
+        VECTOR_FMA(a.y, b.z, -a.z * b.y),
+        VECTOR_FMA(a.z, b.x, -a.x * b.z),
+        VECTOR_FMA(a.x, b.y, -a.y * b.x)
+    );
+}
+
+static inline vector_real vector3_kernel_length(Vector3 v) {
+    vector_real dot = vector3_kernel_dot(v, v);
+    return VECTOR_SQRT(VECTOR_FMAX(0, dot));  // Prevent negative sqrt input
+}
+
+static inline Vector3 vector3_kernel_normalize(Vector3 v) {
+    return vector3_kernel_safe_divide(v, vector3_kernel_length(v), v);
+}
+
+static inline Vector3 vector3_kernel_reflect(Vector3 v, Vector3 normal) {
+    vector_real dot = vector3_kernel_dot(v, normal);
+    return vector3_kernel_subtract(v, vector3_kernel_multiply_precise(normal, 2 * dot));
+}
+
+#endif
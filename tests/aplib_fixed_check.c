@@ -0,0 +1,194 @@
+// Checks for the 256-bit fixed-point kernel in aplib.c. Expected limbs were
+// worked out with exact integer arithmetic, so the kernel is never its own
+// reference. Prints each failed check and exits non-zero if any failed.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "aplib.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition);     \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static APFixed fixed(uint64_t l0, uint64_t l1, uint64_t l2, uint64_t l3, int negative) {
+    APFixed value = {{l0, l1, l2, l3}, negative};
+    return value;
+}
+
+static int fixed_equal(APFixed a, APFixed b) {
+    for (int i = 0; i < APFIXED_LIMBS; i++) {
+        if (a.limb[i] != b.limb[i]) return 0;
+    }
+    return a.negative == b.negative;
+}
+
+static int fixed_is_saturated(APFixed value, int negative) {
+    return fixed_equal(value, fixed(UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, negative));
+}
+
+static const APFixed zero = {{0, 0, 0, 0}, 0};
+static const APFixed one = {{0, 0, 1, 0}, 0};
+static const APFixed resolution = {{1, 0, 0, 0}, 0};
+
+static void check_carries(void) {
+    // 1 - 2^-128 plus 2^-128 carries through both fraction limbs
+    APFixed below_one = fixed(UINT64_MAX, UINT64_MAX, 0, 0, 0);
+    CHECK(fixed_equal(aplib_fixed_add(below_one, resolution), one));
+    CHECK(fixed_equal(aplib_fixed_add(fixed(0, 1ULL << 63, 0, 0, 0), fixed(0, 1ULL << 63, 0, 0, 0)), one));
+    CHECK(fixed_equal(aplib_fixed_add(fixed(0, 0, UINT64_MAX, 0, 0), one), fixed(0, 0, 0, 1, 0)));
+
+    // Borrows run back down the same limbs
+    CHECK(fixed_equal(aplib_fixed_subtract(one, resolution), below_one));
+    CHECK(fixed_equal(aplib_fixed_subtract(fixed(0, 0, 0, 1, 0), resolution),
+                      fixed(UINT64_MAX, UINT64_MAX, UINT64_MAX, 0, 0)));
+
+    // Mixed signs subtract magnitudes and take the larger one's sign
+    APFixed three = fixed(0, 0, 3, 0, 0);
+    CHECK(fixed_equal(aplib_fixed_subtract(one, three), fixed(0, 0, 2, 0, 1)));
+    CHECK(fixed_equal(aplib_fixed_add(fixed(0, 0, 1, 0, 1), three), fixed(0, 0, 2, 0, 0)));
+}
+
+static void check_zero_results(void) {
+    APFixed value = fixed(0x0123456789abcdefULL, 42, 7, 1, 0);
+    APFixed negative = value;
+    negative.negative = 1;
+
+    // Exact cancellation gives zero without a sign
+    CHECK(fixed_equal(aplib_fixed_subtract(value, value), zero));
+    CHECK(fixed_equal(aplib_fixed_subtract(negative, negative), zero));
+    CHECK(fixed_equal(aplib_fixed_add(value, negative), zero));
+    CHECK(fixed_equal(aplib_fixed_add(negative, value), zero));
+    CHECK(fixed_equal(aplib_fixed_multiply(negative, zero), zero));
+    CHECK(fixed_equal(aplib_fixed_from_double(-0.0), zero));
+    CHECK(fixed_equal(aplib_fixed_from_string("-0.000"), zero));
+}
+
+static void check_divide(void) {
+    APFixed five = fixed(0, 0, 5, 0, 0);
+    APFixed minus_five = fixed(0, 0, 5, 0, 1);
+
+    CHECK(fixed_is_saturated(aplib_fixed_divide(five, zero), 0));
+    CHECK(fixed_is_saturated(aplib_fixed_divide(minus_five, zero), 1));
+    CHECK(fixed_equal(aplib_fixed_divide(zero, zero), zero));
+
+    // Quotients truncate: floor(2^128 / 3)
+    APFixed third = fixed(0x5555555555555555ULL, 0x5555555555555555ULL, 0, 0, 0);
+    CHECK(fixed_equal(aplib_fixed_divide(one, fixed(0, 0, 3, 0, 0)), third));
+    CHECK(fixed_equal(aplib_fixed_divide(minus_five, fixed(0, 0, 2, 0, 0)), fixed(0, 1ULL << 63, 2, 0, 1)));
+
+    // A quotient above 2^128 saturates
+    CHECK(fixed_is_saturated(aplib_fixed_divide(fixed(0, 0, 0, 1, 0), resolution), 0));
+}
+
+static void check_saturation(void) {
+    APFixed large = aplib_fixed_from_double(1e30);
+    APFixed minus_large = aplib_fixed_from_double(-1e30);
+    CHECK(fixed_is_saturated(aplib_fixed_multiply(large, large), 0));
+    CHECK(fixed_is_saturated(aplib_fixed_multiply(minus_large, large), 1));
+    CHECK(fixed_is_saturated(aplib_fixed_multiply(minus_large, minus_large), 0));
+
+    // 2^127 + 2^127 carries out of the top limb
+    APFixed half_range = fixed(0, 0, 0, 1ULL << 63, 0);
+    APFixed minus_half_range = fixed(0, 0, 0, 1ULL << 63, 1);
+    CHECK(fixed_is_saturated(aplib_fixed_add(half_range, half_range), 0));
+    CHECK(fixed_is_saturated(aplib_fixed_subtract(minus_half_range, half_range), 1));
+
+    APFixed max = fixed(UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, 0);
+    CHECK(fixed_is_saturated(aplib_fixed_add(max, max), 0));
+    CHECK(fixed_is_saturated(aplib_fixed_add(max, resolution), 0));
+
+    CHECK(fixed_is_saturated(aplib_fixed_from_double(1e40), 0));
+    CHECK(fixed_is_saturated(aplib_fixed_from_double(-INFINITY), 1));
+    CHECK(fixed_is_saturated(aplib_fixed_from_string("1000000000000000000000000000000000000000"), 0));
+}
+
+static void check_multiply_rounding(void) {
+    // Products round on the highest discarded bit
+    APFixed half = fixed(0, 1ULL << 63, 0, 0, 0);
+    APFixed quarter = fixed(0, 1ULL << 62, 0, 0, 0);
+    CHECK(fixed_equal(aplib_fixed_multiply(resolution, half), resolution));
+    CHECK(fixed_equal(aplib_fixed_multiply(resolution, quarter), zero));
+    CHECK(fixed_equal(aplib_fixed_multiply(fixed(0, 1ULL << 63, 1, 0, 0), fixed(0, 0, 4, 0, 1)),
+                      fixed(0, 0, 6, 0, 1)));
+}
+
+static void check_parsing(void) {
+    CHECK(fixed_equal(aplib_fixed_from_string("123.25"), fixed(0, 1ULL << 62, 123, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_from_string("-0.5"), fixed(0, 1ULL << 63, 0, 0, 1)));
+    CHECK(fixed_equal(aplib_fixed_from_string("  +7"), fixed(0, 0, 7, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_from_string("1.375"), fixed(0, 0x6000000000000000ULL, 1, 0, 0)));
+
+    // Integer digits spanning both integer limbs
+    CHECK(fixed_equal(aplib_fixed_from_string("12345678901234567890123"),
+                      fixed(0, 0, 0x42b64e76714244cbULL, 0x29d, 0)));
+
+    // Fractions that are not dyadic truncate to floor(x * 2^128)
+    CHECK(fixed_equal(aplib_fixed_from_string("0.1"), fixed(0x9999999999999999ULL, 0x1999999999999999ULL, 0, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_from_string("0.123456789"),
+                      fixed(0x242081e6dba7ed2aULL, 0x1f9add3739635f31ULL, 0, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_from_string("-1000000000.1"),
+                      fixed(0x9999999999999999ULL, 0x1999999999999999ULL, 1000000000, 0, 1)));
+}
+
+static void check_to_double(void) {
+    // 1 + 2^-53 is a tie and rounds to even; any lower bit breaks the tie
+    CHECK(aplib_fixed_to_double(fixed(0, 1ULL << 11, 1, 0, 0)) == 1.0);
+    CHECK(aplib_fixed_to_double(fixed(1, 1ULL << 11, 1, 0, 0)) == 1.0 + 0x1p-52);
+    CHECK(aplib_fixed_to_double(fixed(0, 3ULL << 11, 1, 0, 0)) == 1.0 + 0x1p-51);
+    CHECK(aplib_fixed_to_double(fixed(0, (1ULL << 11) - 1, 1, 0, 0)) == 1.0);
+
+    // The same ties above 2^64, where the sticky bits sit two limbs down
+    CHECK(aplib_fixed_to_double(fixed(0, 0, 1ULL << 11, 1, 0)) == 0x1p64);
+    CHECK(aplib_fixed_to_double(fixed(1, 0, 1ULL << 11, 1, 0)) == 0x1p64 + 0x1p12);
+    CHECK(aplib_fixed_to_double(fixed(0, 1, 1ULL << 11, 1, 1)) == -(0x1p64 + 0x1p12));
+
+    CHECK(aplib_fixed_to_double(resolution) == 0x1p-128);
+    CHECK(aplib_fixed_to_double(zero) == 0.0);
+    CHECK(aplib_fixed_to_double(fixed(UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, 0)) == 0x1p128);
+
+    // Doubles inside the range round-trip exactly
+    const double values[] = {1.0 / 3.0, -2.5e-3, 1e9 + 0.37, 1e38, -0x1p-100, 12345.6789};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        CHECK(aplib_fixed_to_double(aplib_fixed_from_double(values[i])) == values[i]);
+    }
+
+    // Bits below 2^-128 are truncated on the way in
+    CHECK(fixed_equal(aplib_fixed_from_double(0x1p-128 + 0x1p-140), resolution));
+    CHECK(fixed_equal(aplib_fixed_from_double(0x1p-129), zero));
+}
+
+static void check_sqrt(void) {
+    CHECK(fixed_equal(aplib_fixed_sqrt(fixed(0, 0, 4, 0, 0)), fixed(0, 0, 2, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_sqrt(fixed(0, 1ULL << 62, 0, 0, 0)), fixed(0, 1ULL << 63, 0, 0, 0)));
+    CHECK(fixed_equal(aplib_fixed_sqrt(zero), zero));
+    CHECK(fixed_equal(aplib_fixed_sqrt(fixed(0, 0, 1, 0, 1)), zero));
+
+    // floor(sqrt(2) * 2^128)
+    CHECK(fixed_equal(aplib_fixed_sqrt(fixed(0, 0, 2, 0, 0)),
+                      fixed(0xb2fb1366ea957d3eULL, 0x6a09e667f3bcc908ULL, 1, 0, 0)));
+}
+
+int main(void) {
+    check_carries();
+    check_zero_results();
+    check_divide();
+    check_saturation();
+    check_multiply_rounding();
+    check_parsing();
+    check_to_double();
+    check_sqrt();
+
+    if (failures) {
+        fprintf(stderr, "%d fixed-point check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All fixed-point checks passed\n");
+    return 0;
+}